@@ -0,0 +1,1471 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <math.h>
+#include <sched.h>
+#include "ring_buffer.h"
+#include "ring_buffer_dispatch.h"
+#include "ring_buffer_parking.h"
+#include "fixed_size_ring_buffer.h"
+#include "fixed_size_ring_buffer.c"
+#include "fixed_size_mpmc_ring_buffer.h"
+#include "fixed_size_mpmc_ring_buffer.c"
+#include "fixed_size_ring_buffer_specialized.h"
+#include "ring_allocation.h"
+#include "tsc_clock.h"
+#include "latency_histogram.h"
+#include "perf_counters.h"
+
+/**
+ * Throughput and latency benchmark of any ring, configured from the command line: see usage().
+ * Each producer sends the sequence 1..messages, tagged with its id on the high bits, and the consumers check the
+ * checksum of what they read and, if there is only one of them, the order of each producer's sequence too.
+ * The latency modes carry a TSC timestamp after the sequence: oneway records in the consumers how old is each message,
+ * pingpong has the consumer echoing each message on a second ring and records in the producer the round trip.
+ * With --perf each thread counts its own hardware events, summed per run across the producers and the consumers.
+ */
+
+#define MSG_TYPE_ID 1
+#define MAX_PRODUCERS 64
+#define MAX_CONSUMERS 64
+#define MAX_CPUS (MAX_PRODUCERS + MAX_CONSUMERS)
+#define MAX_RUNS 1024
+#define PRODUCER_ID_SHIFT 48
+#define MAX_LOOKAHEAD_CLAIM 4096
+//failed attempts before the parking consumer and claims park, and the longest park
+#define PARKING_MAX_SPINS 1024
+#define PARKING_TIMEOUT_NANOS 1000000
+//the only message size and capacity of --ring=specialized, being compile time constants
+#ifndef FRANZ_FLOW_SPECIALIZED_MSG_SIZE
+#define FRANZ_FLOW_SPECIALIZED_MSG_SIZE 8
+#endif
+#ifndef FRANZ_FLOW_SPECIALIZED_CAPACITY
+#define FRANZ_FLOW_SPECIALIZED_CAPACITY (64 * 1024)
+#endif
+
+enum ring_kind {
+    RING_KIND_RING_BUFFER,
+    RING_KIND_FIXED_SIZE,
+    RING_KIND_MPMC,
+    //fixed_size compiled for FRANZ_FLOW_SPECIALIZED_MSG_SIZE and FRANZ_FLOW_SPECIALIZED_CAPACITY
+    RING_KIND_SPECIALIZED
+};
+
+enum claim_mode {
+    CLAIM_MODE_SP,
+    CLAIM_MODE_MP,
+    CLAIM_MODE_XADD,
+    CLAIM_MODE_BATCH,
+    CLAIM_MODE_LOOKAHEAD
+};
+
+enum consumer_mode {
+    CONSUMER_MODE_SINGLE,
+    CONSUMER_MODE_BATCH,
+    CONSUMER_MODE_STREAM,
+    //batch reads zeroing with streaming stores
+    CONSUMER_MODE_NT,
+    //batch reads zeroing and releasing a chunk at time
+    CONSUMER_MODE_CHUNKED,
+    //batch reads scanning the ready slots first
+    CONSUMER_MODE_SCAN,
+    //batch reads dispatching by msg type id through a jump table
+    CONSUMER_MODE_TABLE,
+    //batch reads dispatching by msg type id through a generated switch
+    CONSUMER_MODE_SWITCH,
+    //controlled reads, releasing the read records at the end of each
+    CONSUMER_MODE_CONTROLLED,
+    //batch reads parking when the ring is empty, woken by parking claims and commits
+    CONSUMER_MODE_PARKING
+};
+
+enum benchmark_mode {
+    BENCHMARK_MODE_THROUGHPUT,
+    BENCHMARK_MODE_PINGPONG,
+    BENCHMARK_MODE_ONEWAY
+};
+
+enum output_format {
+    OUTPUT_FORMAT_TEXT,
+    OUTPUT_FORMAT_JSON,
+    OUTPUT_FORMAT_CSV
+};
+
+static const char *const BENCHMARK_MODE_NAMES[] = {"throughput", "pingpong", "oneway", NULL};
+static const char *const RING_KIND_NAMES[] = {"ring_buffer", "fixed_size", "mpmc", "specialized", NULL};
+static const char *const CLAIM_MODE_NAMES[] = {"sp", "mp", "xadd", "batch", "lookahead", NULL};
+static const char *const CONSUMER_MODE_NAMES[] = {"single", "batch", "stream", "nt", "chunked", "scan", "table",
+                                                    "switch", "controlled", "parking", NULL};
+static const char *const SLOT_LAYOUT_NAMES[] = {"packed", "separated", "cache_line", NULL};
+static const char *const IDLE_STRATEGY_NAMES[] = {"noop", "busy", "pause", "backoff", NULL};
+static const char *const PAGE_KIND_NAMES[] = {"default", "thp", "hugetlb", NULL};
+static const char *const OUTPUT_FORMAT_NAMES[] = {"text", "json", "csv", NULL};
+
+struct benchmark_options {
+    enum benchmark_mode mode;
+    enum ring_kind ring;
+    enum claim_mode claim;
+    enum consumer_mode consumer;
+    index_t msg_size;
+    index_t capacity;
+    //of fixed_size only
+    enum fixed_size_slot_layout slot_layout;
+    uint32_t payload_alignment;
+    uint32_t claim_batch_size;
+    uint32_t read_batch_size;
+    //bytes zeroed and released at time by the chunked consumer, 0 for a 16th of the ring
+    index_t zero_chunk;
+    uint32_t producers;
+    uint32_t consumers;
+    uint64_t messages;
+    uint32_t warmup;
+    uint32_t runs;
+    //messages per second of each producer on the latency modes, 0 to send as soon as possible
+    uint64_t rate;
+    enum idle_strategy_kind idle_strategy_kind;
+    int cpus[MAX_CPUS];
+    uint32_t cpu_count;
+    enum ring_page_kind page_kind;
+    bool prefault;
+    int numa_node;
+    enum output_format format;
+    bool perf;
+    //0 if the HITM event isn't known on this cpu
+    uint64_t hitm_raw_config;
+};
+
+struct benchmark_ring {
+    struct ring_buffer_header header;
+    struct fixed_size_ring_buffer_header fixed_size_header;
+    uint8_t *buffer;
+};
+
+struct benchmark {
+    const struct benchmark_options *options;
+    //the second ring carries the echoes of pingpong only
+    struct benchmark_ring rings[2];
+    index_t buffer_length;
+    struct tsc_clock clock;
+    //how many messages the consumers read in a lap of the ring, of all the producers
+    uint64_t lap_messages;
+    pthread_barrier_t start_barrier;
+    _Atomic uint64_t read_messages;
+    _Atomic uint64_t checksum;
+    _Atomic bool failed;
+    //of the consumers on the current run: the producers can fill a whole lap of an empty ring ahead of the reads
+    struct timespec start_time;
+    struct timespec first_lap_time;
+    struct timespec end_read_time;
+};
+
+struct benchmark_thread {
+    struct benchmark *benchmark;
+    pthread_t thread;
+    uint32_t id;
+    int cpu;
+    //NULL if the thread doesn't record any latency
+    struct latency_histogram *histogram;
+    struct perf_counter_values counters;
+};
+
+struct consumer_context {
+    uint64_t checksum;
+    uint32_t producers;
+    bool check_order;
+    bool failed;
+    uint64_t last_msg_ids[MAX_PRODUCERS];
+    const struct tsc_clock *clock;
+    //records the age of each message, if not NULL
+    struct latency_histogram *histogram;
+    //sends back each message on it, if not NULL
+    struct benchmark_ring *echo_ring;
+    struct benchmark *benchmark;
+    struct idle_strategy *idle_strategy;
+    //of the chunked consumer
+    struct ring_buffer_chunked_reader chunked_reader;
+    //of the table consumer
+    struct message_dispatch_table dispatch_table;
+};
+
+struct benchmark_result {
+    uint64_t ops_per_sec[MAX_RUNS];
+    uint32_t runs;
+    double median_ops_per_sec;
+    double mean_ops_per_sec;
+    double stddev_ops_per_sec;
+    uint64_t min_ops_per_sec;
+    uint64_t max_ops_per_sec;
+    //of the very first run, warm-up included: the only one paying the page faults of a not prefaulted ring
+    uint64_t first_lap_ps_per_msg;
+    uint64_t steady_state_ps_per_msg;
+    //of all the measured runs, in ticks of the benchmark's clock
+    struct latency_histogram *latency;
+    struct perf_counter_values producer_counters[MAX_RUNS];
+    struct perf_counter_values consumer_counters[MAX_RUNS];
+};
+
+static uint64_t elapsed_nanos(const struct timespec *const start_time, const struct timespec *const end_time) {
+    return ((end_time->tv_sec - start_time->tv_sec) * 1000000000) + (end_time->tv_nsec - start_time->tv_nsec);
+}
+
+/**
+ * Opens the counters of the calling thread, if required: they are started right after the start barrier.
+ */
+static bool open_thread_perf_counters(const struct benchmark_options *const options,
+                                      struct perf_counters *const perf_counters) {
+    return options->perf && open_perf_counters(perf_counters, options->hitm_raw_config);
+}
+
+static void close_thread_perf_counters(struct perf_counters *const perf_counters,
+                                       struct perf_counter_values *const values) {
+    stop_perf_counters(perf_counters);
+    read_perf_counters(perf_counters, values);
+    close_perf_counters(perf_counters);
+}
+
+static void pin_current_thread(const int cpu) {
+    if (cpu < 0) {
+        return;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+        fprintf(stderr, "can't pin on cpu %d\n", cpu);
+    }
+}
+
+inline static void write_msg_content(uint8_t *const msg_content, const uint64_t producer_id_bits,
+                                     const uint64_t msg_id) {
+    const uint64_t value = producer_id_bits | msg_id;
+    //the content isn't 8 bytes aligned on all the layouts
+    memcpy(msg_content, &value, sizeof(value));
+}
+
+inline static bool is_latency_mode(const struct benchmark_options *const options) {
+    return options->mode != BENCHMARK_MODE_THROUGHPUT;
+}
+
+inline static bool on_fixed_size_message(uint8_t *const buffer, void *const context);
+
+DEFINE_FIXED_SIZE_RING_BUFFER(specialized_ring, FRANZ_FLOW_SPECIALIZED_MSG_SIZE, FRANZ_FLOW_SPECIALIZED_CAPACITY,
+                              on_fixed_size_message)
+
+/**
+ * Claims, writes and commits a single message: the stamp is written after the value on the latency modes only.
+ */
+static void send_message(const struct benchmark *const benchmark, const struct benchmark_ring *const ring,
+                         const uint64_t value, const uint64_t stamp, struct idle_strategy *const idle_strategy) {
+    const struct benchmark_options *const options = benchmark->options;
+    uint8_t *const buffer = ring->buffer;
+    uint8_t *msg_content = NULL;
+    uint64_t idles = 0;
+    switch (options->ring) {
+        case RING_KIND_RING_BUFFER: {
+            const index_t msg_size = options->msg_size;
+            uint64_t claimed_position = 0;
+            index_t claimed_index = 0;
+            //the parking consumer is woken by the parking commit, that its claims pair with
+            if (options->consumer == CONSUMER_MODE_PARKING) {
+                if (options->claim == CLAIM_MODE_MP) {
+                    ring_buffer_parking_mp_claim(&ring->header, buffer, msg_size, PARKING_MAX_SPINS,
+                                                 PARKING_TIMEOUT_NANOS, &claimed_position, &claimed_index, &idles);
+                } else {
+                    ring_buffer_parking_sp_claim(&ring->header, buffer, msg_size, PARKING_MAX_SPINS,
+                                                 PARKING_TIMEOUT_NANOS, &claimed_position, &claimed_index, &idles);
+                }
+                msg_content = buffer + encoded_msg_offset(claimed_index);
+                memcpy(msg_content, &value, sizeof(value));
+                if (is_latency_mode(options)) {
+                    memcpy(msg_content + sizeof(value), &stamp, sizeof(stamp));
+                }
+                ring_buffer_parking_commit(&ring->header, buffer, claimed_index, MSG_TYPE_ID, msg_size);
+                return;
+            }
+            switch (options->claim) {
+                case CLAIM_MODE_MP:
+                    ring_buffer_mp_claim(&ring->header, buffer, msg_size, idle_strategy, &claimed_position,
+                                         &claimed_index, &idles);
+                    break;
+                case CLAIM_MODE_XADD:
+                    ring_buffer_xadd_claim(&ring->header, buffer, msg_size, idle_strategy, &claimed_position,
+                                           &claimed_index, &idles);
+                    break;
+                default:
+                    ring_buffer_sp_claim(&ring->header, buffer, msg_size, idle_strategy, &claimed_position,
+                                         &claimed_index, &idles);
+                    break;
+            }
+            msg_content = buffer + encoded_msg_offset(claimed_index);
+            memcpy(msg_content, &value, sizeof(value));
+            if (is_latency_mode(options)) {
+                memcpy(msg_content + sizeof(value), &stamp, sizeof(stamp));
+            }
+            ring_buffer_commit(buffer, claimed_index, MSG_TYPE_ID, msg_size);
+            return;
+        }
+        case RING_KIND_FIXED_SIZE:
+            switch (options->claim) {
+                case CLAIM_MODE_MP:
+                    fixed_size_ring_buffer_mp_claim(buffer, &ring->fixed_size_header, idle_strategy, &msg_content,
+                                                    &idles);
+                    break;
+                case CLAIM_MODE_LOOKAHEAD:
+                    fixed_size_ring_buffer_lookahead_claim(buffer, &ring->fixed_size_header, MAX_LOOKAHEAD_CLAIM,
+                                                           idle_strategy, &msg_content, &idles);
+                    break;
+                default:
+                    fixed_size_ring_buffer_claim(buffer, &ring->fixed_size_header, idle_strategy, &msg_content,
+                                                 &idles);
+                    break;
+            }
+            memcpy(msg_content, &value, sizeof(value));
+            if (is_latency_mode(options)) {
+                memcpy(msg_content + sizeof(value), &stamp, sizeof(stamp));
+            }
+            fixed_size_ring_buffer_commit_claim(buffer, &ring->fixed_size_header, msg_content);
+            return;
+        case RING_KIND_SPECIALIZED:
+            specialized_ring_claim(buffer, idle_strategy, &msg_content, &idles);
+            memcpy(msg_content, &value, sizeof(value));
+            if (is_latency_mode(options)) {
+                memcpy(msg_content + sizeof(value), &stamp, sizeof(stamp));
+            }
+            specialized_ring_commit_claim(msg_content);
+            return;
+        default:
+            fixed_size_mpmc_ring_buffer_claim(buffer, &ring->fixed_size_header, idle_strategy, &msg_content, &idles);
+            memcpy(msg_content, &value, sizeof(value));
+            if (is_latency_mode(options)) {
+                memcpy(msg_content + sizeof(value), &stamp, sizeof(stamp));
+            }
+            fixed_size_mpmc_ring_buffer_commit_claim(msg_content);
+            return;
+    }
+}
+
+inline static bool on_msg_content(const uint8_t *const msg_content, struct consumer_context *const context) {
+    uint64_t value;
+    memcpy(&value, msg_content, sizeof(value));
+    const uint64_t producer_id = value >> PRODUCER_ID_SHIFT;
+    const uint64_t msg_id = value & ((1UL << PRODUCER_ID_SHIFT) - 1);
+    if (producer_id >= context->producers ||
+        (context->check_order && context->last_msg_ids[producer_id] + 1 != msg_id)) {
+        context->failed = true;
+        return false;
+    }
+    context->last_msg_ids[producer_id] = msg_id;
+    context->checksum += msg_id;
+    if (context->histogram != NULL || context->echo_ring != NULL) {
+        uint64_t stamp;
+        memcpy(&stamp, msg_content + sizeof(value), sizeof(stamp));
+        if (context->histogram != NULL) {
+            const uint64_t now = tsc_clock_ticks(context->clock);
+            //a TSC not in sync across the cores could make a oneway stamp look from the future
+            latency_histogram_record(context->histogram, now > stamp ? now - stamp : 0);
+        }
+        if (context->echo_ring != NULL) {
+            send_message(context->benchmark, context->echo_ring, value, stamp, context->idle_strategy);
+        }
+    }
+    return true;
+}
+
+inline static bool on_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                              const index_t msg_content_length, void *context) {
+    return on_msg_content(buffer + msg_content_index, (struct consumer_context *) context);
+}
+
+inline static bool on_fixed_size_message(uint8_t *const buffer, void *const context) {
+    return on_msg_content(buffer, (struct consumer_context *) context);
+}
+
+inline static bool on_unknown_message(const uint32_t msg_type_id, const uint8_t *buffer,
+                                      const index_t msg_content_index, const index_t msg_content_length,
+                                      void *context) {
+    ((struct consumer_context *) context)->failed = true;
+    return false;
+}
+
+inline static enum controlled_read_action
+on_controlled_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                      const index_t msg_content_length, void *context) {
+    return on_message(msg_type_id, buffer, msg_content_index, msg_content_length, context) ?
+           CONTROLLED_READ_CONTINUE : CONTROLLED_READ_BREAK;
+}
+
+#define BENCHMARK_HANDLERS(CASE) CASE(MSG_TYPE_ID, on_message)
+
+DEFINE_RING_BUFFER_SWITCH_BATCH_READ(benchmark_switch, BENCHMARK_HANDLERS, on_unknown_message)
+
+/**
+ * The chunk of the chunked consumer, for a ring_buffer of capacity bytes.
+ */
+static index_t zero_chunk_length(const struct benchmark_options *const options, const index_t capacity) {
+    if (options->zero_chunk != 0) {
+        return options->zero_chunk;
+    }
+    return capacity / 16 < RECORD_ALIGNMENT ? RECORD_ALIGNMENT : capacity / 16;
+}
+
+/**
+ * Prepares the context to read the ring, that must be empty, with the consumer mode of the benchmark.
+ */
+static void init_consumer_context(const struct benchmark *const benchmark, const struct benchmark_ring *const ring,
+                                  struct consumer_context *const context) {
+    if (benchmark->options->consumer == CONSUMER_MODE_CHUNKED) {
+        //can't fail: the chunk length is validated by main
+        init_ring_buffer_chunked_reader(&ring->header, ring->buffer,
+                                        zero_chunk_length(benchmark->options, ring->header.capacity),
+                                        &context->chunked_reader);
+    }
+    if (benchmark->options->consumer == CONSUMER_MODE_TABLE) {
+        init_message_dispatch_table(&context->dispatch_table, &on_unknown_message);
+        message_dispatch_table_register(&context->dispatch_table, MSG_TYPE_ID, &on_message);
+    }
+}
+
+static uint32_t consume(const struct benchmark *const benchmark, const struct benchmark_ring *const ring,
+                        struct consumer_context *const context) {
+    const struct benchmark_options *const options = benchmark->options;
+    uint8_t *const buffer = ring->buffer;
+    const struct fixed_size_ring_buffer_header *const fixed_size_header = &ring->fixed_size_header;
+    const uint32_t count = options->consumer == CONSUMER_MODE_SINGLE ? 1 : options->read_batch_size;
+    uint8_t *read_message_address = NULL;
+    switch (options->ring) {
+        case RING_KIND_RING_BUFFER:
+            if (options->consumer == CONSUMER_MODE_NT) {
+                return ring_buffer_nt_batch_read(&ring->header, buffer, &on_message, count, context);
+            }
+            if (options->consumer == CONSUMER_MODE_CHUNKED) {
+                return ring_buffer_chunked_batch_read(&ring->header, buffer, &context->chunked_reader, &on_message,
+                                                      count, context);
+            }
+            if (options->consumer == CONSUMER_MODE_TABLE) {
+                return ring_buffer_dispatch_batch_read(&ring->header, buffer, &context->dispatch_table, count,
+                                                       context);
+            }
+            if (options->consumer == CONSUMER_MODE_SWITCH) {
+                return benchmark_switch_batch_read(&ring->header, buffer, count, context);
+            }
+            if (options->consumer == CONSUMER_MODE_CONTROLLED) {
+                uint32_t msg_read = 0;
+                ring_buffer_controlled_read(&ring->header, buffer, &on_controlled_message, count, context, &msg_read);
+                return msg_read;
+            }
+            if (options->consumer == CONSUMER_MODE_PARKING) {
+                uint64_t parks = 0;
+                return ring_buffer_parking_batch_read(&ring->header, buffer, &on_message, count, context,
+                                                      PARKING_MAX_SPINS, PARKING_TIMEOUT_NANOS, &parks);
+            }
+            return ring_buffer_batch_read(&ring->header, buffer, &on_message, count, context);
+        case RING_KIND_FIXED_SIZE:
+            if (options->consumer == CONSUMER_MODE_SINGLE) {
+                if (!try_fixed_size_ring_buffer_read(buffer, fixed_size_header, &read_message_address)) {
+                    return 0;
+                }
+                on_fixed_size_message(read_message_address, context);
+                fixed_size_ring_buffer_commit_read(buffer, fixed_size_header, read_message_address);
+                return 1;
+            }
+            if (options->consumer == CONSUMER_MODE_STREAM) {
+                return fixed_size_ring_buffer_stream_batch_read(buffer, fixed_size_header, &on_fixed_size_message,
+                                                                count, context);
+            }
+            if (options->consumer == CONSUMER_MODE_SCAN) {
+                return fixed_size_ring_buffer_scan_batch_read(buffer, fixed_size_header, &on_fixed_size_message,
+                                                              count, context);
+            }
+            return fixed_size_ring_buffer_batch_read(buffer, fixed_size_header, &on_fixed_size_message, count,
+                                                     context);
+        case RING_KIND_SPECIALIZED:
+            return specialized_ring_batch_read(buffer, count, context);
+        default:
+            if (options->consumer == CONSUMER_MODE_SINGLE) {
+                if (!try_fixed_size_mpmc_ring_buffer_read(buffer, fixed_size_header, &read_message_address)) {
+                    return 0;
+                }
+                on_fixed_size_message(read_message_address, context);
+                fixed_size_mpmc_ring_buffer_commit_read(fixed_size_header, read_message_address);
+                return 1;
+            }
+            return fixed_size_mpmc_ring_buffer_batch_read(buffer, fixed_size_header, &on_fixed_size_message, count,
+                                                          context);
+    }
+}
+
+static void ring_buffer_batch_produce(struct benchmark *const benchmark, const uint64_t producer_id_bits,
+                                      struct idle_strategy *const idle_strategy) {
+    const struct benchmark_options *const options = benchmark->options;
+    const struct ring_buffer_header *const header = &benchmark->rings[0].header;
+    uint8_t *const buffer = benchmark->rings[0].buffer;
+    const uint64_t messages = options->messages;
+    const index_t msg_size = options->msg_size;
+    index_t claimed_index = 0;
+    struct ring_buffer_batch batch = {0};
+    struct ring_buffer_batch_iterator iterator;
+    const bool multi_producer = options->producers > 1;
+    uint64_t msg_id = 1;
+    while (msg_id <= messages) {
+        const uint64_t remaining = messages - msg_id + 1;
+        const uint32_t batch_size = remaining < options->claim_batch_size ? (uint32_t) remaining :
+                                    options->claim_batch_size;
+        while (!(multi_producer ?
+                 try_ring_buffer_mp_uniform_batch_claim(header, buffer, msg_size, batch_size, &batch) :
+                 try_ring_buffer_sp_uniform_batch_claim(header, buffer, msg_size, batch_size, &batch))) {
+            idle_strategy_idle(idle_strategy);
+        }
+        idle_strategy_reset(idle_strategy);
+        ring_buffer_batch_iterator_init(&batch, &iterator);
+        while (ring_buffer_batch_iterator_next(&iterator, msg_size, &claimed_index)) {
+            write_msg_content(buffer + encoded_msg_offset(claimed_index), producer_id_bits, msg_id);
+            msg_id++;
+        }
+        ring_buffer_uniform_batch_commit(buffer, &batch, MSG_TYPE_ID, msg_size);
+    }
+}
+
+static void fixed_size_batch_produce(struct benchmark *const benchmark, const uint64_t producer_id_bits,
+                                     struct idle_strategy *const idle_strategy) {
+    const struct benchmark_options *const options = benchmark->options;
+    const struct fixed_size_ring_buffer_header *const header = &benchmark->rings[0].fixed_size_header;
+    uint8_t *const buffer = benchmark->rings[0].buffer;
+    const uint64_t messages = options->messages;
+    uint8_t *msg_content = NULL;
+    struct fixed_size_ring_buffer_batch batch = {0};
+    struct fixed_size_ring_buffer_batch_iterator iterator;
+    uint64_t msg_id = 1;
+    while (msg_id <= messages) {
+        const uint64_t remaining = messages - msg_id + 1;
+        const uint32_t batch_size = remaining < options->claim_batch_size ? (uint32_t) remaining :
+                                    options->claim_batch_size;
+        while (!try_fixed_size_ring_buffer_batch_claim(buffer, header, batch_size, &batch)) {
+            idle_strategy_idle(idle_strategy);
+        }
+        idle_strategy_reset(idle_strategy);
+        fixed_size_ring_buffer_batch_iterator_init(buffer, header, &batch, &iterator);
+        while (fixed_size_ring_buffer_batch_iterator_next(&iterator, &msg_content)) {
+            write_msg_content(msg_content, producer_id_bits, msg_id);
+            msg_id++;
+        }
+        fixed_size_ring_buffer_commit_batch_claim(buffer, header, &batch);
+    }
+}
+
+/**
+ * Sends each message on the first ring and, on pingpong, waits its echo from the second one before sending the next.
+ * With a rate each message has a scheduled send time, used as its stamp: a stall of the ring delays the following
+ * sends too and their latency accounts for it, instead of hiding it as a closed loop would (coordinated omission).
+ */
+static void produce(struct benchmark *const benchmark, const uint64_t producer_id_bits,
+                    struct idle_strategy *const idle_strategy, struct latency_histogram *const histogram) {
+    const struct benchmark_options *const options = benchmark->options;
+    const struct tsc_clock *const clock = &benchmark->clock;
+    const uint64_t messages = options->messages;
+    const bool latency_mode = is_latency_mode(options);
+    const bool pingpong = options->mode == BENCHMARK_MODE_PINGPONG;
+    const double interval_ticks = options->rate == 0 ? 0 : tsc_clock_ticks_of(clock, 1e9 / options->rate);
+    struct consumer_context echo_context = {.checksum = 0, .producers = options->producers, .check_order = true,
+            .failed = false, .last_msg_ids = {0}, .clock = clock, .histogram = histogram, .echo_ring = NULL,
+            .benchmark = benchmark, .idle_strategy = idle_strategy};
+    if (pingpong) {
+        init_consumer_context(benchmark, &benchmark->rings[1], &echo_context);
+    }
+    const uint64_t start_ticks = tsc_clock_ticks(clock);
+    for (uint64_t msg_id = 1; msg_id <= messages; msg_id++) {
+        uint64_t stamp = 0;
+        if (latency_mode) {
+            if (interval_ticks == 0) {
+                stamp = tsc_clock_ticks(clock);
+            } else {
+                stamp = start_ticks + (uint64_t) ((msg_id - 1) * interval_ticks);
+                while (tsc_clock_ticks(clock) < stamp) {
+                    idle_strategy_idle(idle_strategy);
+                }
+                idle_strategy_reset(idle_strategy);
+            }
+        }
+        send_message(benchmark, &benchmark->rings[0], producer_id_bits | msg_id, stamp, idle_strategy);
+        if (pingpong) {
+            uint32_t read;
+            while ((read = consume(benchmark, &benchmark->rings[1], &echo_context)) == 0 &&
+                   !atomic_load_explicit(&benchmark->failed, memory_order_relaxed)) {
+                idle_strategy_idle(idle_strategy);
+            }
+            idle_strategy_reset(idle_strategy);
+            if (read == 0 || echo_context.failed) {
+                atomic_store(&benchmark->failed, true);
+                return;
+            }
+        }
+    }
+}
+
+static void *producer(void *arg) {
+    struct benchmark_thread *const thread = (struct benchmark_thread *) arg;
+    struct benchmark *const benchmark = thread->benchmark;
+    pin_current_thread(thread->cpu);
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, benchmark->options->idle_strategy_kind);
+    const uint64_t producer_id_bits = ((uint64_t) thread->id) << PRODUCER_ID_SHIFT;
+    struct perf_counters perf_counters;
+    const bool perf = open_thread_perf_counters(benchmark->options, &perf_counters);
+    pthread_barrier_wait(&benchmark->start_barrier);
+    if (perf) {
+        start_perf_counters(&perf_counters);
+    }
+    if (benchmark->options->ring == RING_KIND_RING_BUFFER && benchmark->options->claim == CLAIM_MODE_BATCH) {
+        ring_buffer_batch_produce(benchmark, producer_id_bits, &idle_strategy);
+    } else if (benchmark->options->claim == CLAIM_MODE_BATCH) {
+        fixed_size_batch_produce(benchmark, producer_id_bits, &idle_strategy);
+    } else {
+        produce(benchmark, producer_id_bits, &idle_strategy, thread->histogram);
+    }
+    if (perf) {
+        close_thread_perf_counters(&perf_counters, &thread->counters);
+    }
+    return NULL;
+}
+
+/**
+ * Times the first lap and the end of the reads on the consumer that moves the messages read by all the consumers
+ * from previous_read to read past them.
+ */
+static void record_laps(struct benchmark *const benchmark, const uint64_t previous_read, const uint64_t read,
+                        const uint64_t total_messages) {
+    if (previous_read < benchmark->lap_messages && read >= benchmark->lap_messages) {
+        clock_gettime(CLOCK_MONOTONIC, &benchmark->first_lap_time);
+    }
+    if (previous_read < total_messages && read >= total_messages) {
+        clock_gettime(CLOCK_MONOTONIC, &benchmark->end_read_time);
+    }
+}
+
+static void *consumer(void *arg) {
+    struct benchmark_thread *const thread = (struct benchmark_thread *) arg;
+    struct benchmark *const benchmark = thread->benchmark;
+    const struct benchmark_options *const options = benchmark->options;
+    pin_current_thread(thread->cpu);
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, options->idle_strategy_kind);
+    //the echoes can't share the idle strategy of the reads
+    struct idle_strategy echo_idle_strategy;
+    init_idle_strategy(&echo_idle_strategy, options->idle_strategy_kind);
+    const uint64_t total_messages = options->producers * options->messages;
+    const bool single_consumer = options->consumers == 1;
+    //the order of each producer can be checked only if all its messages are read by the same consumer
+    struct consumer_context context = {.checksum = 0, .producers = options->producers,
+            .check_order = single_consumer, .failed = false, .last_msg_ids = {0}, .clock = &benchmark->clock,
+            .histogram = thread->histogram,
+            .echo_ring = options->mode == BENCHMARK_MODE_PINGPONG ? &benchmark->rings[1] : NULL,
+            .benchmark = benchmark, .idle_strategy = &echo_idle_strategy};
+    init_consumer_context(benchmark, &benchmark->rings[0], &context);
+    uint64_t read_messages = 0;
+    struct perf_counters perf_counters;
+    const bool perf = open_thread_perf_counters(options, &perf_counters);
+    pthread_barrier_wait(&benchmark->start_barrier);
+    if (perf) {
+        start_perf_counters(&perf_counters);
+    }
+    if (thread->id == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &benchmark->start_time);
+    }
+    //the consumers stop together when all the messages are read by any of them
+    while (!context.failed && !atomic_load_explicit(&benchmark->failed, memory_order_relaxed) &&
+           (single_consumer ? read_messages :
+            atomic_load_explicit(&benchmark->read_messages, memory_order_relaxed)) < total_messages) {
+        const uint32_t read = consume(benchmark, &benchmark->rings[0], &context);
+        if (read != 0) {
+            read_messages += read;
+            const uint64_t all_read_messages = single_consumer ? read_messages :
+                                               atomic_fetch_add_explicit(&benchmark->read_messages, read,
+                                                                         memory_order_relaxed) + read;
+            record_laps(benchmark, all_read_messages - read, all_read_messages, total_messages);
+        }
+        idle_strategy_idle_work(&idle_strategy, read);
+    }
+    if (perf) {
+        close_thread_perf_counters(&perf_counters, &thread->counters);
+    }
+    if (context.failed) {
+        atomic_store(&benchmark->failed, true);
+    }
+    atomic_fetch_add_explicit(&benchmark->checksum, context.checksum, memory_order_relaxed);
+    return NULL;
+}
+
+static bool reset_ring(const struct benchmark *const benchmark, struct benchmark_ring *const ring) {
+    const struct benchmark_options *const options = benchmark->options;
+    //each run starts from an empty ring
+    memset(ring->buffer, 0, benchmark->buffer_length);
+    switch (options->ring) {
+        case RING_KIND_RING_BUFFER:
+            return init_ring_buffer_header(&ring->header, benchmark->buffer_length);
+        case RING_KIND_SPECIALIZED:
+            return init_fixed_size_ring_buffer_header(ring->buffer, &ring->fixed_size_header, options->capacity,
+                                                      options->msg_size);
+        case RING_KIND_FIXED_SIZE:
+            return init_fixed_size_ring_buffer_layout_header(ring->buffer, &ring->fixed_size_header,
+                                                             options->capacity, options->msg_size,
+                                                             options->slot_layout, options->payload_alignment);
+        default:
+            return init_fixed_size_mpmc_ring_buffer_header(ring->buffer, &ring->fixed_size_header,
+                                                           options->capacity, options->msg_size);
+    }
+}
+
+/**
+ * Returns the throughput of a run in ops/sec (round trips/sec on pingpong) or 0 if it has failed.
+ * The latencies and the counters recorded by the run are added to latency and to the counters, if not NULL.
+ */
+static uint64_t run_benchmark(struct benchmark *const benchmark, struct latency_histogram *const latency,
+                              struct perf_counter_values *const producer_counters,
+                              struct perf_counter_values *const consumer_counters) {
+    const struct benchmark_options *const options = benchmark->options;
+    const bool pingpong = options->mode == BENCHMARK_MODE_PINGPONG;
+    if (!reset_ring(benchmark, &benchmark->rings[0]) || (pingpong && !reset_ring(benchmark, &benchmark->rings[1]))) {
+        return 0;
+    }
+    atomic_store(&benchmark->read_messages, 0);
+    atomic_store(&benchmark->checksum, 0);
+    atomic_store(&benchmark->failed, false);
+    const uint32_t threads = options->producers + options->consumers;
+    struct benchmark_thread benchmark_threads[threads];
+    pthread_barrier_init(&benchmark->start_barrier, NULL, threads + 1);
+    //the cpus are assigned to the producers first and then to the consumers
+    for (uint32_t i = 0; i < threads; i++) {
+        struct benchmark_thread *const thread = &benchmark_threads[i];
+        thread->benchmark = benchmark;
+        thread->id = i < options->producers ? i : i - options->producers;
+        thread->cpu = options->cpu_count == 0 ? -1 : options->cpus[i % options->cpu_count];
+        //the round trips are recorded by the producer, the oneway latencies by the consumers
+        const bool records_latency = pingpong ? i < options->producers :
+                                     options->mode == BENCHMARK_MODE_ONEWAY && i >= options->producers;
+        thread->histogram = NULL;
+        reset_perf_counter_values(&thread->counters);
+        if (records_latency) {
+            thread->histogram = (struct latency_histogram *) malloc(sizeof(struct latency_histogram));
+            reset_latency_histogram(thread->histogram);
+        }
+        pthread_create(&thread->thread, NULL, i < options->producers ? producer : consumer, thread);
+    }
+    struct timespec start_time;
+    struct timespec end_time;
+    pthread_barrier_wait(&benchmark->start_barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_join(benchmark_threads[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    for (uint32_t i = 0; i < threads; i++) {
+        struct latency_histogram *const histogram = benchmark_threads[i].histogram;
+        if (histogram != NULL) {
+            if (latency != NULL) {
+                latency_histogram_merge(latency, histogram);
+            }
+            free(histogram);
+        }
+        struct perf_counter_values *const counters = i < options->producers ? producer_counters : consumer_counters;
+        if (counters != NULL) {
+            add_perf_counter_values(counters, &benchmark_threads[i].counters);
+        }
+    }
+    pthread_barrier_destroy(&benchmark->start_barrier);
+    const uint64_t messages = options->messages;
+    const uint64_t expected_checksum = options->producers * ((messages * (messages + 1)) / 2);
+    const uint64_t checksum = atomic_load(&benchmark->checksum);
+    if (atomic_load(&benchmark->failed) || checksum != expected_checksum) {
+        fprintf(stderr, "checksum %ld instead of %ld!\n", checksum, expected_checksum);
+        return 0;
+    }
+    const uint64_t nanos = elapsed_nanos(&start_time, &end_time);
+    return (uint64_t) ((options->producers * messages * 1000000000.0) / (nanos == 0 ? 1 : nanos));
+}
+
+static int compare_uint64(const void *a, const void *b) {
+    const uint64_t first = *(const uint64_t *) a;
+    const uint64_t second = *(const uint64_t *) b;
+    return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+static void compute_statistics(struct benchmark_result *const result) {
+    const uint32_t runs = result->runs;
+    uint64_t sorted[MAX_RUNS];
+    memcpy(sorted, result->ops_per_sec, runs * sizeof(uint64_t));
+    qsort(sorted, runs, sizeof(uint64_t), compare_uint64);
+    result->min_ops_per_sec = sorted[0];
+    result->max_ops_per_sec = sorted[runs - 1];
+    result->median_ops_per_sec = (runs % 2) == 1 ? (double) sorted[runs / 2] :
+                                 (sorted[(runs / 2) - 1] + sorted[runs / 2]) / 2.0;
+    double sum = 0;
+    for (uint32_t i = 0; i < runs; i++) {
+        sum += sorted[i];
+    }
+    const double mean = sum / runs;
+    double squares = 0;
+    for (uint32_t i = 0; i < runs; i++) {
+        squares += (sorted[i] - mean) * (sorted[i] - mean);
+    }
+    result->mean_ops_per_sec = mean;
+    result->stddev_ops_per_sec = runs > 1 ? sqrt(squares / (runs - 1)) : 0;
+}
+
+static void record_first_lap(const struct benchmark *const benchmark, struct benchmark_result *const result) {
+    const uint64_t lap_messages = benchmark->lap_messages;
+    const uint64_t messages = benchmark->options->producers * benchmark->options->messages;
+    if (lap_messages >= messages) {
+        return;
+    }
+    result->first_lap_ps_per_msg = (elapsed_nanos(&benchmark->start_time, &benchmark->first_lap_time) * 1000) /
+                                   lap_messages;
+    result->steady_state_ps_per_msg =
+            (elapsed_nanos(&benchmark->first_lap_time, &benchmark->end_read_time) * 1000) /
+            (messages - lap_messages);
+}
+
+struct latency_percentiles {
+    double p50;
+    double p99;
+    double p999;
+    double p9999;
+    double max;
+    double mean;
+    uint64_t samples;
+};
+
+static void compute_latency_percentiles(const struct tsc_clock *const clock,
+                                        const struct latency_histogram *const latency,
+                                        struct latency_percentiles *const percentiles) {
+    percentiles->p50 = tsc_clock_nanos(clock, latency_histogram_percentile(latency, 50));
+    percentiles->p99 = tsc_clock_nanos(clock, latency_histogram_percentile(latency, 99));
+    percentiles->p999 = tsc_clock_nanos(clock, latency_histogram_percentile(latency, 99.9));
+    percentiles->p9999 = tsc_clock_nanos(clock, latency_histogram_percentile(latency, 99.99));
+    percentiles->max = tsc_clock_nanos(clock, latency->total_count == 0 ? 0 : latency->max);
+    percentiles->mean = tsc_clock_nanos(clock, 1) * latency_histogram_mean(latency);
+    percentiles->samples = latency->total_count;
+}
+
+static const char *const PERF_COUNTER_ROLES[] = {"producer", "consumer"};
+
+static void print_text_counters(const char *const role, const struct perf_counter_values *const counters,
+                                const uint64_t messages) {
+    printf(" %s", role);
+    const bool *const available = counters->available;
+    const uint64_t *const values = counters->values;
+    if (available[PERF_COUNTER_CYCLES] && available[PERF_COUNTER_INSTRUCTIONS] && values[PERF_COUNTER_CYCLES] != 0) {
+        printf(" ipc:%.2f", ((double) values[PERF_COUNTER_INSTRUCTIONS]) / values[PERF_COUNTER_CYCLES]);
+    }
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        if (available[i]) {
+            printf(" %s/msg:%.3f", PERF_COUNTER_NAMES[i], ((double) values[i]) / messages);
+        }
+    }
+}
+
+static void print_json_counters(const char *const role, const struct perf_counter_values *const counters,
+                                const uint32_t runs) {
+    printf(",\"%s_counters\":[", role);
+    for (uint32_t run = 0; run < runs; run++) {
+        printf(run == 0 ? "{" : ",{");
+        for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+            printf(i == 0 ? "\"%s\":" : ",\"%s\":", PERF_COUNTER_NAMES[i]);
+            if (counters[run].available[i]) {
+                printf("%lu", counters[run].values[i]);
+            } else {
+                printf("null");
+            }
+        }
+        printf("}");
+    }
+    printf("]");
+}
+
+/**
+ * The counters per message of all the runs: empty if not available.
+ */
+static void print_csv_counters(const struct perf_counter_values *const counters, const uint32_t runs,
+                               const uint64_t messages) {
+    struct perf_counter_values sum;
+    reset_perf_counter_values(&sum);
+    for (uint32_t run = 0; run < runs; run++) {
+        add_perf_counter_values(&sum, &counters[run]);
+    }
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        if (sum.available[i]) {
+            printf(",%.3f", ((double) sum.values[i]) / (messages * runs));
+        } else {
+            printf(",");
+        }
+    }
+}
+
+static void print_result(const struct benchmark *const benchmark, const struct benchmark_result *const result) {
+    const struct benchmark_options *const options = benchmark->options;
+    const char *const mode = BENCHMARK_MODE_NAMES[options->mode];
+    const char *const ring = RING_KIND_NAMES[options->ring];
+    const char *const claim = options->ring == RING_KIND_MPMC ? "mp" : CLAIM_MODE_NAMES[options->claim];
+    const char *const consumer = CONSUMER_MODE_NAMES[options->consumer];
+    const char *const slot_layout = SLOT_LAYOUT_NAMES[options->slot_layout];
+    const char *const clock = benchmark->clock.tsc ? "tsc" : "monotonic";
+    struct latency_percentiles latency;
+    compute_latency_percentiles(&benchmark->clock, result->latency, &latency);
+    //round trips on pingpong
+    const uint64_t run_messages = options->producers * options->messages;
+    switch (options->format) {
+        case OUTPUT_FORMAT_JSON:
+            printf("{\"mode\":\"%s\",\"ring\":\"%s\",\"claim\":\"%s\",\"consumer\":\"%s\",\"msg_size\":%" PRIdINDEX
+                   ",\"capacity\":%" PRIdINDEX ",\"slot_layout\":\"%s\",\"payload_alignment\":%u"
+                   ",\"claim_batch_size\":%u,\"read_batch_size\":%u,\"producers\":%u"
+                   ",\"consumers\":%u,\"messages\":%lu,\"warmup\":%u,\"rate\":%lu,\"idle\":\"%s\",\"pages\":\"%s\""
+                   ",\"prefault\":%s,\"index_bits\":%zu,\"clock\":\"%s\",\"ops_per_sec\":[",
+                   mode, ring, claim, consumer, options->msg_size, options->capacity, slot_layout,
+                   options->payload_alignment, options->claim_batch_size, options->read_batch_size,
+                   options->producers, options->consumers, options->messages, options->warmup, options->rate,
+                   IDLE_STRATEGY_NAMES[options->idle_strategy_kind], PAGE_KIND_NAMES[options->page_kind],
+                   options->prefault ? "true" : "false", sizeof(index_t) * 8, clock);
+            for (uint32_t i = 0; i < result->runs; i++) {
+                printf(i == 0 ? "%lu" : ",%lu", result->ops_per_sec[i]);
+            }
+            printf("],\"median_ops_per_sec\":%.0f,\"mean_ops_per_sec\":%.0f,\"stddev_ops_per_sec\":%.0f"
+                   ",\"min_ops_per_sec\":%lu,\"max_ops_per_sec\":%lu,\"first_lap_ps_per_msg\":%lu"
+                   ",\"steady_state_ps_per_msg\":%lu",
+                   result->median_ops_per_sec, result->mean_ops_per_sec, result->stddev_ops_per_sec,
+                   result->min_ops_per_sec, result->max_ops_per_sec, result->first_lap_ps_per_msg,
+                   result->steady_state_ps_per_msg);
+            if (is_latency_mode(options)) {
+                printf(",\"latency_ns\":{\"samples\":%lu,\"p50\":%.0f,\"p99\":%.0f,\"p99.9\":%.0f,\"p99.99\":%.0f"
+                       ",\"max\":%.0f,\"mean\":%.0f}",
+                       latency.samples, latency.p50, latency.p99, latency.p999, latency.p9999, latency.max,
+                       latency.mean);
+            }
+            if (options->perf) {
+                print_json_counters(PERF_COUNTER_ROLES[0], result->producer_counters, result->runs);
+                print_json_counters(PERF_COUNTER_ROLES[1], result->consumer_counters, result->runs);
+            }
+            printf("}\n");
+            break;
+        case OUTPUT_FORMAT_CSV:
+            printf("mode,ring,claim,consumer,msg_size,capacity,slot_layout,payload_alignment,claim_batch_size,"
+                   "read_batch_size,producers,consumers,messages,warmup,runs,rate,idle,pages,prefault,index_bits,clock,median_ops_per_sec,"
+                   "mean_ops_per_sec,stddev_ops_per_sec,min_ops_per_sec,max_ops_per_sec,first_lap_ps_per_msg,"
+                   "steady_state_ps_per_msg,latency_samples,p50_ns,p99_ns,p99.9_ns,p99.99_ns,max_ns,mean_ns");
+            for (int role = 0; role < 2; role++) {
+                for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+                    printf(",%s_%s_per_msg", PERF_COUNTER_ROLES[role], PERF_COUNTER_NAMES[i]);
+                }
+            }
+            printf("\n");
+            printf("%s,%s,%s,%s,%" PRIdINDEX ",%" PRIdINDEX ",%s,%u,%u,%u,%u,%u,%lu,%u,%u,%lu,%s,%s,%s,%zu,%s,"
+                   "%.0f,%.0f,%.0f,%lu,%lu,%lu,%lu,%lu,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f",
+                   mode, ring, claim, consumer, options->msg_size, options->capacity, slot_layout,
+                   options->payload_alignment, options->claim_batch_size, options->read_batch_size,
+                   options->producers, options->consumers, options->messages, options->warmup, result->runs,
+                   options->rate, IDLE_STRATEGY_NAMES[options->idle_strategy_kind],
+                   PAGE_KIND_NAMES[options->page_kind], options->prefault ? "true" : "false", sizeof(index_t) * 8,
+                   clock, result->median_ops_per_sec, result->mean_ops_per_sec, result->stddev_ops_per_sec,
+                   result->min_ops_per_sec, result->max_ops_per_sec, result->first_lap_ps_per_msg,
+                   result->steady_state_ps_per_msg, latency.samples, latency.p50, latency.p99, latency.p999,
+                   latency.p9999, latency.max, latency.mean);
+            print_csv_counters(result->producer_counters, result->runs, run_messages);
+            print_csv_counters(result->consumer_counters, result->runs, run_messages);
+            printf("\n");
+            break;
+        default:
+            printf("%s %s claim:%s consumer:%s msg_size:%" PRIdINDEX " capacity:%" PRIdINDEX " %uP x %uC\n",
+                   mode, ring, claim, consumer, options->msg_size, options->capacity, options->producers,
+                   options->consumers);
+            if (options->ring == RING_KIND_FIXED_SIZE) {
+                printf("slot layout:%s payload alignment:%u\n", slot_layout, options->payload_alignment);
+            }
+            for (uint32_t i = 0; i < result->runs; i++) {
+                printf("run %u:\t%luM ops/sec", i, result->ops_per_sec[i] / 1000000);
+                if (options->perf) {
+                    print_text_counters(PERF_COUNTER_ROLES[0], &result->producer_counters[i], run_messages);
+                    print_text_counters(PERF_COUNTER_ROLES[1], &result->consumer_counters[i], run_messages);
+                }
+                printf("\n");
+            }
+            printf("median:\t%.2fM ops/sec stddev:%.2fM min:%.2fM max:%.2fM\n", result->median_ops_per_sec / 1e6,
+                   result->stddev_ops_per_sec / 1e6, result->min_ops_per_sec / 1e6, result->max_ops_per_sec / 1e6);
+            if (result->first_lap_ps_per_msg != 0) {
+                printf("first lap:%lu ps/msg steady state:%lu ps/msg\n", result->first_lap_ps_per_msg,
+                       result->steady_state_ps_per_msg);
+            }
+            if (is_latency_mode(options)) {
+                printf("%s latency (%s clock, %lu samples%s): p50:%.0f ns p99:%.0f ns p99.9:%.0f ns p99.99:%.0f ns"
+                       " max:%.0f ns mean:%.0f ns\n",
+                       options->mode == BENCHMARK_MODE_PINGPONG ? "round trip" : "oneway", clock, latency.samples,
+                       options->rate == 0 ? "" : ", from the scheduled send", latency.p50, latency.p99,
+                       latency.p999, latency.p9999, latency.max, latency.mean);
+            }
+            break;
+    }
+}
+
+static void usage(const char *const program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --mode=throughput|pingpong|oneway   (default throughput; pingpong: 1 producer and 1 consumer)\n"
+            "  --ring=ring_buffer|fixed_size|mpmc|specialized (default ring_buffer; specialized: fixed_size built"
+            " for a msg size of %d bytes and a capacity of %d messages, sp claim and single or batch consumer only)\n"
+            "  --claim=sp|mp|xadd|batch|lookahead  (default sp; xadd: ring_buffer only, batch: not mpmc,"
+            " lookahead: fixed_size only)\n"
+            "  --consumer=single|batch|stream|nt|chunked|scan|table|switch|controlled|parking (default batch; stream"
+            " and scan: fixed_size only, nt, chunked, table, switch, controlled and parking: ring_buffer only;"
+            " parking: sp or mp claim, not pingpong)\n"
+            "  --msg-size=BYTES                    (default 8, at least 8 or 16 on the latency modes)\n"
+            "  --capacity=MESSAGES                 (default 65536)\n"
+            "  --slot-layout=packed|separated|cache_line (fixed_size only, default packed)\n"
+            "  --payload-alignment=4|8|16|32|64    (fixed_size only, default 4)\n"
+            "  --claim-batch=MESSAGES              (default 16, with --claim=batch; ring_buffer: up to capacity/2)\n"
+            "  --read-batch=MESSAGES               (default capacity / 64)\n"
+            "  --zero-chunk=BYTES                  (zeroed at time by the chunked consumer, a power of 2;"
+            " default ring bytes / 16)\n"
+            "  --producers=N --consumers=N         (default 1; more consumers: mpmc only)\n"
+            "  --messages=N                        (per producer and run, default 10000000)\n"
+            "  --warmup=RUNS --runs=RUNS           (default 1 and 5)\n"
+            "  --rate=MSGS_PER_SEC                 (per producer, latency modes only; default as fast as possible)\n"
+            "  --idle=noop|busy|pause|backoff      (default pause)\n"
+            "  --cpus=CPU[,CPU...]                 (pins the producers, then the consumers)\n"
+            "  --pages=default|thp|hugetlb         (default default)\n"
+            "  --no-prefault --numa-node=NODE|any  (default prefaulted on the node of the cpu consuming each ring"
+            " with --cpus, else of the main thread)\n"
+            "  --perf                              (counts cycles, instructions, L1D/LLC misses and HITM per run)\n"
+            "  --perf-hitm-event=RAW               (raw perf config of HITM, in hex; default known on Intel only)\n"
+            "  --format=text|json|csv              (default text)\n",
+            program, FRANZ_FLOW_SPECIALIZED_MSG_SIZE, FRANZ_FLOW_SPECIALIZED_CAPACITY);
+}
+
+static bool parse_name(const char *const value, const char *const *const names, int *const result) {
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strcmp(value, names[i]) == 0) {
+            *result = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_uint64(const char *const value, const uint64_t min, const uint64_t max, uint64_t *const result) {
+    char *end = NULL;
+    const unsigned long long parsed = strtoull(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < min || parsed > max) {
+        return false;
+    }
+    *result = parsed;
+    return true;
+}
+
+static bool parse_cpus(const char *const value, struct benchmark_options *const options) {
+    char cpus[256];
+    if (strlen(value) >= sizeof(cpus)) {
+        return false;
+    }
+    strcpy(cpus, value);
+    options->cpu_count = 0;
+    char *save = NULL;
+    for (char *token = strtok_r(cpus, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+        uint64_t cpu;
+        if (options->cpu_count == MAX_CPUS || !parse_uint64(token, 0, CPU_SETSIZE - 1, &cpu)) {
+            return false;
+        }
+        options->cpus[options->cpu_count++] = (int) cpu;
+    }
+    return options->cpu_count > 0;
+}
+
+static bool validate_options(struct benchmark_options *const options) {
+    const enum ring_kind ring = options->ring;
+    const enum claim_mode claim = options->claim;
+    if (options->msg_size < (index_t) sizeof(uint64_t) || options->producers == 0 || options->consumers == 0 ||
+        options->messages == 0 || options->runs == 0 || options->warmup + options->runs > MAX_RUNS) {
+        return false;
+    }
+    if ((options->slot_layout != FIXED_SIZE_SLOT_LAYOUT_PACKED || options->payload_alignment != 4) &&
+        ring != RING_KIND_FIXED_SIZE) {
+        fprintf(stderr, "slot layout and payload alignment are supported by fixed_size only\n");
+        return false;
+    }
+    if (ring == RING_KIND_SPECIALIZED) {
+        if (options->msg_size != FRANZ_FLOW_SPECIALIZED_MSG_SIZE ||
+            options->capacity != FRANZ_FLOW_SPECIALIZED_CAPACITY) {
+            fprintf(stderr, "specialized is built for a msg size of %d and a capacity of %d: rebuild with"
+                            " -DFRANZ_FLOW_SPECIALIZED_MSG_SIZE=%" PRIdINDEX " -DFRANZ_FLOW_SPECIALIZED_CAPACITY=%"
+                            PRIdINDEX "\n", FRANZ_FLOW_SPECIALIZED_MSG_SIZE, FRANZ_FLOW_SPECIALIZED_CAPACITY,
+                    options->msg_size, options->capacity);
+            return false;
+        }
+        if (claim != CLAIM_MODE_SP ||
+            (options->consumer != CONSUMER_MODE_SINGLE && options->consumer != CONSUMER_MODE_BATCH)) {
+            fprintf(stderr, "specialized supports the sp claim and the single and batch consumers only\n");
+            return false;
+        }
+    }
+    if (ring != RING_KIND_MPMC && options->consumers > 1) {
+        fprintf(stderr, "only mpmc supports more consumers\n");
+        return false;
+    }
+    if (claim == CLAIM_MODE_XADD && ring != RING_KIND_RING_BUFFER) {
+        fprintf(stderr, "xadd claim is supported by ring_buffer only\n");
+        return false;
+    }
+    if (claim == CLAIM_MODE_BATCH && ring == RING_KIND_MPMC) {
+        fprintf(stderr, "batch claim is supported by ring_buffer and fixed_size only\n");
+        return false;
+    }
+    if (claim == CLAIM_MODE_LOOKAHEAD && ring != RING_KIND_FIXED_SIZE) {
+        fprintf(stderr, "lookahead claim is supported by fixed_size only\n");
+        return false;
+    }
+    if ((claim == CLAIM_MODE_SP || claim == CLAIM_MODE_LOOKAHEAD ||
+         (claim == CLAIM_MODE_BATCH && ring == RING_KIND_FIXED_SIZE)) && ring != RING_KIND_MPMC &&
+        options->producers > 1) {
+        fprintf(stderr, "%s claim supports a single producer only\n", CLAIM_MODE_NAMES[claim]);
+        return false;
+    }
+    if (claim == CLAIM_MODE_BATCH && options->claim_batch_size > (uint32_t) options->capacity) {
+        fprintf(stderr, "a batch can't be bigger than the ring\n");
+        return false;
+    }
+    //see max_batch_capacity
+    if (claim == CLAIM_MODE_BATCH && ring == RING_KIND_RING_BUFFER &&
+        options->claim_batch_size > (uint32_t) options->capacity / 2) {
+        fprintf(stderr, "a ring_buffer batch can't be bigger than half the ring\n");
+        return false;
+    }
+    if ((options->consumer == CONSUMER_MODE_STREAM || options->consumer == CONSUMER_MODE_SCAN) &&
+        ring != RING_KIND_FIXED_SIZE) {
+        fprintf(stderr, "%s consumer is supported by fixed_size only\n", CONSUMER_MODE_NAMES[options->consumer]);
+        return false;
+    }
+    if ((options->consumer == CONSUMER_MODE_NT || options->consumer == CONSUMER_MODE_CHUNKED ||
+         options->consumer == CONSUMER_MODE_TABLE || options->consumer == CONSUMER_MODE_SWITCH ||
+         options->consumer == CONSUMER_MODE_CONTROLLED || options->consumer == CONSUMER_MODE_PARKING) &&
+        ring != RING_KIND_RING_BUFFER) {
+        fprintf(stderr, "%s consumer is supported by ring_buffer only\n", CONSUMER_MODE_NAMES[options->consumer]);
+        return false;
+    }
+    if (options->consumer == CONSUMER_MODE_PARKING) {
+        if (claim != CLAIM_MODE_SP && claim != CLAIM_MODE_MP) {
+            fprintf(stderr, "parking consumer supports the sp and mp claims only\n");
+            return false;
+        }
+        //a parked read can't see a failed run: the producer of pingpong would wait forever for its echo
+        if (options->mode == BENCHMARK_MODE_PINGPONG) {
+            fprintf(stderr, "parking consumer isn't supported by pingpong\n");
+            return false;
+        }
+    }
+    if (options->zero_chunk != 0 && options->consumer != CONSUMER_MODE_CHUNKED) {
+        fprintf(stderr, "zero chunk is supported by the chunked consumer only\n");
+        return false;
+    }
+    if (is_latency_mode(options)) {
+        if (options->msg_size < (index_t) (2 * sizeof(uint64_t))) {
+            fprintf(stderr, "the latency modes need a msg size of at least 16 bytes\n");
+            return false;
+        }
+        if (claim == CLAIM_MODE_BATCH) {
+            fprintf(stderr, "batch claim is supported by the throughput mode only\n");
+            return false;
+        }
+    } else if (options->rate != 0) {
+        fprintf(stderr, "rate is supported by the latency modes only\n");
+        return false;
+    }
+    if (options->mode == BENCHMARK_MODE_PINGPONG && (options->producers > 1 || options->consumers > 1)) {
+        fprintf(stderr, "pingpong supports a single producer and a single consumer only\n");
+        return false;
+    }
+    if (options->read_batch_size == 0) {
+        options->read_batch_size = options->capacity / 64 == 0 ? 1 : options->capacity / 64;
+    }
+    return true;
+}
+
+static bool parse_options(const int argc, char *argv[], struct benchmark_options *const options) {
+    static const struct option long_options[] = {
+            {"mode",        required_argument, NULL, 'M'},
+            {"ring",        required_argument, NULL, 'r'},
+            {"claim",       required_argument, NULL, 'c'},
+            {"consumer",    required_argument, NULL, 'C'},
+            {"msg-size",    required_argument, NULL, 's'},
+            {"capacity",    required_argument, NULL, 'k'},
+            {"slot-layout", required_argument, NULL, 'L'},
+            {"payload-alignment", required_argument, NULL, 'A'},
+            {"claim-batch", required_argument, NULL, 'b'},
+            {"read-batch",  required_argument, NULL, 'B'},
+            {"zero-chunk",  required_argument, NULL, 'z'},
+            {"producers",   required_argument, NULL, 'p'},
+            {"consumers",   required_argument, NULL, 'q'},
+            {"messages",    required_argument, NULL, 'm'},
+            {"warmup",      required_argument, NULL, 'w'},
+            {"runs",        required_argument, NULL, 'n'},
+            {"rate",        required_argument, NULL, 'R'},
+            {"idle",        required_argument, NULL, 'i'},
+            {"cpus",        required_argument, NULL, 'a'},
+            {"pages",       required_argument, NULL, 'P'},
+            {"no-prefault", no_argument,       NULL, 'F'},
+            {"numa-node",   required_argument, NULL, 'N'},
+            {"format",      required_argument, NULL, 'f'},
+            {"perf",        no_argument,       NULL, 'e'},
+            {"perf-hitm-event", required_argument, NULL, 'H'},
+            {"help",        no_argument,       NULL, 'h'},
+            {NULL, 0,                          NULL, 0}
+    };
+    options->mode = BENCHMARK_MODE_THROUGHPUT;
+    options->ring = RING_KIND_RING_BUFFER;
+    options->claim = CLAIM_MODE_SP;
+    options->consumer = CONSUMER_MODE_BATCH;
+    options->msg_size = 8;
+    options->capacity = 64 * 1024;
+    options->slot_layout = FIXED_SIZE_SLOT_LAYOUT_PACKED;
+    options->payload_alignment = 4;
+    options->claim_batch_size = 16;
+    options->read_batch_size = 0;
+    options->zero_chunk = 0;
+    options->producers = 1;
+    options->consumers = 1;
+    options->messages = 10000000;
+    options->warmup = 1;
+    options->runs = 5;
+    options->rate = 0;
+    options->idle_strategy_kind = IDLE_STRATEGY_PAUSE_SPIN;
+    options->cpu_count = 0;
+    options->page_kind = RING_PAGES_DEFAULT;
+    options->prefault = true;
+    options->numa_node = RING_NUMA_NODE_CURRENT;
+    options->format = OUTPUT_FORMAT_TEXT;
+    options->perf = false;
+    options->hitm_raw_config = default_hitm_raw_config();
+    int option;
+    int option_index = 0;
+    while ((option = getopt_long(argc, argv, "h", long_options, &option_index)) != -1) {
+        int name = 0;
+        uint64_t value = 0;
+        bool valid = true;
+        switch (option) {
+            case 'M':
+                valid = parse_name(optarg, BENCHMARK_MODE_NAMES, &name);
+                options->mode = (enum benchmark_mode) name;
+                break;
+            case 'r':
+                valid = parse_name(optarg, RING_KIND_NAMES, &name);
+                options->ring = (enum ring_kind) name;
+                break;
+            case 'c':
+                valid = parse_name(optarg, CLAIM_MODE_NAMES, &name);
+                options->claim = (enum claim_mode) name;
+                break;
+            case 'C':
+                valid = parse_name(optarg, CONSUMER_MODE_NAMES, &name);
+                options->consumer = (enum consumer_mode) name;
+                break;
+            case 's':
+                valid = parse_uint64(optarg, 1, INT32_MAX, &value);
+                options->msg_size = (index_t) value;
+                break;
+            case 'k':
+                valid = parse_uint64(optarg, 1, INT32_MAX, &value);
+                options->capacity = (index_t) value;
+                break;
+            case 'L':
+                valid = parse_name(optarg, SLOT_LAYOUT_NAMES, &name);
+                options->slot_layout = (enum fixed_size_slot_layout) name;
+                break;
+            case 'A':
+                valid = parse_uint64(optarg, 4, CACHE_LINE_LENGTH, &value) && is_pow_2((index_t) value);
+                options->payload_alignment = (uint32_t) value;
+                break;
+            case 'b':
+                valid = parse_uint64(optarg, 1, UINT32_MAX, &value);
+                options->claim_batch_size = (uint32_t) value;
+                break;
+            case 'B':
+                valid = parse_uint64(optarg, 1, UINT32_MAX, &value);
+                options->read_batch_size = (uint32_t) value;
+                break;
+            case 'z':
+                valid = parse_uint64(optarg, 1, INT32_MAX, &value);
+                options->zero_chunk = (index_t) value;
+                break;
+            case 'p':
+                valid = parse_uint64(optarg, 1, MAX_PRODUCERS, &value);
+                options->producers = (uint32_t) value;
+                break;
+            case 'q':
+                valid = parse_uint64(optarg, 1, MAX_CONSUMERS, &value);
+                options->consumers = (uint32_t) value;
+                break;
+            case 'm':
+                valid = parse_uint64(optarg, 1, (1UL << PRODUCER_ID_SHIFT) - 1, &value);
+                options->messages = value;
+                break;
+            case 'w':
+                valid = parse_uint64(optarg, 0, MAX_RUNS, &value);
+                options->warmup = (uint32_t) value;
+                break;
+            case 'n':
+                valid = parse_uint64(optarg, 1, MAX_RUNS, &value);
+                options->runs = (uint32_t) value;
+                break;
+            case 'R':
+                valid = parse_uint64(optarg, 1, 1000000000, &value);
+                options->rate = value;
+                break;
+            case 'i':
+                valid = parse_name(optarg, IDLE_STRATEGY_NAMES, &name);
+                options->idle_strategy_kind = (enum idle_strategy_kind) name;
+                break;
+            case 'a':
+                valid = parse_cpus(optarg, options);
+                break;
+            case 'P':
+                valid = parse_name(optarg, PAGE_KIND_NAMES, &name);
+                options->page_kind = (enum ring_page_kind) name;
+                break;
+            case 'F':
+                options->prefault = false;
+                break;
+            case 'N':
+                if (strcmp(optarg, "any") == 0) {
+                    options->numa_node = RING_NUMA_NODE_ANY;
+                } else {
+                    valid = parse_uint64(optarg, 0, 63, &value);
+                    options->numa_node = (int) value;
+                }
+                break;
+            case 'f':
+                valid = parse_name(optarg, OUTPUT_FORMAT_NAMES, &name);
+                options->format = (enum output_format) name;
+                break;
+            case 'e':
+                options->perf = true;
+                break;
+            case 'H': {
+                char *end = NULL;
+                options->hitm_raw_config = strtoull(optarg, &end, 16);
+                valid = end != optarg && *end == '\0';
+                break;
+            }
+            default:
+                return false;
+        }
+        if (!valid) {
+            fprintf(stderr, "invalid --%s value: %s\n", long_options[option_index].name, optarg);
+            return false;
+        }
+    }
+    return optind == argc && validate_options(options);
+}
+
+/**
+ * The default node is resolved from the cpu pinning the consumer of the ring, that is the one reading it, instead of
+ * from the unpinned main thread allocating it: the echo ring of pingpong is consumed by the first producer.
+ */
+static int ring_numa_node(const struct benchmark_options *const options, const uint32_t ring) {
+    if (options->numa_node != RING_NUMA_NODE_CURRENT || options->cpu_count == 0) {
+        return options->numa_node;
+    }
+    //the cpus are assigned to the producers first and then to the consumers, as in run_benchmark
+    const uint32_t consumer_thread = ring == 0 ? options->producers : 0;
+    const int numa_node = cpu_numa_node(options->cpus[consumer_thread % options->cpu_count]);
+    return numa_node == RING_NUMA_NODE_ANY ? RING_NUMA_NODE_CURRENT : numa_node;
+}
+
+int main(int argc, char *argv[]) {
+    struct benchmark_options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    struct benchmark benchmark;
+    benchmark.options = &options;
+    init_tsc_clock(&benchmark.clock, TSC_CLOCK_DEFAULT_CALIBRATION_NANOS);
+    if (options.perf) {
+        struct perf_counters perf_counters;
+        if (!open_perf_counters(&perf_counters, options.hitm_raw_config)) {
+            perror("perf counters unavailable");
+            options.perf = false;
+        } else {
+            close_perf_counters(&perf_counters);
+        }
+    }
+    const index_t buffer_length = options.ring == RING_KIND_RING_BUFFER ?
+                                  ring_buffer_capacity(options.capacity * required_record_capacity(options.msg_size)) :
+                                  options.ring == RING_KIND_FIXED_SIZE ?
+                                  fixed_size_ring_buffer_layout_capacity(options.capacity, options.msg_size,
+                                                                         options.slot_layout,
+                                                                         options.payload_alignment) :
+                                  fixed_size_ring_buffer_capacity(options.capacity, options.msg_size);
+    if (buffer_length == 0) {
+        fprintf(stderr, "the ring can't fit an index_t\n");
+        return 2;
+    }
+    if (options.consumer == CONSUMER_MODE_CHUNKED) {
+        const index_t capacity = buffer_length - RING_BUFFER_TRAILER_LENGTH;
+        const index_t chunk_length = zero_chunk_length(&options, capacity);
+        if (!is_pow_2(chunk_length) || chunk_length < RECORD_ALIGNMENT || chunk_length > capacity) {
+            fprintf(stderr, "the zero chunk must be a power of 2 between %" PRIdINDEX " and %" PRIdINDEX " bytes\n",
+                    RECORD_ALIGNMENT, capacity);
+            return 2;
+        }
+    }
+    struct ring_allocation_options allocation_options;
+    init_ring_allocation_options(&allocation_options);
+    allocation_options.page_kind = options.page_kind;
+    allocation_options.prefault = options.prefault;
+    const uint32_t ring_count = options.mode == BENCHMARK_MODE_PINGPONG ? 2 : 1;
+    struct ring_allocation allocations[2];
+    for (uint32_t i = 0; i < ring_count; i++) {
+        allocation_options.numa_node = ring_numa_node(&options, i);
+        if (!allocate_ring(buffer_length, &allocation_options, &allocations[i])) {
+            fprintf(stderr, "can't allocate %" PRIdINDEX " bytes\n", buffer_length);
+            for (uint32_t j = 0; j < i; j++) {
+                free_ring(&allocations[j]);
+            }
+            return 1;
+        }
+        benchmark.rings[i].buffer = allocations[i].buffer;
+    }
+    benchmark.buffer_length = buffer_length;
+    benchmark.lap_messages = options.ring == RING_KIND_RING_BUFFER ?
+                             (uint64_t) (buffer_length - RING_BUFFER_TRAILER_LENGTH) /
+                             required_record_capacity(options.msg_size) : (uint64_t) next_pow_2(options.capacity);
+    struct benchmark_result result;
+    memset(&result, 0, sizeof(result));
+    result.runs = options.runs;
+    result.latency = (struct latency_histogram *) malloc(sizeof(struct latency_histogram));
+    reset_latency_histogram(result.latency);
+    bool failed = false;
+    for (uint32_t i = 0; i < options.warmup + options.runs && !failed; i++) {
+        const bool measured = i >= options.warmup;
+        const uint64_t ops_per_sec = run_benchmark(&benchmark, measured ? result.latency : NULL,
+                                                   measured ? &result.producer_counters[i - options.warmup] : NULL,
+                                                   measured ? &result.consumer_counters[i - options.warmup] : NULL);
+        if (ops_per_sec == 0) {
+            failed = true;
+        } else {
+            if (i == 0) {
+                record_first_lap(&benchmark, &result);
+            }
+            if (i >= options.warmup) {
+                result.ops_per_sec[i - options.warmup] = ops_per_sec;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < ring_count; i++) {
+        free_ring(&allocations[i]);
+    }
+    if (!failed) {
+        compute_statistics(&result);
+        print_result(&benchmark, &result);
+    }
+    free(result.latency);
+    return failed ? 1 : 0;
+}
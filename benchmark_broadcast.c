@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include "ring_buffer.h"
+#include "broadcast_buffer.h"
+
+/**
+ * Fan-out of a single producer to N receivers, each receiving all the 1..messages sequence and checking its checksum:
+ * - broadcast: one transmitter on a broadcast_buffer, read in place by all the receivers
+ * - copies: the producer writes each message on N ring_buffers, one per receiver
+ * The broadcast transmitter never blocks on its own: here it is paced by the slowest receiver, never more than half
+ * a buffer behind, hence both deliver every message to every receiver and the throughputs can be compared.
+ */
+
+#define MSG_TYPE_ID 1
+#define MAX_RECEIVERS 16
+
+struct fan_out_options {
+    uint64_t messages;
+    uint32_t receivers;
+    uint32_t runs;
+    //in messages
+    index_t capacity;
+    index_t msg_size;
+    uint32_t read_batch_size;
+    enum idle_strategy_kind idle_strategy_kind;
+};
+
+//the position of a receiver, published to the pacing transmitter on its own cache line
+struct receiver_position {
+    _Atomic uint64_t position;
+    uint8_t padding[CACHE_LINE_LENGTH - sizeof(uint64_t)];
+};
+
+struct fan_out {
+    const struct fan_out_options *options;
+    struct broadcast_buffer_header broadcast_header;
+    uint8_t *broadcast_buffer;
+    struct ring_buffer_header ring_headers[MAX_RECEIVERS];
+    uint8_t *ring_buffers[MAX_RECEIVERS];
+    struct receiver_position receiver_positions[MAX_RECEIVERS];
+    uint64_t checksums[MAX_RECEIVERS];
+    uint64_t lapped_counts[MAX_RECEIVERS];
+    pthread_barrier_t start_barrier;
+};
+
+struct fan_out_thread {
+    struct fan_out *fan_out;
+    pthread_t thread;
+    uint32_t id;
+};
+
+struct receiver_context {
+    uint64_t checksum;
+    uint64_t last_value;
+};
+
+static bool on_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                       const index_t msg_content_length, void *context) {
+    struct receiver_context *const receiver_context = (struct receiver_context *) context;
+    uint64_t value;
+    memcpy(&value, buffer + msg_content_index, sizeof(value));
+    receiver_context->checksum += value;
+    receiver_context->last_value = value;
+    return true;
+}
+
+static uint64_t min_receiver_position(const struct fan_out *const fan_out) {
+    uint64_t min_position = UINT64_MAX;
+    for (uint32_t i = 0; i < fan_out->options->receivers; i++) {
+        const uint64_t position = atomic_load_explicit(&fan_out->receiver_positions[i].position,
+                                                       memory_order_acquire);
+        min_position = position < min_position ? position : min_position;
+    }
+    return min_position;
+}
+
+static void *broadcast_producer(void *arg) {
+    struct fan_out *const fan_out = ((struct fan_out_thread *) arg)->fan_out;
+    const struct fan_out_options *const options = fan_out->options;
+    const struct broadcast_buffer_header *const header = &fan_out->broadcast_header;
+    uint8_t *const buffer = fan_out->broadcast_buffer;
+    const index_t msg_size = options->msg_size;
+    uint8_t msg[msg_size];
+    memset(msg, 0, msg_size);
+    //a record could need a padding record before it too
+    const uint64_t max_ahead = (header->capacity / 2) - (2 * required_record_capacity(msg_size));
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, options->idle_strategy_kind);
+    uint64_t min_position = 0;
+    pthread_barrier_wait(&fan_out->start_barrier);
+    for (uint64_t value = 1; value <= options->messages; value++) {
+        //the slowest receiver is checked only when the cached one is too far behind
+        while (load_tail(header, buffer) - min_position > max_ahead) {
+            min_position = min_receiver_position(fan_out);
+            if (load_tail(header, buffer) - min_position > max_ahead) {
+                idle_strategy_idle(&idle_strategy);
+            }
+        }
+        idle_strategy_reset(&idle_strategy);
+        memcpy(msg, &value, sizeof(value));
+        broadcast_transmit(header, buffer, MSG_TYPE_ID, msg, msg_size);
+    }
+    return NULL;
+}
+
+static void *broadcast_consumer(void *arg) {
+    const struct fan_out_thread *const thread = (struct fan_out_thread *) arg;
+    struct fan_out *const fan_out = thread->fan_out;
+    const struct broadcast_buffer_header *const header = &fan_out->broadcast_header;
+    const uint8_t *const buffer = fan_out->broadcast_buffer;
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, fan_out->options->idle_strategy_kind);
+    struct broadcast_receiver receiver;
+    init_broadcast_receiver(header, buffer, &receiver);
+    struct receiver_context context = {0, 0};
+    uint64_t lapped_count = 0;
+    pthread_barrier_wait(&fan_out->start_barrier);
+    while (context.last_value != fan_out->options->messages) {
+        const enum broadcast_receive_status status = broadcast_receive(header, buffer, &receiver, &on_message,
+                                                                       &context);
+        if (status == BROADCAST_RECEIVE_LAPPED) {
+            lapped_count++;
+        }
+        if (status != BROADCAST_RECEIVE_EMPTY) {
+            atomic_store_explicit(&fan_out->receiver_positions[thread->id].position, receiver.next_record,
+                                  memory_order_release);
+        }
+        idle_strategy_idle_work(&idle_strategy, status != BROADCAST_RECEIVE_EMPTY);
+    }
+    fan_out->checksums[thread->id] = context.checksum;
+    fan_out->lapped_counts[thread->id] = lapped_count + receiver.lapped_count;
+    return NULL;
+}
+
+static void *copies_producer(void *arg) {
+    struct fan_out *const fan_out = ((struct fan_out_thread *) arg)->fan_out;
+    const struct fan_out_options *const options = fan_out->options;
+    const index_t msg_size = options->msg_size;
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, options->idle_strategy_kind);
+    pthread_barrier_wait(&fan_out->start_barrier);
+    for (uint64_t value = 1; value <= options->messages; value++) {
+        for (uint32_t i = 0; i < options->receivers; i++) {
+            uint8_t *const buffer = fan_out->ring_buffers[i];
+            uint64_t claimed_position = 0;
+            index_t claimed_index = 0;
+            uint64_t idles = 0;
+            ring_buffer_sp_claim(&fan_out->ring_headers[i], buffer, msg_size, &idle_strategy, &claimed_position,
+                                 &claimed_index, &idles);
+            uint8_t *const msg_content = buffer + encoded_msg_offset(claimed_index);
+            memset(msg_content, 0, msg_size);
+            memcpy(msg_content, &value, sizeof(value));
+            ring_buffer_commit(buffer, claimed_index, MSG_TYPE_ID, msg_size);
+        }
+    }
+    return NULL;
+}
+
+static void *copies_consumer(void *arg) {
+    const struct fan_out_thread *const thread = (struct fan_out_thread *) arg;
+    struct fan_out *const fan_out = thread->fan_out;
+    const struct ring_buffer_header *const header = &fan_out->ring_headers[thread->id];
+    uint8_t *const buffer = fan_out->ring_buffers[thread->id];
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, fan_out->options->idle_strategy_kind);
+    struct receiver_context context = {0, 0};
+    pthread_barrier_wait(&fan_out->start_barrier);
+    while (context.last_value != fan_out->options->messages) {
+        const uint32_t read = ring_buffer_batch_read(header, buffer, &on_message, fan_out->options->read_batch_size,
+                                                     &context);
+        idle_strategy_idle_work(&idle_strategy, read);
+    }
+    fan_out->checksums[thread->id] = context.checksum;
+    fan_out->lapped_counts[thread->id] = 0;
+    return NULL;
+}
+
+static uint8_t *allocate_zeroed(const index_t length) {
+    uint8_t *const buffer = (uint8_t *) aligned_alloc(CACHE_LINE_LENGTH, align(length, CACHE_LINE_LENGTH));
+    if (buffer != NULL) {
+        memset(buffer, 0, length);
+    }
+    return buffer;
+}
+
+/**
+ * Returns the messages/sec delivered to all the receivers, or 0 if any of them has a wrong checksum.
+ */
+static uint64_t run_fan_out(struct fan_out *const fan_out, void *(*producer)(void *), void *(*receiver)(void *)) {
+    const struct fan_out_options *const options = fan_out->options;
+    const uint32_t receivers = options->receivers;
+    for (uint32_t i = 0; i < receivers; i++) {
+        atomic_store(&fan_out->receiver_positions[i].position, 0);
+    }
+    struct fan_out_thread threads[MAX_RECEIVERS + 1];
+    pthread_barrier_init(&fan_out->start_barrier, NULL, receivers + 2);
+    for (uint32_t i = 0; i <= receivers; i++) {
+        threads[i].fan_out = fan_out;
+        threads[i].id = i;
+        pthread_create(&threads[i].thread, NULL, i == receivers ? producer : receiver, &threads[i]);
+    }
+    struct timespec start_time;
+    struct timespec end_time;
+    pthread_barrier_wait(&fan_out->start_barrier);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    for (uint32_t i = 0; i <= receivers; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    pthread_barrier_destroy(&fan_out->start_barrier);
+    const uint64_t expected_checksum = options->messages * (options->messages + 1) / 2;
+    for (uint32_t i = 0; i < receivers; i++) {
+        if (fan_out->checksums[i] != expected_checksum || fan_out->lapped_counts[i] != 0) {
+            return 0;
+        }
+    }
+    const double seconds = (end_time.tv_sec - start_time.tv_sec) + ((end_time.tv_nsec - start_time.tv_nsec) / 1e9);
+    return (uint64_t) (options->messages / seconds);
+}
+
+static uint64_t broadcast_run(struct fan_out *const fan_out) {
+    const struct fan_out_options *const options = fan_out->options;
+    const index_t length = broadcast_buffer_capacity(options->capacity * required_record_capacity(options->msg_size));
+    fan_out->broadcast_buffer = allocate_zeroed(length);
+    if (fan_out->broadcast_buffer == NULL || !init_broadcast_buffer_header(&fan_out->broadcast_header, length)) {
+        free(fan_out->broadcast_buffer);
+        return 0;
+    }
+    const uint64_t ops = run_fan_out(fan_out, &broadcast_producer, &broadcast_consumer);
+    free(fan_out->broadcast_buffer);
+    return ops;
+}
+
+static uint64_t copies_run(struct fan_out *const fan_out) {
+    const struct fan_out_options *const options = fan_out->options;
+    const index_t length = ring_buffer_capacity(options->capacity * required_record_capacity(options->msg_size));
+    bool allocated = true;
+    for (uint32_t i = 0; i < options->receivers; i++) {
+        fan_out->ring_buffers[i] = allocate_zeroed(length);
+        allocated &= fan_out->ring_buffers[i] != NULL && init_ring_buffer_header(&fan_out->ring_headers[i], length);
+    }
+    const uint64_t ops = allocated ? run_fan_out(fan_out, &copies_producer, &copies_consumer) : 0;
+    for (uint32_t i = 0; i < options->receivers; i++) {
+        free(fan_out->ring_buffers[i]);
+    }
+    return ops;
+}
+
+static int compare_uint64(const void *a, const void *b) {
+    const uint64_t first = *(const uint64_t *) a;
+    const uint64_t second = *(const uint64_t *) b;
+    return (first > second) - (first < second);
+}
+
+static void usage(const char *const program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --messages=N                        (per run, default 1000000)\n"
+            "  --receivers=N                       (default 4, at most %d)\n"
+            "  --runs=RUNS                         (default 5, after 1 warmup)\n"
+            "  --capacity=MESSAGES                 (of the broadcast buffer and of each ring copy, default 65536)\n"
+            "  --msg-size=BYTES                    (default 8, at least 8)\n"
+            "  --read-batch=MESSAGES               (of the ring copies, default capacity / 64)\n"
+            "  --idle=noop|busy|pause|backoff      (default pause)\n",
+            program, MAX_RECEIVERS);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+            {"messages",   required_argument, NULL, 'm'},
+            {"receivers",  required_argument, NULL, 'n'},
+            {"runs",       required_argument, NULL, 'r'},
+            {"capacity",   required_argument, NULL, 'c'},
+            {"msg-size",   required_argument, NULL, 's'},
+            {"read-batch", required_argument, NULL, 'b'},
+            {"idle",       required_argument, NULL, 'i'},
+            {"help",       no_argument,       NULL, 'h'},
+            {NULL, 0,                         NULL, 0}
+    };
+    static const char *const idle_names[] = {"noop", "busy", "pause", "backoff"};
+    struct fan_out_options options = {1000000, 4, 5, 64 * 1024, sizeof(uint64_t), 0, IDLE_STRATEGY_PAUSE_SPIN};
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        char *end = NULL;
+        bool valid = true;
+        switch (option) {
+            case 'm':
+                options.messages = strtoull(optarg, &end, 10);
+                valid = end != optarg && *end == '\0' && options.messages != 0;
+                break;
+            case 'n':
+                options.receivers = (uint32_t) strtoul(optarg, &end, 10);
+                valid = end != optarg && *end == '\0' && options.receivers != 0 && options.receivers <= MAX_RECEIVERS;
+                break;
+            case 'r':
+                options.runs = (uint32_t) strtoul(optarg, &end, 10);
+                valid = end != optarg && *end == '\0' && options.runs != 0;
+                break;
+            case 'c':
+                options.capacity = (index_t) strtol(optarg, &end, 10);
+                valid = end != optarg && *end == '\0' && options.capacity > 0 && is_pow_2(options.capacity);
+                break;
+            case 's':
+                options.msg_size = (index_t) strtol(optarg, &end, 10);
+                valid = end != optarg && *end == '\0' && options.msg_size >= (index_t) sizeof(uint64_t);
+                break;
+            case 'b':
+                options.read_batch_size = (uint32_t) strtoul(optarg, &end, 10);
+                valid = end != optarg && *end == '\0' && options.read_batch_size != 0;
+                break;
+            case 'i':
+                valid = false;
+                for (int kind = 0; kind < 4; kind++) {
+                    if (strcmp(optarg, idle_names[kind]) == 0) {
+                        options.idle_strategy_kind = (enum idle_strategy_kind) kind;
+                        valid = true;
+                    }
+                }
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    //a broadcast record can't be bigger than 1/8 of the buffer
+    if (options.capacity < 16) {
+        fprintf(stderr, "the capacity must be at least 16 messages\n");
+        return 2;
+    }
+    if (options.read_batch_size == 0) {
+        options.read_batch_size = options.capacity / 64 < 1 ? 1 : (uint32_t) (options.capacity / 64);
+    }
+    static struct fan_out fan_out;
+    fan_out.options = &options;
+    const struct {
+        const char *name;
+        uint64_t (*run)(struct fan_out *);
+    } benchmarks[] = {
+            {"broadcast", &broadcast_run},
+            {"copies",    &copies_run}
+    };
+    double medians[2];
+    for (uint32_t b = 0; b < 2; b++) {
+        uint64_t ops_per_sec[options.runs];
+        //the first run is a warmup
+        for (uint32_t run = 0; run <= options.runs; run++) {
+            const uint64_t ops = benchmarks[b].run(&fan_out);
+            if (ops == 0) {
+                fprintf(stderr, "%s: wrong checksum or lapped receiver\n", benchmarks[b].name);
+                return 1;
+            }
+            if (run != 0) {
+                ops_per_sec[run - 1] = ops;
+            }
+        }
+        qsort(ops_per_sec, options.runs, sizeof(uint64_t), &compare_uint64);
+        medians[b] = ops_per_sec[options.runs / 2] / 1e6;
+        printf("%-10s receivers:%u median:%.2fM msgs/sec min:%.2fM max:%.2fM\n", benchmarks[b].name,
+               options.receivers, medians[b], ops_per_sec[0] / 1e6, ops_per_sec[options.runs - 1] / 1e6);
+    }
+    printf("broadcast/copies: %.2fx\n", medians[0] / medians[1]);
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "franz_flow.hpp"
+#include "benchmark_cpp_c.h"
+
+/**
+ * Throughput of the C++ front-end (franz_flow.hpp) against the C calls it wraps, with a single producer sending
+ * 1..messages on a ring and a single consumer checking their checksum:
+ * - c: the C functions, with a function pointer consumer and its context, as benchmark.c, built as C by
+ *   benchmark_cpp_c.c
+ * - cpp: the C++ classes, with a lambda consumer and a claim committed on scope exit
+ * on both a ring_buffer of 8 bytes records and a fixed_size_ring of uint64_t.
+ */
+
+#define MSG_TYPE_ID 1
+
+/**
+ * Runs produce and consume on 2 threads: returns the ops/sec or 0 if the checksum is wrong.
+ */
+template<typename Produce, typename Consume>
+static uint64_t run(const cpp_benchmark_options &options, Produce &&produce, Consume &&consume) {
+    const uint64_t messages = options.messages;
+    const auto start = std::chrono::steady_clock::now();
+    std::thread producer([&] {
+        idle_strategy idle_strategy;
+        init_idle_strategy(&idle_strategy, options.idle_strategy_kind);
+        for (uint64_t value = 1; value <= messages; value++) {
+            while (!produce(value)) {
+                idle_strategy_idle(&idle_strategy);
+            }
+            idle_strategy_reset(&idle_strategy);
+        }
+    });
+    idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, options.idle_strategy_kind);
+    uint64_t read = 0;
+    uint64_t checksum = 0;
+    while (read < messages) {
+        const uint32_t msg_read = consume(checksum);
+        idle_strategy_idle_work(&idle_strategy, msg_read);
+        read += msg_read;
+    }
+    producer.join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (checksum != messages * (messages + 1) / 2) {
+        return 0;
+    }
+    return static_cast<uint64_t>(messages / seconds);
+}
+
+static uint64_t cpp_ring_buffer_run(const cpp_benchmark_options &options) {
+    auto ring = franz_flow::ring_buffer::allocate(options.capacity * required_record_capacity(sizeof(uint64_t)));
+    if (!ring) {
+        return 0;
+    }
+    return run(options, [&](const uint64_t value) {
+        auto claim = ring->try_claim(MSG_TYPE_ID, sizeof(value));
+        if (!claim) {
+            return false;
+        }
+        std::memcpy(claim->payload().data(), &value, sizeof(value));
+        return true;
+    }, [&](uint64_t &checksum) {
+        return ring->batch_read([&](const uint32_t msg_type_id, const std::span<const uint8_t> payload) {
+            uint64_t value;
+            std::memcpy(&value, payload.data(), sizeof(value));
+            checksum += value;
+        }, options.read_batch_size);
+    });
+}
+
+static uint64_t cpp_fixed_size_run(const cpp_benchmark_options &options) {
+    auto ring = franz_flow::fixed_size_ring<uint64_t>::allocate(options.capacity);
+    if (!ring) {
+        return 0;
+    }
+    return run(options, [&](const uint64_t value) {
+        auto claim = ring->try_claim();
+        if (!claim) {
+            return false;
+        }
+        claim->message() = value;
+        return true;
+    }, [&](uint64_t &checksum) {
+        return ring->batch_read([&](const uint64_t &value) {
+            checksum += value;
+        }, options.read_batch_size);
+    });
+}
+
+struct cpp_benchmark {
+    const char *name;
+    uint64_t (*run)(const cpp_benchmark_options &);
+};
+
+static void usage(const char *const program) {
+    std::fprintf(stderr,
+                 "usage: %s [options]\n"
+                 "  --messages=N                        (per run, default 10000000)\n"
+                 "  --runs=RUNS                         (default 5, after 1 warmup)\n"
+                 "  --capacity=MESSAGES                 (default 65536)\n"
+                 "  --read-batch=MESSAGES               (default capacity / 64)\n"
+                 "  --idle=noop|busy|pause|backoff      (default pause)\n",
+                 program);
+}
+
+int main(int argc, char *argv[]) {
+    static const option long_options[] = {
+            {"messages",   required_argument, nullptr, 'm'},
+            {"runs",       required_argument, nullptr, 'r'},
+            {"capacity",   required_argument, nullptr, 'c'},
+            {"read-batch", required_argument, nullptr, 'b'},
+            {"idle",       required_argument, nullptr, 'i'},
+            {"help",       no_argument,       nullptr, 'h'},
+            {nullptr, 0,                      nullptr, 0}
+    };
+    static const char *const idle_names[] = {"noop", "busy", "pause", "backoff"};
+    cpp_benchmark_options options = {10000000, 5, 64 * 1024, 0, IDLE_STRATEGY_PAUSE_SPIN};
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, nullptr)) != -1) {
+        char *end = nullptr;
+        bool valid = true;
+        switch (option) {
+            case 'm':
+                options.messages = std::strtoull(optarg, &end, 10);
+                valid = end != optarg && *end == '\0' && options.messages != 0;
+                break;
+            case 'r':
+                options.runs = static_cast<uint32_t>(std::strtoul(optarg, &end, 10));
+                valid = end != optarg && *end == '\0' && options.runs != 0;
+                break;
+            case 'c':
+                options.capacity = static_cast<index_t>(std::strtol(optarg, &end, 10));
+                valid = end != optarg && *end == '\0' && options.capacity > 0 && is_pow_2(options.capacity);
+                break;
+            case 'b':
+                options.read_batch_size = static_cast<uint32_t>(std::strtoul(optarg, &end, 10));
+                valid = end != optarg && *end == '\0' && options.read_batch_size != 0;
+                break;
+            case 'i':
+                valid = false;
+                for (int kind = 0; kind < 4; kind++) {
+                    if (std::strcmp(optarg, idle_names[kind]) == 0) {
+                        options.idle_strategy_kind = static_cast<idle_strategy_kind>(kind);
+                        valid = true;
+                    }
+                }
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.read_batch_size == 0) {
+        options.read_batch_size = std::max<uint32_t>(1, static_cast<uint32_t>(options.capacity / 64));
+    }
+    static const cpp_benchmark benchmarks[] = {
+            {"ring_buffer c",   [](const cpp_benchmark_options &options) { return c_ring_buffer_run(&options); }},
+            {"ring_buffer cpp", &cpp_ring_buffer_run},
+            {"fixed_size c",    [](const cpp_benchmark_options &options) { return c_fixed_size_run(&options); }},
+            {"fixed_size cpp",  &cpp_fixed_size_run}
+    };
+    for (const cpp_benchmark &benchmark: benchmarks) {
+        std::vector<uint64_t> ops_per_sec;
+        //the first run is a warmup
+        for (uint32_t run = 0; run <= options.runs; run++) {
+            const uint64_t ops = benchmark.run(options);
+            if (ops == 0) {
+                std::fprintf(stderr, "%s: can't allocate or wrong checksum\n", benchmark.name);
+                return 1;
+            }
+            if (run != 0) {
+                ops_per_sec.push_back(ops);
+            }
+        }
+        std::sort(ops_per_sec.begin(), ops_per_sec.end());
+        std::printf("%-16s median:%.2fM ops/sec min:%.2fM max:%.2fM\n", benchmark.name,
+                    ops_per_sec[ops_per_sec.size() / 2] / 1e6, ops_per_sec.front() / 1e6, ops_per_sec.back() / 1e6);
+    }
+    return 0;
+}
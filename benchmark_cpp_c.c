@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "ring_buffer.h"
+#include "fixed_size_ring_buffer.c"
+#include "benchmark_cpp_c.h"
+
+/**
+ * The C side of benchmark_cpp.cpp: the C functions, with a function pointer consumer and its context, as
+ * benchmark.c, on the same rings and with the same checksum of the C++ runs.
+ */
+
+#define MSG_TYPE_ID 1
+
+struct c_run {
+    const struct cpp_benchmark_options *options;
+    uint8_t *buffer;
+    struct ring_buffer_header ring_buffer_header;
+    struct fixed_size_ring_buffer_header fixed_size_header;
+    struct timespec start_time;
+    pthread_t producer;
+};
+
+static bool on_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                       const index_t msg_content_length, void *context) {
+    uint64_t value;
+    memcpy(&value, buffer + msg_content_index, sizeof(value));
+    *((uint64_t *) context) += value;
+    return true;
+}
+
+static bool on_fixed_size_message(uint8_t *const buffer, void *const context) {
+    uint64_t value;
+    memcpy(&value, buffer, sizeof(value));
+    *((uint64_t *) context) += value;
+    return true;
+}
+
+static void *ring_buffer_producer(void *arg) {
+    struct c_run *const run = (struct c_run *) arg;
+    const struct ring_buffer_header *const header = &run->ring_buffer_header;
+    uint8_t *const buffer = run->buffer;
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, run->options->idle_strategy_kind);
+    for (uint64_t value = 1; value <= run->options->messages; value++) {
+        uint64_t claimed_position;
+        index_t claimed_index;
+        while (!try_ring_buffer_sp_claim(header, buffer, sizeof(value), &claimed_position, &claimed_index)) {
+            idle_strategy_idle(&idle_strategy);
+        }
+        idle_strategy_reset(&idle_strategy);
+        memcpy(buffer + encoded_msg_offset(claimed_index), &value, sizeof(value));
+        ring_buffer_commit(buffer, claimed_index, MSG_TYPE_ID, sizeof(value));
+    }
+    return NULL;
+}
+
+static void *fixed_size_producer(void *arg) {
+    struct c_run *const run = (struct c_run *) arg;
+    const struct fixed_size_ring_buffer_header *const header = &run->fixed_size_header;
+    uint8_t *const buffer = run->buffer;
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, run->options->idle_strategy_kind);
+    for (uint64_t value = 1; value <= run->options->messages; value++) {
+        uint8_t *content;
+        while (!try_fixed_size_ring_buffer_claim(buffer, header, &content)) {
+            idle_strategy_idle(&idle_strategy);
+        }
+        idle_strategy_reset(&idle_strategy);
+        memcpy(content, &value, sizeof(value));
+        fixed_size_ring_buffer_commit_claim(buffer, header, content);
+    }
+    return NULL;
+}
+
+static uint8_t *allocate_zeroed(const index_t length) {
+    uint8_t *const buffer = (uint8_t *) aligned_alloc(CACHE_LINE_LENGTH, align(length, CACHE_LINE_LENGTH));
+    if (buffer != NULL) {
+        memset(buffer, 0, length);
+    }
+    return buffer;
+}
+
+static bool start_run(struct c_run *const run, void *(*producer)(void *)) {
+    clock_gettime(CLOCK_MONOTONIC, &run->start_time);
+    return pthread_create(&run->producer, NULL, producer, run) == 0;
+}
+
+/**
+ * Joins the producer and frees the ring: returns the ops/sec or 0 if the checksum is wrong.
+ */
+static uint64_t end_run(struct c_run *const run, const uint64_t checksum) {
+    pthread_join(run->producer, NULL);
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    free(run->buffer);
+    const uint64_t messages = run->options->messages;
+    if (checksum != messages * (messages + 1) / 2) {
+        return 0;
+    }
+    const double seconds = (double) (end_time.tv_sec - run->start_time.tv_sec) +
+                           (double) (end_time.tv_nsec - run->start_time.tv_nsec) / 1e9;
+    return (uint64_t) (messages / seconds);
+}
+
+uint64_t c_ring_buffer_run(const struct cpp_benchmark_options *const options) {
+    struct c_run run = {.options = options};
+    const index_t length = ring_buffer_capacity(options->capacity * required_record_capacity(sizeof(uint64_t)));
+    run.buffer = allocate_zeroed(length);
+    if (run.buffer == NULL) {
+        return 0;
+    }
+    if (!init_ring_buffer_header(&run.ring_buffer_header, length) || !start_run(&run, &ring_buffer_producer)) {
+        free(run.buffer);
+        return 0;
+    }
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, options->idle_strategy_kind);
+    uint64_t read = 0;
+    uint64_t checksum = 0;
+    while (read < options->messages) {
+        const uint32_t msg_read = ring_buffer_batch_read(&run.ring_buffer_header, run.buffer, &on_message,
+                                                         options->read_batch_size, &checksum);
+        idle_strategy_idle_work(&idle_strategy, msg_read);
+        read += msg_read;
+    }
+    return end_run(&run, checksum);
+}
+
+uint64_t c_fixed_size_run(const struct cpp_benchmark_options *const options) {
+    struct c_run run = {.options = options};
+    run.buffer = allocate_zeroed(fixed_size_ring_buffer_capacity(options->capacity, sizeof(uint64_t)));
+    if (run.buffer == NULL) {
+        return 0;
+    }
+    if (!init_fixed_size_ring_buffer_header(run.buffer, &run.fixed_size_header, options->capacity,
+                                            sizeof(uint64_t)) || !start_run(&run, &fixed_size_producer)) {
+        free(run.buffer);
+        return 0;
+    }
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, options->idle_strategy_kind);
+    uint64_t read = 0;
+    uint64_t checksum = 0;
+    while (read < options->messages) {
+        const uint32_t msg_read = fixed_size_ring_buffer_batch_read(run.buffer, &run.fixed_size_header,
+                                                                    &on_fixed_size_message,
+                                                                    options->read_batch_size, &checksum);
+        idle_strategy_idle_work(&idle_strategy, msg_read);
+        read += msg_read;
+    }
+    return end_run(&run, checksum);
+}
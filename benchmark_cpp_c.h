@@ -0,0 +1,43 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_BENCHMARK_CPP_C_H
+#define FRANZ_FLOW_BENCHMARK_CPP_C_H
+
+#include <stdint.h>
+#include "index.h"
+#include "idle_strategy.h"
+
+/**
+ * The C baselines of benchmark_cpp.cpp, built from benchmark_cpp_c.c as C: the hot paths they measure are compiled
+ * by the C compiler with the C11 atomics, not with the mapping of franz_flow.hpp.
+ */
+
+struct cpp_benchmark_options {
+    uint64_t messages;
+    uint32_t runs;
+    index_t capacity;
+    uint32_t read_batch_size;
+    enum idle_strategy_kind idle_strategy_kind;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns the ops/sec or 0 if the checksum is wrong or the ring can't be allocated.
+ */
+uint64_t c_ring_buffer_run(const struct cpp_benchmark_options *options);
+
+/**
+ * Returns the ops/sec or 0 if the checksum is wrong or the ring can't be allocated.
+ */
+uint64_t c_fixed_size_run(const struct cpp_benchmark_options *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FRANZ_FLOW_BENCHMARK_CPP_C_H
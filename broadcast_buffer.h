@@ -0,0 +1,212 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_BROADCAST_BUFFER_H
+#define FRANZ_FLOW_BROADCAST_BUFFER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "message_layout.h"
+#include "index.h"
+#include "bytes_utils.h"
+#include "broadcast_buffer_layout.h"
+#include "ring_buffer.h"
+
+/**
+ * One transmitter to many receivers over the message_layout.h records: the transmitter never blocks, overwriting the
+ * oldest records, and each receiver reads them in place from its own cursor.
+ */
+
+inline static uint64_t load_record_header(const uint8_t *const buffer, const index_t index) {
+    //the transmitter could be overwriting it: at least it can't be torn
+    const _Atomic uint64_t *record_header_address = (_Atomic uint64_t *) (buffer + index);
+    return atomic_load_explicit(record_header_address, memory_order_relaxed);
+}
+
+inline static void store_record_header(const uint8_t *const buffer, const index_t index, const uint64_t record_header) {
+    const _Atomic uint64_t *record_header_address = (_Atomic uint64_t *) (buffer + index);
+    atomic_store_explicit(record_header_address, record_header, memory_order_relaxed);
+}
+
+inline static void
+signal_tail_intent(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                   const uint64_t tail_intent) {
+    store_release_tail_intent(header, buffer, tail_intent);
+    //StoreStore: the receivers must see the tail intent before any of the bytes that it is going to overwrite
+    atomic_thread_fence(memory_order_release);
+}
+
+inline static bool
+broadcast_transmit(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                   const uint32_t msg_type_id, const uint8_t *const msg, const index_t msg_length) {
+    if (!check_msg_type_id(msg_type_id) || msg_length > header->max_msg_length) {
+        return false;
+    }
+    const index_t capacity = header->capacity;
+    const index_t mask = capacity - 1;
+    uint64_t current_tail = load_tail(header, buffer);
+    index_t record_index = current_tail & mask;
+    const index_t record_length = msg_length + RECORD_HEADER_LENGTH;
+    const index_t aligned_record_length = align(record_length, RECORD_ALIGNMENT);
+    const uint64_t new_tail = current_tail + aligned_record_length;
+    const index_t bytes_until_end_of_buffer = capacity - record_index;
+    if (bytes_until_end_of_buffer < aligned_record_length) {
+        signal_tail_intent(header, buffer, new_tail + bytes_until_end_of_buffer);
+        store_record_header(buffer, record_index, make_header(RECORD_PADDING_MSG_TYPE_ID, bytes_until_end_of_buffer));
+        current_tail += bytes_until_end_of_buffer;
+        record_index = 0;
+    } else {
+        signal_tail_intent(header, buffer, new_tail);
+    }
+    store_record_header(buffer, record_index, make_header(msg_type_id, record_length));
+    memcpy((uint8_t *) buffer + encoded_msg_offset(record_index), msg, msg_length);
+    store_release_latest(header, buffer, current_tail);
+    store_release_tail(header, buffer, current_tail + aligned_record_length);
+    return true;
+}
+
+struct broadcast_receiver {
+    //start position of the received record
+    uint64_t cursor;
+    uint64_t next_record;
+    index_t record_index;
+    uint32_t msg_type_id;
+    index_t msg_length;
+    //how many times the transmitter has lapped the receiver and how many bytes it has lost due to it
+    uint64_t lapped_count;
+    uint64_t lost_bytes;
+};
+
+inline static void
+init_broadcast_receiver(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                        struct broadcast_receiver *const receiver) {
+    //a new receiver starts from the latest record transmitted
+    const uint64_t latest = load_acquire_latest(header, buffer);
+    receiver->cursor = latest;
+    receiver->next_record = latest;
+    receiver->record_index = latest & (header->capacity - 1);
+    receiver->msg_type_id = 0;
+    receiver->msg_length = 0;
+    receiver->lapped_count = 0;
+    receiver->lost_bytes = 0;
+}
+
+inline static bool
+is_broadcast_position_valid(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                            const uint64_t position) {
+    return (position + header->capacity) > load_acquire_tail_intent(header, buffer);
+}
+
+/**
+ * Moves the receiver to the next record, if any. The record is read in place, hence it could be overwritten while
+ * being read: broadcast_receiver_validate tells if it is still valid after it has been read.
+ */
+inline static bool
+broadcast_receiver_receive_next(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                                struct broadcast_receiver *const receiver) {
+    const uint64_t tail = load_acquire_tail(header, buffer);
+    uint64_t cursor = receiver->next_record;
+    if (tail <= cursor) {
+        return false;
+    }
+    const index_t mask = header->capacity - 1;
+    while (true) {
+        if (!is_broadcast_position_valid(header, buffer, cursor)) {
+            //lapped by the transmitter: restart from the latest record
+            const uint64_t latest = load_acquire_latest(header, buffer);
+            receiver->lapped_count++;
+            receiver->lost_bytes += latest - cursor;
+            cursor = latest;
+        }
+        index_t record_index = cursor & mask;
+        uint64_t record_header = load_record_header(buffer, record_index);
+        uint64_t next_record = cursor + align(record_length(record_header), RECORD_ALIGNMENT);
+        if (message_type_id(record_header) == RECORD_PADDING_MSG_TYPE_ID) {
+            record_index = 0;
+            cursor = next_record;
+            record_header = load_record_header(buffer, record_index);
+            next_record = cursor + align(record_length(record_header), RECORD_ALIGNMENT);
+        }
+        //LoadLoad: the record header is valid only if it hasn't been overwritten after being read
+        atomic_thread_fence(memory_order_acquire);
+        if (is_broadcast_position_valid(header, buffer, cursor)) {
+            receiver->cursor = cursor;
+            receiver->next_record = next_record;
+            receiver->record_index = record_index;
+            receiver->msg_type_id = message_type_id(record_header);
+            receiver->msg_length = record_length(record_header) - RECORD_HEADER_LENGTH;
+            return true;
+        }
+    }
+}
+
+inline static bool
+broadcast_receiver_validate(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                            const struct broadcast_receiver *const receiver) {
+    //LoadLoad: any read of the record must happen before checking that it hasn't been overwritten
+    atomic_thread_fence(memory_order_acquire);
+    return is_broadcast_position_valid(header, buffer, receiver->cursor);
+}
+
+enum broadcast_receive_status {
+    BROADCAST_RECEIVE_EMPTY,
+    BROADCAST_RECEIVE_OK,
+    //the record has been overwritten while being consumed
+    BROADCAST_RECEIVE_LAPPED
+};
+
+/**
+ * Zero copy receive: the consumer reads the record in place and its work must be discarded if the record has been
+ * lapped meanwhile.
+ */
+inline static enum broadcast_receive_status
+broadcast_receive(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                  struct broadcast_receiver *const receiver, const message_consumer consumer, void *const context) {
+    if (!broadcast_receiver_receive_next(header, buffer, receiver)) {
+        return BROADCAST_RECEIVE_EMPTY;
+    }
+    consumer(receiver->msg_type_id, buffer, encoded_msg_offset(receiver->record_index), receiver->msg_length,
+             context);
+    if (!broadcast_receiver_validate(header, buffer, receiver)) {
+        return BROADCAST_RECEIVE_LAPPED;
+    }
+    return BROADCAST_RECEIVE_OK;
+}
+
+/**
+ * Copies the record the receiver is on in scratch, that must be max_msg_length bytes long: returns false if it has
+ * been overwritten before the copy was complete, hence scratch can't be trusted.
+ */
+inline static bool
+broadcast_receiver_copy(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                        const struct broadcast_receiver *const receiver, uint8_t *const scratch) {
+    const index_t msg_length = receiver->msg_length;
+    //only a lapped record could have a wrong length
+    if (msg_length < 0 || msg_length > header->max_msg_length) {
+        return false;
+    }
+    memcpy(scratch, buffer + encoded_msg_offset(receiver->record_index), msg_length);
+    return broadcast_receiver_validate(header, buffer, receiver);
+}
+
+/**
+ * Copies the record in scratch, that must be max_msg_length bytes long, and validates it before the consumer reads it
+ * from there: the consumer can't see any overwritten record, at the cost of a copy.
+ */
+inline static enum broadcast_receive_status
+broadcast_copy_receive(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                       struct broadcast_receiver *const receiver, uint8_t *const scratch,
+                       const message_consumer consumer, void *const context) {
+    if (!broadcast_receiver_receive_next(header, buffer, receiver)) {
+        return BROADCAST_RECEIVE_EMPTY;
+    }
+    if (!broadcast_receiver_copy(header, buffer, receiver, scratch)) {
+        return BROADCAST_RECEIVE_LAPPED;
+    }
+    consumer(receiver->msg_type_id, scratch, 0, receiver->msg_length, context);
+    return BROADCAST_RECEIVE_OK;
+}
+
+#endif //FRANZ_FLOW_BROADCAST_BUFFER_H
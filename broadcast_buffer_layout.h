@@ -0,0 +1,117 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_BROADCAST_BUFFER_LAYOUT_H
+#define FRANZ_FLOW_BROADCAST_BUFFER_LAYOUT_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "message_layout.h"
+#include "index.h"
+#include "bytes_utils.h"
+
+/**
+ * Offset within the trailer for where the tail intent value is stored: the end position of the record that is being
+ * written by the transmitter.
+ */
+static const index_t BROADCAST_BUFFER_TAIL_INTENT_COUNTER_OFFSET = 0;
+/**
+ * Offset within the trailer for where the tail value is stored: the end position of the last record transmitted.
+ */
+static const index_t BROADCAST_BUFFER_TAIL_COUNTER_OFFSET = sizeof(uint64_t);
+/**
+ * Offset within the trailer for where the latest value is stored: the start position of the last record transmitted.
+ */
+static const index_t BROADCAST_BUFFER_LATEST_COUNTER_OFFSET = sizeof(uint64_t) * 2;
+/**
+ * Total length of the trailer in bytes: the counters are written only by the transmitter and read by all the
+ * receivers, then they can share the same cache line.
+ */
+static const index_t BROADCAST_BUFFER_TRAILER_LENGTH = CACHE_LINE_LENGTH * 2;
+
+inline static bool broadcast_buffer_check_capacity(const index_t capacity) {
+    return is_pow_2(capacity - BROADCAST_BUFFER_TRAILER_LENGTH);
+}
+
+/**
+ * Returns 0 if the length of the broadcast buffer can't fit an index_t.
+ */
+inline static index_t broadcast_buffer_capacity(const index_t requested_capacity) {
+    index_t capacity;
+    index_t broadcast_buffer_capacity;
+    if (!checked_next_pow_2(requested_capacity, &capacity) ||
+        !checked_add(capacity, BROADCAST_BUFFER_TRAILER_LENGTH, &broadcast_buffer_capacity)) {
+        return 0;
+    }
+    return broadcast_buffer_capacity;
+}
+
+struct broadcast_buffer_header {
+    index_t max_msg_length;
+    index_t tail_intent_counter_index;
+    index_t tail_counter_index;
+    index_t latest_counter_index;
+    index_t capacity;
+};
+
+inline static bool init_broadcast_buffer_header(struct broadcast_buffer_header *const header, const index_t length) {
+    if (!broadcast_buffer_check_capacity(length)) {
+        return false;
+    }
+    const index_t capacity = length - BROADCAST_BUFFER_TRAILER_LENGTH;
+    header->capacity = capacity;
+    //a record can't be bigger than 1/8 of the buffer, to give a chance to the receivers to not be lapped
+    header->max_msg_length = clamp_max_msg_length(capacity / 8);
+    header->tail_intent_counter_index = capacity + BROADCAST_BUFFER_TAIL_INTENT_COUNTER_OFFSET;
+    header->tail_counter_index = capacity + BROADCAST_BUFFER_TAIL_COUNTER_OFFSET;
+    header->latest_counter_index = capacity + BROADCAST_BUFFER_LATEST_COUNTER_OFFSET;
+    return true;
+}
+
+inline static uint64_t
+load_acquire_tail_intent(const struct broadcast_buffer_header *const header, const uint8_t *const buffer) {
+    const _Atomic uint64_t *tail_intent_address = (_Atomic uint64_t *) (buffer + header->tail_intent_counter_index);
+    return atomic_load_explicit(tail_intent_address, memory_order_acquire);
+}
+
+inline static void
+store_release_tail_intent(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                          const uint64_t value) {
+    const _Atomic uint64_t *tail_intent_address = (_Atomic uint64_t *) (buffer + header->tail_intent_counter_index);
+    atomic_store_explicit(tail_intent_address, value, memory_order_release);
+}
+
+inline static uint64_t load_tail(const struct broadcast_buffer_header *const header, const uint8_t *const buffer) {
+    //only the transmitter writes it
+    const uint64_t *tail_address = (uint64_t *) (buffer + header->tail_counter_index);
+    return *tail_address;
+}
+
+inline static uint64_t
+load_acquire_tail(const struct broadcast_buffer_header *const header, const uint8_t *const buffer) {
+    const _Atomic uint64_t *tail_address = (_Atomic uint64_t *) (buffer + header->tail_counter_index);
+    return atomic_load_explicit(tail_address, memory_order_acquire);
+}
+
+inline static void
+store_release_tail(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                   const uint64_t value) {
+    const _Atomic uint64_t *tail_address = (_Atomic uint64_t *) (buffer + header->tail_counter_index);
+    atomic_store_explicit(tail_address, value, memory_order_release);
+}
+
+inline static uint64_t
+load_acquire_latest(const struct broadcast_buffer_header *const header, const uint8_t *const buffer) {
+    const _Atomic uint64_t *latest_address = (_Atomic uint64_t *) (buffer + header->latest_counter_index);
+    return atomic_load_explicit(latest_address, memory_order_acquire);
+}
+
+inline static void
+store_release_latest(const struct broadcast_buffer_header *const header, const uint8_t *const buffer,
+                     const uint64_t value) {
+    const _Atomic uint64_t *latest_address = (_Atomic uint64_t *) (buffer + header->latest_counter_index);
+    atomic_store_explicit(latest_address, value, memory_order_release);
+}
+
+#endif //FRANZ_FLOW_BROADCAST_BUFFER_LAYOUT_H
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "broadcast_buffer.h"
+
+/**
+ * broadcast_buffer receives on a buffer of 1024 bytes, with the transmitter lapping the receivers on purpose:
+ * exits with 1 if any check fails.
+ */
+
+#define MSG_TYPE_ID 1
+#define BUFFER_CAPACITY 1024
+
+struct test_broadcast_buffer {
+    struct broadcast_buffer_header header;
+    uint8_t *buffer;
+};
+
+struct test_consumer_context {
+    uint64_t last_value;
+    uint64_t received;
+    //if not NULL, the consumer transmits lap_records records on it while reading
+    const struct test_broadcast_buffer *lapping_buffer;
+    uint32_t lap_records;
+};
+
+static uint32_t failures = 0;
+
+static void check(const bool condition, const char *const test, const char *const what) {
+    if (!condition) {
+        fprintf(stderr, "%s: %s\n", test, what);
+        failures++;
+    }
+}
+
+static bool init_test_broadcast_buffer(struct test_broadcast_buffer *const broadcast_buffer) {
+    const index_t length = broadcast_buffer_capacity(BUFFER_CAPACITY);
+    broadcast_buffer->buffer = (uint8_t *) aligned_alloc(CACHE_LINE_LENGTH, length);
+    if (broadcast_buffer->buffer == NULL) {
+        return false;
+    }
+    memset(broadcast_buffer->buffer, 0, length);
+    return init_broadcast_buffer_header(&broadcast_buffer->header, length);
+}
+
+/**
+ * Transmits value on msg_length bytes, that must be at least 8.
+ */
+static bool transmit(const struct test_broadcast_buffer *const broadcast_buffer, const uint64_t value,
+                     const index_t msg_length) {
+    uint8_t msg[64] = {0};
+    memcpy(msg, &value, sizeof(value));
+    return broadcast_transmit(&broadcast_buffer->header, broadcast_buffer->buffer, MSG_TYPE_ID, msg, msg_length);
+}
+
+static bool on_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                       const index_t msg_content_length, void *context) {
+    struct test_consumer_context *const consumer_context = (struct test_consumer_context *) context;
+    memcpy(&consumer_context->last_value, buffer + msg_content_index, sizeof(uint64_t));
+    consumer_context->received++;
+    if (consumer_context->lapping_buffer != NULL) {
+        for (uint32_t i = 0; i < consumer_context->lap_records; i++) {
+            transmit(consumer_context->lapping_buffer, 0, sizeof(uint64_t));
+        }
+    }
+    return true;
+}
+
+static void test_in_order_receive(void) {
+    struct test_broadcast_buffer broadcast_buffer;
+    check(init_test_broadcast_buffer(&broadcast_buffer), __func__, "can't init");
+    const struct broadcast_buffer_header *const header = &broadcast_buffer.header;
+    struct broadcast_receiver receiver;
+    init_broadcast_receiver(header, broadcast_buffer.buffer, &receiver);
+    struct test_consumer_context context = {0};
+    //24 bytes records don't divide the buffer: the laps of the transmitter end with a padding record
+    uint64_t value = 0;
+    for (uint32_t batch = 0; batch < 10; batch++) {
+        for (uint32_t i = 0; i < 20; i++) {
+            value++;
+            check(transmit(&broadcast_buffer, value, 16), __func__, "can't transmit");
+        }
+        for (uint32_t i = 0; i < 20; i++) {
+            const uint64_t expected_value = context.last_value + 1;
+            check(broadcast_receive(header, broadcast_buffer.buffer, &receiver, &on_message, &context) ==
+                  BROADCAST_RECEIVE_OK, __func__, "not received");
+            check(context.last_value == expected_value, __func__, "not received in order");
+        }
+    }
+    check(broadcast_receive(header, broadcast_buffer.buffer, &receiver, &on_message, &context) ==
+          BROADCAST_RECEIVE_EMPTY, __func__, "not empty");
+    check(context.received == value, __func__, "wrong received count");
+    check(receiver.lapped_count == 0 && receiver.lost_bytes == 0, __func__, "lapped without being lapped");
+    free(broadcast_buffer.buffer);
+}
+
+static void test_lapped_receiver(void) {
+    struct test_broadcast_buffer broadcast_buffer;
+    check(init_test_broadcast_buffer(&broadcast_buffer), __func__, "can't init");
+    const struct broadcast_buffer_header *const header = &broadcast_buffer.header;
+    struct broadcast_receiver receiver;
+    init_broadcast_receiver(header, broadcast_buffer.buffer, &receiver);
+    //16 bytes records: more than a lap, the receiver has to restart from the latest one
+    const uint64_t records = 100;
+    for (uint64_t value = 1; value <= records; value++) {
+        check(transmit(&broadcast_buffer, value, sizeof(uint64_t)), __func__, "can't transmit");
+    }
+    struct test_consumer_context context = {0};
+    check(broadcast_receive(header, broadcast_buffer.buffer, &receiver, &on_message, &context) ==
+          BROADCAST_RECEIVE_OK, __func__, "not received");
+    check(context.last_value == records, __func__, "not restarted from the latest record");
+    check(receiver.lapped_count == 1, __func__, "wrong lapped count");
+    check(receiver.lost_bytes == (records - 1) * 16, __func__, "wrong lost bytes");
+    check(broadcast_receive(header, broadcast_buffer.buffer, &receiver, &on_message, &context) ==
+          BROADCAST_RECEIVE_EMPTY, __func__, "not empty");
+    free(broadcast_buffer.buffer);
+}
+
+static void test_lapped_while_consuming(void) {
+    struct test_broadcast_buffer broadcast_buffer;
+    check(init_test_broadcast_buffer(&broadcast_buffer), __func__, "can't init");
+    const struct broadcast_buffer_header *const header = &broadcast_buffer.header;
+    struct broadcast_receiver receiver;
+    init_broadcast_receiver(header, broadcast_buffer.buffer, &receiver);
+    check(transmit(&broadcast_buffer, 1, sizeof(uint64_t)), __func__, "can't transmit");
+    //a lap of 16 bytes records while the zero copy consumer reads in place
+    struct test_consumer_context context = {.lapping_buffer = &broadcast_buffer,
+            .lap_records = BUFFER_CAPACITY / 16};
+    check(broadcast_receive(header, broadcast_buffer.buffer, &receiver, &on_message, &context) ==
+          BROADCAST_RECEIVE_LAPPED, __func__, "overwritten record not detected");
+    free(broadcast_buffer.buffer);
+}
+
+static void test_copy_receive_overwritten(void) {
+    struct test_broadcast_buffer broadcast_buffer;
+    check(init_test_broadcast_buffer(&broadcast_buffer), __func__, "can't init");
+    const struct broadcast_buffer_header *const header = &broadcast_buffer.header;
+    uint8_t *const buffer = broadcast_buffer.buffer;
+    uint8_t scratch[BUFFER_CAPACITY];
+    struct broadcast_receiver receiver;
+    init_broadcast_receiver(header, buffer, &receiver);
+    check(transmit(&broadcast_buffer, 1, sizeof(uint64_t)), __func__, "can't transmit");
+    check(broadcast_receiver_receive_next(header, buffer, &receiver), __func__, "not received");
+    //the transmitter laps the receiver between its receive and its copy
+    const uint64_t lap_records = BUFFER_CAPACITY / 16;
+    for (uint64_t value = 2; value <= lap_records + 1; value++) {
+        check(transmit(&broadcast_buffer, value, sizeof(uint64_t)), __func__, "can't transmit");
+    }
+    check(!broadcast_receiver_copy(header, buffer, &receiver, scratch), __func__, "overwritten record copied");
+    //the next copy receive restarts from the latest record
+    struct test_consumer_context context = {0};
+    check(broadcast_copy_receive(header, buffer, &receiver, scratch, &on_message, &context) == BROADCAST_RECEIVE_OK,
+          __func__, "not received after the lap");
+    check(context.received == 1 && context.last_value == lap_records + 1, __func__, "not the latest record");
+    check(receiver.lapped_count == 1, __func__, "wrong lapped count");
+    free(broadcast_buffer.buffer);
+}
+
+int main(int argc, char *argv[]) {
+    test_in_order_receive();
+    test_lapped_receiver();
+    test_lapped_while_consuming();
+    test_copy_receive_overwritten();
+    if (failures != 0) {
+        fprintf(stderr, "%u checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
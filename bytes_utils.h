@@ -7,8 +7,16 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include "index.h"
 
+#if defined(__x86_64__)
+
+#include <emmintrin.h>
+
+#endif
+
 #define CACHE_LINE_LENGTH 64
 
 inline static bool is_pow_2(const index_t value) {
@@ -27,8 +35,55 @@ inline static index_t next_pow_2(const index_t value) {
     v |= v >> 4;
     v |= v >> 8;
     v |= v >> 16;
+#ifdef FRANZ_FLOW_INDEX_64
+    v |= v >> 32;
+#endif
     v++;
     return v;
 }
 
+/**
+ * Computes the next power of 2 of a positive value, failing if it can't fit an index_t.
+ */
+inline static bool checked_next_pow_2(const index_t value, index_t *const result) {
+    if (value <= 0 || value > ((INDEX_MAX >> 1) + 1)) {
+        return false;
+    }
+    *result = next_pow_2(value);
+    return true;
+}
+
+inline static bool checked_add(const index_t a, const index_t b, index_t *const result) {
+    return !__builtin_add_overflow(a, b, result);
+}
+
+inline static bool checked_multiply(const index_t a, const index_t b, index_t *const result) {
+    return !__builtin_mul_overflow(a, b, result);
+}
+
+/**
+ * Zeroes length bytes, 8 bytes aligned, with streaming stores: the zeroed lines are written back to memory without
+ * being read nor kept in the cache. The stores are fenced, hence they are visible before any store that follows.
+ */
+inline static void non_temporal_zero(uint8_t *const address, const index_t length) {
+#if defined(__x86_64__)
+    uint8_t *current = address;
+    uint8_t *const end = address + length;
+    if (current < end && (((uintptr_t) current) & 15) != 0) {
+        _mm_stream_si64((long long *) current, 0);
+        current += 8;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    for (; current + 16 <= end; current += 16) {
+        _mm_stream_si128((__m128i *) current, zero);
+    }
+    if (current < end) {
+        _mm_stream_si64((long long *) current, 0);
+    }
+    _mm_sfence();
+#else
+    memset(address, 0, length);
+#endif
+}
+
 #endif //FRANZ_FLOW_BYTES_UTILS_H
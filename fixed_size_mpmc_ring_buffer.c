@@ -0,0 +1,202 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_FIXED_SIZE_MPMC_RING_BUFFER_C
+#define FRANZ_FLOW_FIXED_SIZE_MPMC_RING_BUFFER_C
+
+#include <stdatomic.h>
+#include "fixed_size_mpmc_ring_buffer.h"
+#include "fixed_size_ring_buffer.c"
+#include "bytes_utils.h"
+
+/**
+ * The sequence of a slot is a 32 bit truncation of the positions: the distance between them is always less than
+ * the capacity, hence its sign is enough to tell apart the laps.
+ */
+static inline int32_t sequence_distance(const uint32_t sequence, const uint64_t position) {
+    return (int32_t) (sequence - (uint32_t) position);
+}
+
+static inline bool
+init_fixed_size_mpmc_ring_buffer_header(uint8_t *const buffer, struct fixed_size_ring_buffer_header *const header,
+                                        const index_t requested_capacity,
+                                        const uint32_t message_size) {
+    if (!init_fixed_size_ring_buffer_header(buffer, header, requested_capacity, message_size)) {
+        return false;
+    }
+    const index_t capacity = header->capacity;
+    //the distance between a 32 bit sequence and a position must keep its sign
+    if (capacity > (1 << 30)) {
+        return false;
+    }
+    const index_t aligned_message_size = header->aligned_message_size;
+    //a slot is free for the producer claiming the position equals to its sequence
+    for (index_t i = 0; i < capacity; i++) {
+        _Atomic uint32_t *const message_sequence_address = (_Atomic uint32_t *) (buffer + (i * aligned_message_size));
+        atomic_store_explicit(message_sequence_address, (uint32_t) i, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+    return true;
+}
+
+static inline bool
+try_fixed_size_mpmc_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                      uint8_t **const claimed_message) {
+    _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) (buffer + header->producer_position_index);
+    const index_t mask = header->mask;
+    const index_t aligned_message_size = header->aligned_message_size;
+    uint64_t producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);
+    while (true) {
+        const index_t message_sequence_offset = (producer_position & mask) * aligned_message_size;
+        const _Atomic uint32_t *const message_sequence_address = (_Atomic uint32_t *) (buffer +
+                                                                                       message_sequence_offset);
+        const uint32_t message_sequence = atomic_load_explicit(message_sequence_address, memory_order_acquire);
+        const int32_t distance = sequence_distance(message_sequence, producer_position);
+        if (distance == 0) {
+            if (atomic_compare_exchange_weak_explicit(producer_position_address, &producer_position,
+                                                      producer_position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *claimed_message = buffer + message_sequence_offset + MESSAGE_STATE_SIZE;
+                return true;
+            }
+        } else if (distance < 0) {
+            //the message of the previous lap is not consumed yet: is full
+            return false;
+        } else {
+            //another producer has already claimed it
+            producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);
+        }
+    }
+}
+
+static inline void fixed_size_mpmc_ring_buffer_commit_claim(const uint8_t *const claimed_message_address) {
+    _Atomic uint32_t *const message_sequence_address = (_Atomic uint32_t *) (claimed_message_address -
+                                                                             MESSAGE_STATE_SIZE);
+    //the claimed position is the current sequence
+    const uint32_t claimed_sequence = atomic_load_explicit(message_sequence_address, memory_order_relaxed);
+    atomic_store_explicit(message_sequence_address, claimed_sequence + 1, memory_order_release);
+}
+
+static inline bool
+try_fixed_size_mpmc_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                     uint8_t **const read_message_address) {
+    _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer + header->consumer_position_index);
+    const index_t mask = header->mask;
+    const index_t aligned_message_size = header->aligned_message_size;
+    uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
+    while (true) {
+        const index_t message_sequence_offset = (consumer_position & mask) * aligned_message_size;
+        const _Atomic uint32_t *const message_sequence_address = (_Atomic uint32_t *) (buffer +
+                                                                                       message_sequence_offset);
+        const uint32_t message_sequence = atomic_load_explicit(message_sequence_address, memory_order_acquire);
+        const int32_t distance = sequence_distance(message_sequence, consumer_position + 1);
+        if (distance == 0) {
+            if (atomic_compare_exchange_weak_explicit(consumer_position_address, &consumer_position,
+                                                      consumer_position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *read_message_address = buffer + message_sequence_offset + MESSAGE_STATE_SIZE;
+                return true;
+            }
+        } else if (distance < 0) {
+            //can't consume if not filled!
+            return false;
+        } else {
+            //another consumer has already read it
+            consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
+        }
+    }
+}
+
+static inline void fixed_size_mpmc_ring_buffer_commit_read(const struct fixed_size_ring_buffer_header *const header,
+                                                           const uint8_t *const read_message_address) {
+    _Atomic uint32_t *const message_sequence_address = (_Atomic uint32_t *) (read_message_address -
+                                                                             MESSAGE_STATE_SIZE);
+    //the read position is the current sequence - 1: the slot is free for the producer of the next lap
+    const uint32_t read_sequence = atomic_load_explicit(message_sequence_address, memory_order_relaxed);
+    atomic_store_explicit(message_sequence_address, read_sequence - 1 + header->capacity, memory_order_release);
+}
+
+/**
+ * Claims with a single CAS up to count consecutive ready messages: none of them can be left to the other consumers,
+ * hence all of them are consumed whatever the consumer returns.
+ */
+inline static uint32_t fixed_size_mpmc_ring_buffer_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context) {
+    _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer + header->consumer_position_index);
+    const index_t mask = header->mask;
+    const index_t capacity = header->capacity;
+    const index_t aligned_message_size = header->aligned_message_size;
+    uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
+    uint32_t msg_ready;
+    do {
+        int32_t distance = 0;
+        msg_ready = 0;
+        while (msg_ready < count) {
+            const uint64_t message_position = consumer_position + msg_ready;
+            const index_t message_sequence_offset = (message_position & mask) * aligned_message_size;
+            const _Atomic uint32_t *const message_sequence_address = (_Atomic uint32_t *) (buffer +
+                                                                                           message_sequence_offset);
+            const uint32_t message_sequence = atomic_load_explicit(message_sequence_address, memory_order_relaxed);
+            distance = sequence_distance(message_sequence, message_position + 1);
+            if (distance != 0) {
+                break;
+            }
+            msg_ready++;
+        }
+        if (msg_ready == 0) {
+            if (distance < 0) {
+                return 0;
+            }
+            //another consumer has already read it
+            consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
+        }
+    } while (msg_ready == 0 ||
+             !atomic_compare_exchange_weak_explicit(consumer_position_address, &consumer_position,
+                                                    consumer_position + msg_ready, memory_order_relaxed,
+                                                    memory_order_relaxed));
+    atomic_thread_fence(memory_order_acquire);
+    for (uint32_t i = 0; i < msg_ready; i++) {
+        const uint64_t message_position = consumer_position + i;
+        uint8_t *const message_sequence_address = buffer + ((message_position & mask) * aligned_message_size);
+        consumer(message_sequence_address + MESSAGE_STATE_SIZE, context);
+        atomic_store_explicit((_Atomic uint32_t *) message_sequence_address,
+                              (uint32_t) (message_position + capacity), memory_order_release);
+    }
+    return msg_ready;
+}
+
+static inline void
+fixed_size_mpmc_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                  struct idle_strategy *const idle_strategy,
+                                  uint8_t **const claimed_message, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    while (!try_fixed_size_mpmc_ring_buffer_claim(buffer, header, claimed_message)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+}
+
+static inline void
+fixed_size_mpmc_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                 struct idle_strategy *const idle_strategy,
+                                 uint8_t **const read_message_address, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    while (!try_fixed_size_mpmc_ring_buffer_read(buffer, header, read_message_address)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+}
+
+#endif //FRANZ_FLOW_FIXED_SIZE_MPMC_RING_BUFFER_C
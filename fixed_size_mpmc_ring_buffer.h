@@ -0,0 +1,52 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_FIXED_SIZE_MPMC_RING_BUFFER_H
+#define FRANZ_FLOW_FIXED_SIZE_MPMC_RING_BUFFER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "index.h"
+#include "idle_strategy.h"
+#include "fixed_size_ring_buffer.h"
+
+/**
+ * Same slot layout and trailer of fixed_size_ring_buffer, but the state of each slot is a sequence: it allows
+ * any number of producers and consumers and must be initialized by init_fixed_size_mpmc_ring_buffer_header.
+ */
+static inline bool
+init_fixed_size_mpmc_ring_buffer_header(uint8_t *const buffer, struct fixed_size_ring_buffer_header *const header,
+                                        const index_t requested_capacity,
+                                        const uint32_t message_size);
+
+static inline bool
+try_fixed_size_mpmc_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                      uint8_t **const claimed_message);
+
+static inline void fixed_size_mpmc_ring_buffer_commit_claim(const uint8_t *const claimed_message_address);
+
+static inline bool
+try_fixed_size_mpmc_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                     uint8_t **const read_message_address);
+
+static inline void fixed_size_mpmc_ring_buffer_commit_read(const struct fixed_size_ring_buffer_header *const header,
+                                                           const uint8_t *const read_message_address);
+
+inline static uint32_t fixed_size_mpmc_ring_buffer_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context);
+
+static inline void
+fixed_size_mpmc_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                  struct idle_strategy *const idle_strategy,
+                                  uint8_t **const claimed_message, uint64_t *const idles);
+
+static inline void
+fixed_size_mpmc_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                 struct idle_strategy *const idle_strategy,
+                                 uint8_t **const read_message_address, uint64_t *const idles);
+
+#endif //FRANZ_FLOW_FIXED_SIZE_MPMC_RING_BUFFER_H
@@ -2,9 +2,21 @@
 // Created by forked_franz on 10/02/17.
 //
 
+#ifndef FRANZ_FLOW_FIXED_SIZE_RING_BUFFER_C
+#define FRANZ_FLOW_FIXED_SIZE_RING_BUFFER_C
+
 #include <stdatomic.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+#define FIXED_SIZE_RING_BUFFER_AVX2_SCAN
+
+#endif
+
 #include "fixed_size_ring_buffer.h"
 #include "bytes_utils.h"
+#include "ring_stats.h"
 
 #define MESSAGE_STATE_SIZE 4
 
@@ -13,39 +25,166 @@ static const index_t MESSAGE_STATE_BUSY = 1;
 static const index_t PRODUCER_POSITION_OFFSET = CACHE_LINE_LENGTH * 2;
 static const index_t CONSUMER_CACHE_POSITION_OFFSET = CACHE_LINE_LENGTH * 4;
 static const index_t CONSUMER_POSITION_OFFSET = CACHE_LINE_LENGTH * 6;
-static const index_t TRAILER_LENGTH = CACHE_LINE_LENGTH * 8;
+static const index_t PRODUCER_STATS_OFFSET = CACHE_LINE_LENGTH * 8;
+static const index_t CONSUMER_STATS_OFFSET = CACHE_LINE_LENGTH * 10;
+static const index_t TRAILER_LENGTH = CACHE_LINE_LENGTH * 12;
 
+static const uint32_t MAX_PAYLOAD_ALIGNMENT = CACHE_LINE_LENGTH;
+
+/**
+ * Computes the layout fields of header and the bytes of the slots, without the trailer.
+ */
+static inline bool fixed_size_ring_buffer_layout(const index_t requested_capacity, const uint32_t message_size,
+                                                 const enum fixed_size_slot_layout slot_layout,
+                                                 const uint32_t payload_alignment,
+                                                 struct fixed_size_ring_buffer_header *const header,
+                                                 index_t *const capacity_bytes) {
+    //the slots can't be bigger than what the header could store
+    if (message_size > (INT32_MAX - (MAX_PAYLOAD_ALIGNMENT * 2)) || payload_alignment < MESSAGE_STATE_SIZE ||
+        payload_alignment > MAX_PAYLOAD_ALIGNMENT || !is_pow_2(payload_alignment)) {
+        return false;
+    }
+    index_t capacity;
+    if (!checked_next_pow_2(requested_capacity, &capacity)) {
+        return false;
+    }
+    index_t message_offset;
+    index_t aligned_message_size;
+    index_t state_stride;
+    index_t slots_bytes;
+    switch (slot_layout) {
+        case FIXED_SIZE_SLOT_LAYOUT_PACKED:
+        case FIXED_SIZE_SLOT_LAYOUT_CACHE_LINE:
+            //the state is at the start of the slot and the content at the first aligned offset after it
+            message_offset = align(MESSAGE_STATE_SIZE, payload_alignment);
+            aligned_message_size = align(message_offset + (index_t) message_size,
+                                         slot_layout == FIXED_SIZE_SLOT_LAYOUT_PACKED ? payload_alignment :
+                                         CACHE_LINE_LENGTH);
+            state_stride = aligned_message_size;
+            if (!checked_multiply(capacity, aligned_message_size, &slots_bytes)) {
+                return false;
+            }
+            break;
+        case FIXED_SIZE_SLOT_LAYOUT_SEPARATED: {
+            index_t states_bytes;
+            index_t messages_bytes;
+            //the contents start on their own cache line
+            aligned_message_size = align(message_size == 0 ? 1 : (index_t) message_size, payload_alignment);
+            state_stride = MESSAGE_STATE_SIZE;
+            if (!checked_multiply(capacity, MESSAGE_STATE_SIZE, &states_bytes) ||
+                states_bytes > INDEX_MAX - CACHE_LINE_LENGTH ||
+                !checked_multiply(capacity, aligned_message_size, &messages_bytes)) {
+                return false;
+            }
+            message_offset = align(states_bytes, CACHE_LINE_LENGTH);
+            if (!checked_add(message_offset, messages_bytes, &slots_bytes)) {
+                return false;
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+    if (slots_bytes > (INDEX_MAX - TRAILER_LENGTH)) {
+        return false;
+    }
+    header->capacity = capacity;
+    header->mask = capacity - 1;
+    header->message_offset = message_offset;
+    header->aligned_message_size = (uint32_t) aligned_message_size;
+    header->state_stride = (uint32_t) state_stride;
+    header->slot_layout = slot_layout;
+    *capacity_bytes = slots_bytes;
+    return true;
+}
+
+/**
+ * Returns 0 if the length of the ring buffer can't fit an index_t.
+ */
+static inline index_t
+fixed_size_ring_buffer_layout_capacity(const index_t requested_capacity, const uint32_t message_size,
+                                       const enum fixed_size_slot_layout slot_layout,
+                                       const uint32_t payload_alignment) {
+    struct fixed_size_ring_buffer_header header;
+    index_t capacity_bytes;
+    if (!fixed_size_ring_buffer_layout(requested_capacity, message_size, slot_layout, payload_alignment, &header,
+                                       &capacity_bytes)) {
+        return 0;
+    }
+    return capacity_bytes + TRAILER_LENGTH;
+}
+
+/**
+ * Same as fixed_size_ring_buffer_layout_capacity, with the PACKED layout and 4 bytes aligned contents.
+ */
 static inline index_t fixed_size_ring_buffer_capacity(const index_t requested_capacity, const uint32_t message_size) {
-    const index_t next_pow_2_requested_capacity = next_pow_2(requested_capacity);
-    const index_t aligned_message_size = align(message_size + MESSAGE_STATE_SIZE, MESSAGE_STATE_SIZE);
-    return (next_pow_2_requested_capacity * aligned_message_size) + TRAILER_LENGTH;
+    return fixed_size_ring_buffer_layout_capacity(requested_capacity, message_size, FIXED_SIZE_SLOT_LAYOUT_PACKED,
+                                                  MESSAGE_STATE_SIZE);
 }
 
+static inline bool
+init_fixed_size_ring_buffer_layout_header(uint8_t *const buffer, struct fixed_size_ring_buffer_header *const header,
+                                          const index_t requested_capacity, const uint32_t message_size,
+                                          const enum fixed_size_slot_layout slot_layout,
+                                          const uint32_t payload_alignment) {
+    index_t capacity_bytes;
+    if (!fixed_size_ring_buffer_layout(requested_capacity, message_size, slot_layout, payload_alignment, header,
+                                       &capacity_bytes)) {
+        return false;
+    }
+    header->producer_position_index = capacity_bytes + PRODUCER_POSITION_OFFSET;
+    header->consumer_cache_position_index = capacity_bytes + CONSUMER_CACHE_POSITION_OFFSET;
+    header->consumer_position_index = capacity_bytes + CONSUMER_POSITION_OFFSET;
+    header->producer_stats_index = capacity_bytes + PRODUCER_STATS_OFFSET;
+    header->consumer_stats_index = capacity_bytes + CONSUMER_STATS_OFFSET;
+    return true;
+}
 
+/**
+ * Same as init_fixed_size_ring_buffer_layout_header, with the PACKED layout and 4 bytes aligned contents: the only
+ * layout supported by the mpmc ring.
+ */
 static inline bool
 init_fixed_size_ring_buffer_header(uint8_t *const buffer, struct fixed_size_ring_buffer_header *const header,
                                    const index_t requested_capacity,
                                    const uint32_t message_size) {
-    const index_t next_pow_2_requested_capacity = next_pow_2(requested_capacity);
-    const index_t aligned_message_size = align(message_size + MESSAGE_STATE_SIZE, MESSAGE_STATE_SIZE);
-    const index_t capacity_bytes = (next_pow_2_requested_capacity * aligned_message_size);
-    header->capacity = next_pow_2_requested_capacity;
-    header->mask = next_pow_2_requested_capacity - 1;
-    header->aligned_message_size = aligned_message_size;
-    header->producer_position = buffer + capacity_bytes + PRODUCER_POSITION_OFFSET;
-    header->consumer_cache_position = buffer + capacity_bytes + CONSUMER_CACHE_POSITION_OFFSET;
-    header->consumer_position = buffer + capacity_bytes + CONSUMER_POSITION_OFFSET;
-    return true;
+    return init_fixed_size_ring_buffer_layout_header(buffer, header, requested_capacity, message_size,
+                                                     FIXED_SIZE_SLOT_LAYOUT_PACKED, MESSAGE_STATE_SIZE);
+}
+
+static inline index_t message_state_offset_of(const struct fixed_size_ring_buffer_header *const header,
+                                              const uint64_t position) {
+    return (position & header->mask) * header->state_stride;
+}
+
+static inline uint8_t *
+message_content_of(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                   const uint64_t position) {
+    return buffer + header->message_offset + ((position & header->mask) * header->aligned_message_size);
+}
+
+/**
+ * The state of a message from its content: the SEPARATED layout pays a division, the batch claims and reads don't.
+ */
+static inline _Atomic uint32_t *message_state_of(uint8_t *const buffer,
+                                                 const struct fixed_size_ring_buffer_header *const header,
+                                                 const uint8_t *const message_content) {
+    if (header->slot_layout != FIXED_SIZE_SLOT_LAYOUT_SEPARATED) {
+        return (_Atomic uint32_t *) (message_content - header->message_offset);
+    }
+    const index_t index = (index_t) (message_content - buffer - header->message_offset) /
+                          (index_t) header->aligned_message_size;
+    return (_Atomic uint32_t *) (buffer + (index * MESSAGE_STATE_SIZE));
 }
 
 static inline bool claim_slow_path(uint8_t *const buffer, const index_t message_state_offset,
                                    uint64_t *const consumer_cache_position_address,
                                    const uint64_t consumer_cache_position, const uint32_t max_look_ahead_step,
-                                   const index_t mask, const index_t aligned_message_size) {
+                                   const index_t mask, const index_t state_stride) {
     //try to look ahead if the consumer has freed MAX_LOOK_AHEAD_STEP messages
     const uint64_t next_consumer_cache_position = consumer_cache_position + max_look_ahead_step;
     //check the state of the message
-    const index_t look_ahead_message_offset = (next_consumer_cache_position & mask) * aligned_message_size;
+    const index_t look_ahead_message_offset = (next_consumer_cache_position & mask) * state_stride;
     const _Atomic uint32_t *const look_ahead_message_state_atomic_address = (_Atomic uint32_t *) (buffer +
                                                                                                   look_ahead_message_offset);
     const uint32_t message_state_value = atomic_load_explicit(look_ahead_message_state_atomic_address,
@@ -74,58 +213,192 @@ try_fixed_size_ring_buffer_lookahead_claim(uint8_t *const buffer,
                                            const struct fixed_size_ring_buffer_header *const header,
                                            const uint32_t max_look_ahead_step,
                                            uint8_t **const claimed_message) {
-    const _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) header->producer_position;
-    uint64_t *const consumer_cache_position_address = (uint64_t *) header->consumer_cache_position;
-    const index_t mask = header->mask;
-    const index_t aligned_message_size = header->aligned_message_size;
+    const _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) (buffer + header->producer_position_index);
+    uint64_t *const consumer_cache_position_address = (uint64_t *) (buffer + header->consumer_cache_position_index);
     const uint64_t consumer_cache_position = *consumer_cache_position_address;
     const uint64_t producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);
-    const index_t message_state_offset = (producer_position & mask) * aligned_message_size;
+    const index_t message_state_offset = message_state_offset_of(header, producer_position);
     //the consumer_cache_position is no longer valid?
-    if (producer_position >= consumer_cache_position &&
-        !claim_slow_path(buffer, message_state_offset, consumer_cache_position_address, consumer_cache_position,
-                         max_look_ahead_step, mask, aligned_message_size)) {
-        return false;
+    if (producer_position >= consumer_cache_position) {
+        ring_stats_record_full_event(buffer, header->producer_stats_index, false);
+        if (!claim_slow_path(buffer, message_state_offset, consumer_cache_position_address, consumer_cache_position,
+                             max_look_ahead_step, header->mask, header->state_stride)) {
+            ring_stats_record_failed_claim(buffer, header->producer_stats_index, false);
+            return false;
+        }
     }
     atomic_store_explicit(producer_position_address, producer_position + 1, memory_order_relaxed);
-    *claimed_message = buffer + message_state_offset + MESSAGE_STATE_SIZE;
+    ring_stats_record_claim(buffer, header->producer_stats_index, false, 0, 0);
+    *claimed_message = message_content_of(buffer, header, producer_position);
     return true;
 }
 
 static inline bool
 try_fixed_size_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
                                  uint8_t **const claimed_message) {
-    const _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) header->producer_position;
-    const index_t mask = header->mask;
-    const index_t aligned_message_size = header->aligned_message_size;
+    const _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) (buffer + header->producer_position_index);
     const uint64_t producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);
-    const index_t message_state_offset = (producer_position & mask) * aligned_message_size;
+    const index_t message_state_offset = message_state_offset_of(header, producer_position);
     const _Atomic uint32_t *const claimed_message_state_atomic_address = (_Atomic uint32_t *) (buffer +
                                                                                                message_state_offset);
     const uint32_t claimed_message_state_value = atomic_load_explicit(claimed_message_state_atomic_address,
                                                                       memory_order_relaxed);
     if (claimed_message_state_value != MESSAGE_STATE_FREE) {
+        //without a cached consumer position, a failed claim is always a full ring
+        ring_stats_record_full_event(buffer, header->producer_stats_index, false);
+        ring_stats_record_failed_claim(buffer, header->producer_stats_index, false);
         return false;
     }
     atomic_thread_fence(memory_order_acquire);
     atomic_store_explicit(producer_position_address, producer_position + 1, memory_order_relaxed);
-    *claimed_message = buffer + message_state_offset + MESSAGE_STATE_SIZE;
+    ring_stats_record_claim(buffer, header->producer_stats_index, false, 0, 0);
+    *claimed_message = message_content_of(buffer, header, producer_position);
     return true;
 }
 
-static inline void fixed_size_ring_buffer_commit_claim(const uint8_t *const claimed_message_address) {
-    const _Atomic uint32_t *const message_state = (_Atomic uint32_t *) (claimed_message_address - MESSAGE_STATE_SIZE);
+/**
+ * Multi producer claim: any producer of the ring must use it. A slot whose state is MESSAGE_STATE_FREE isn't enough
+ * to be claimed, because a slot claimed but not committed yet on the previous lap looks FREE too: the consumer must
+ * have already read the message of the previous lap.
+ */
+static inline bool
+try_fixed_size_ring_buffer_mp_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                    uint8_t **const claimed_message) {
+    _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) (buffer + header->producer_position_index);
+    _Atomic uint64_t *const consumer_cache_position_address = (_Atomic uint64_t *) (buffer +
+                                                                                    header->consumer_cache_position_index);
+    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer +
+                                                                                    header->consumer_position_index);
+    const index_t capacity = header->capacity;
+    uint64_t producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);
+    index_t message_state_offset;
+    do {
+        //the consumer cache position is shared between the producers: release/acquire keeps it as good as the
+        //consumer position it was read from
+        const uint64_t consumer_cache_position = atomic_load_explicit(consumer_cache_position_address,
+                                                                      memory_order_acquire);
+        if ((int64_t) (producer_position - consumer_cache_position) >= capacity) {
+            ring_stats_record_full_event(buffer, header->producer_stats_index, true);
+            const uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_acquire);
+            if ((int64_t) (producer_position - consumer_position) >= capacity) {
+                ring_stats_record_failed_claim(buffer, header->producer_stats_index, true);
+                return false;
+            }
+            atomic_store_explicit(consumer_cache_position_address, consumer_position, memory_order_release);
+        }
+        message_state_offset = message_state_offset_of(header, producer_position);
+        const _Atomic uint32_t *const message_state_atomic_address = (_Atomic uint32_t *) (buffer +
+                                                                                           message_state_offset);
+        //the consumer could still be reading the message of the previous lap
+        if (atomic_load_explicit(message_state_atomic_address, memory_order_acquire) != MESSAGE_STATE_FREE) {
+            ring_stats_record_failed_claim(buffer, header->producer_stats_index, true);
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(producer_position_address, &producer_position,
+                                                    producer_position + 1, memory_order_relaxed,
+                                                    memory_order_relaxed));
+    ring_stats_record_claim(buffer, header->producer_stats_index, true, 0, 0);
+    *claimed_message = message_content_of(buffer, header, producer_position);
+    return true;
+}
+
+static inline void fixed_size_ring_buffer_commit_claim(uint8_t *const buffer,
+                                                       const struct fixed_size_ring_buffer_header *const header,
+                                                       const uint8_t *const claimed_message_address) {
+    _Atomic uint32_t *const message_state = message_state_of(buffer, header, claimed_message_address);
     atomic_store_explicit(message_state, MESSAGE_STATE_BUSY, memory_order_release);
 }
 
+/**
+ * Single producer claim of count consecutive slots, with a single producer position update: as the lookahead claim,
+ * it checks only the state of the last slot of the batch, if not known to be free by the consumer cache position,
+ * because the consumer frees the slots in order. The batch must be committed before claiming again.
+ */
+static inline bool
+try_fixed_size_ring_buffer_batch_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                       const uint32_t count, struct fixed_size_ring_buffer_batch *const batch) {
+    if (count == 0 || (index_t) count > header->capacity) {
+        return false;
+    }
+    const _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) (buffer + header->producer_position_index);
+    uint64_t *const consumer_cache_position_address = (uint64_t *) (buffer + header->consumer_cache_position_index);
+    const uint64_t producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);
+    const uint64_t next_producer_position = producer_position + count;
+    if (next_producer_position > *consumer_cache_position_address) {
+        ring_stats_record_full_event(buffer, header->producer_stats_index, false);
+        const index_t last_message_state_offset = message_state_offset_of(header, next_producer_position - 1);
+        const _Atomic uint32_t *const last_message_state_atomic_address = (_Atomic uint32_t *) (buffer +
+                                                                                                last_message_state_offset);
+        if (atomic_load_explicit(last_message_state_atomic_address, memory_order_relaxed) != MESSAGE_STATE_FREE) {
+            ring_stats_record_failed_claim(buffer, header->producer_stats_index, false);
+            return false;
+        }
+        atomic_thread_fence(memory_order_acquire);
+        *consumer_cache_position_address = next_producer_position;
+    }
+    atomic_store_explicit(producer_position_address, next_producer_position, memory_order_relaxed);
+    ring_stats_record_claim(buffer, header->producer_stats_index, false, 0, 0);
+    batch->position = producer_position;
+    batch->count = count;
+    return true;
+}
+
+/**
+ * Publishes all the messages of a claimed batch: the consumer reads them in order, as soon as each one is BUSY.
+ */
+static inline void
+fixed_size_ring_buffer_commit_batch_claim(uint8_t *const buffer,
+                                          const struct fixed_size_ring_buffer_header *const header,
+                                          const struct fixed_size_ring_buffer_batch *const batch) {
+    //a single fence orders the contents of all the messages before any of their states
+    atomic_thread_fence(memory_order_release);
+    for (uint32_t i = 0; i < batch->count; i++) {
+        const index_t message_state_offset = message_state_offset_of(header, batch->position + i);
+        atomic_store_explicit((_Atomic uint32_t *) (buffer + message_state_offset), MESSAGE_STATE_BUSY,
+                              memory_order_relaxed);
+    }
+}
+
+static inline void
+fixed_size_ring_buffer_batch_iterator_init(uint8_t *const buffer,
+                                           const struct fixed_size_ring_buffer_header *const header,
+                                           const struct fixed_size_ring_buffer_batch *const batch,
+                                           struct fixed_size_ring_buffer_batch_iterator *const iterator) {
+    const index_t index = batch->position & header->mask;
+    const index_t until_wrap = header->capacity - index;
+    iterator->message = message_content_of(buffer, header, batch->position);
+    iterator->wrapped_message = buffer + header->message_offset;
+    iterator->aligned_message_size = header->aligned_message_size;
+    iterator->until_wrap = until_wrap < (index_t) batch->count ? (uint32_t) until_wrap : batch->count;
+    iterator->remaining = batch->count;
+}
+
+/**
+ * Provides the content of the next message of the batch, in order.
+ */
+static inline bool
+fixed_size_ring_buffer_batch_iterator_next(struct fixed_size_ring_buffer_batch_iterator *const iterator,
+                                           uint8_t **const message) {
+    if (iterator->remaining == 0) {
+        return false;
+    }
+    if (iterator->until_wrap == 0) {
+        iterator->message = iterator->wrapped_message;
+        iterator->until_wrap = iterator->remaining;
+    }
+    *message = iterator->message;
+    iterator->message += iterator->aligned_message_size;
+    iterator->until_wrap--;
+    iterator->remaining--;
+    return true;
+}
+
 static inline bool
 try_fixed_size_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
                                 uint8_t **const read_message_address) {
-    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) header->consumer_position;
-    const index_t mask = header->mask;
-    const index_t aligned_message_size = header->aligned_message_size;
+    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer + header->consumer_position_index);
     const uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
-    const index_t message_state_offset = (consumer_position & mask) * aligned_message_size;
+    const index_t message_state_offset = message_state_offset_of(header, consumer_position);
     uint8_t *const message_state_address = buffer + message_state_offset;
     const _Atomic uint32_t *const message_state_atomic_address = (_Atomic uint32_t *) message_state_address;
     const uint32_t message_state_value = atomic_load_explicit(message_state_atomic_address, memory_order_relaxed);
@@ -134,13 +407,18 @@ try_fixed_size_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_r
         return false;
     }
     atomic_thread_fence(memory_order_acquire);
-    atomic_store_explicit(consumer_position_address, consumer_position + 1, memory_order_relaxed);
-    *read_message_address = message_state_address + MESSAGE_STATE_SIZE;
+    //release: a multi producer claim relies on the consumer position to know that the message has been read
+    atomic_store_explicit(consumer_position_address, consumer_position + 1, memory_order_release);
+    ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index, consumer_position,
+                           1, header->aligned_message_size);
+    *read_message_address = message_content_of(buffer, header, consumer_position);
     return true;
 }
 
-static inline void fixed_size_ring_buffer_commit_read(const uint8_t *const read_message_address) {
-    const _Atomic uint32_t *const message_state = (_Atomic uint32_t *) (read_message_address - MESSAGE_STATE_SIZE);
+static inline void fixed_size_ring_buffer_commit_read(uint8_t *const buffer,
+                                                      const struct fixed_size_ring_buffer_header *const header,
+                                                      const uint8_t *const read_message_address) {
+    _Atomic uint32_t *const message_state = message_state_of(buffer, header, read_message_address);
     atomic_store_explicit(message_state, MESSAGE_STATE_FREE, memory_order_release);
 }
 
@@ -151,31 +429,183 @@ inline static uint32_t fixed_size_ring_buffer_batch_read(
         const fixed_size_message_consumer consumer,
         const uint32_t count, void *const context) {
     uint32_t msg_read = 0;
-    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) header->consumer_position;
-    const index_t mask = header->mask;
+    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer + header->consumer_position_index);
     const index_t aligned_message_size = header->aligned_message_size;
     const uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
     while (msg_read < count) {
         const uint64_t message_position = consumer_position + msg_read;
-        const index_t message_state_offset = (message_position & mask) * aligned_message_size;
+        const index_t message_state_offset = message_state_offset_of(header, message_position);
         uint8_t *const message_state_address = buffer + message_state_offset;
         const _Atomic uint32_t *const message_state_atomic_address = (_Atomic uint32_t *) message_state_address;
         const uint32_t message_state_value = atomic_load_explicit(message_state_atomic_address, memory_order_relaxed);
         if (message_state_value == MESSAGE_STATE_FREE) {
-            return msg_read;
+            break;
         } else {
             atomic_thread_fence(memory_order_acquire);
-            atomic_store_explicit(consumer_position_address, message_position + 1, memory_order_relaxed);
-            uint8_t *message_content_address = message_state_address + MESSAGE_STATE_SIZE;
+            atomic_store_explicit(consumer_position_address, message_position + 1, memory_order_release);
+            uint8_t *message_content_address = message_content_of(buffer, header, message_position);
             const bool stop = !consumer(message_content_address, context);
             atomic_store_explicit((_Atomic uint32_t *) message_state_address, MESSAGE_STATE_FREE, memory_order_release);
             msg_read++;
             if (stop) {
-                return msg_read;
+                break;
             }
         }
     }
-    return count;
+    if (msg_read != 0) {
+        ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index,
+                               consumer_position, msg_read, (uint64_t) msg_read * aligned_message_size);
+    }
+    return msg_read;
+}
+
+/**
+ * Counts the consecutive BUSY slots from position, up to max_run, one state at time.
+ */
+inline static uint32_t scalar_busy_run(const uint8_t *const buffer, const index_t mask, const index_t state_stride,
+                                       const uint64_t position, const uint32_t max_run) {
+    uint32_t run = 0;
+    while (run < max_run) {
+        const index_t message_state_offset = ((position + run) & mask) * state_stride;
+        const _Atomic uint32_t *const message_state_atomic_address = (_Atomic uint32_t *) (buffer +
+                                                                                           message_state_offset);
+        if (atomic_load_explicit(message_state_atomic_address, memory_order_relaxed) == MESSAGE_STATE_FREE) {
+            break;
+        }
+        run++;
+    }
+    return run;
+}
+
+#ifdef FIXED_SIZE_RING_BUFFER_AVX2_SCAN
+
+/**
+ * Same as scalar_busy_run, but loads 8 states at time while they don't wrap: each state is loaded by a 4 bytes
+ * aligned (hence single-copy atomic) access, not all the 8 together.
+ * The states are gathered if strided, by state_stride that must fit 8 times an int32_t, or loaded at once if packed.
+ */
+__attribute__((target("avx2")))
+inline static uint32_t avx2_busy_run(const uint8_t *const buffer, const index_t mask, const index_t capacity,
+                                     const index_t state_stride, const uint64_t position,
+                                     const uint32_t max_run) {
+    const int32_t stride = (int32_t) state_stride;
+    const bool packed_states = state_stride == MESSAGE_STATE_SIZE;
+    const __m256i offsets = _mm256_setr_epi32(0, stride, stride * 2, stride * 3, stride * 4, stride * 5, stride * 6,
+                                              stride * 7);
+    const __m256i free_states = _mm256_set1_epi32(MESSAGE_STATE_FREE);
+    uint32_t run = 0;
+    while (run < max_run) {
+        const index_t index = (position + run) & mask;
+        if (run + 8 <= max_run && index + 8 <= capacity) {
+            const uint8_t *const first_state_address = buffer + (index * state_stride);
+            const __m256i states = packed_states ? _mm256_loadu_si256((const __m256i *) first_state_address) :
+                                   _mm256_i32gather_epi32((const int *) first_state_address, offsets, 1);
+            const uint32_t free_slots = (uint32_t) _mm256_movemask_ps(
+                    _mm256_castsi256_ps(_mm256_cmpeq_epi32(states, free_states)));
+            if (free_slots != 0) {
+                return run + __builtin_ctz(free_slots);
+            }
+            run += 8;
+        } else {
+            const _Atomic uint32_t *const message_state_atomic_address = (_Atomic uint32_t *) (buffer +
+                                                                                               (index * state_stride));
+            if (atomic_load_explicit(message_state_atomic_address, memory_order_relaxed) == MESSAGE_STATE_FREE) {
+                return run;
+            }
+            run++;
+        }
+    }
+    return run;
+}
+
+#endif
+
+/**
+ * Counts the consecutive BUSY slots from position, up to max_run, with AVX2 if the cpu supports it.
+ * It doesn't order the loads of the messages after the states: see fixed_size_ring_buffer_scan_batch_read.
+ */
+inline static uint32_t fixed_size_ring_buffer_busy_run(const uint8_t *const buffer,
+                                                       const struct fixed_size_ring_buffer_header *const header,
+                                                       const uint64_t position, const uint32_t max_run) {
+#ifdef FIXED_SIZE_RING_BUFFER_AVX2_SCAN
+    if (max_run >= 8 && header->state_stride <= INT32_MAX / 8 && __builtin_cpu_supports("avx2")) {
+        return avx2_busy_run(buffer, header->mask, header->capacity, header->state_stride, position, max_run);
+    }
+#endif
+    return scalar_busy_run(buffer, header->mask, header->state_stride, position, max_run);
+}
+
+/**
+ * Finds the run of up to max_count messages ready to be read: they stay in the ring until committed.
+ */
+static inline bool
+try_fixed_size_ring_buffer_batch_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                      const uint32_t max_count, struct fixed_size_ring_buffer_batch *const batch) {
+    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer + header->consumer_position_index);
+    const uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
+    //on a full ring the slot after the last one is the first one again
+    const uint32_t max_run = (index_t) max_count > header->capacity ? (uint32_t) header->capacity : max_count;
+    const uint32_t run = fixed_size_ring_buffer_busy_run(buffer, header, consumer_position, max_run);
+    if (run == 0) {
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    batch->position = consumer_position;
+    batch->count = run;
+    return true;
+}
+
+/**
+ * Frees the slots of the first read messages of a batch and publishes the consumer position once: the other
+ * messages will be read again.
+ */
+static inline void
+fixed_size_ring_buffer_commit_batch_read(uint8_t *const buffer,
+                                         const struct fixed_size_ring_buffer_header *const header,
+                                         const struct fixed_size_ring_buffer_batch *const batch,
+                                         const uint32_t read) {
+    if (read == 0) {
+        return;
+    }
+    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer + header->consumer_position_index);
+    //release: a producer finding a slot FREE relies on the slots before it to be FREE too
+    for (uint32_t i = 0; i < read; i++) {
+        const index_t message_state_offset = message_state_offset_of(header, batch->position + i);
+        atomic_store_explicit((_Atomic uint32_t *) (buffer + message_state_offset), MESSAGE_STATE_FREE,
+                              memory_order_release);
+    }
+    //release: a multi producer claim relies on the consumer position to know that the messages have been read
+    atomic_store_explicit(consumer_position_address, batch->position + read, memory_order_release);
+    ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index, batch->position,
+                           read, (uint64_t) read * header->aligned_message_size);
+}
+
+/**
+ * Same as fixed_size_ring_buffer_batch_read, but finds first how many messages can be read, scanning the states,
+ * then consumes all of them, frees their slots and publishes the consumer position once: the producers see the
+ * slots freed at the end of the batch instead of one by one.
+ */
+inline static uint32_t fixed_size_ring_buffer_scan_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context) {
+    struct fixed_size_ring_buffer_batch batch;
+    if (!try_fixed_size_ring_buffer_batch_read(buffer, header, count, &batch)) {
+        return 0;
+    }
+    struct fixed_size_ring_buffer_batch_iterator iterator;
+    fixed_size_ring_buffer_batch_iterator_init(buffer, header, &batch, &iterator);
+    uint32_t msg_read = 0;
+    uint8_t *message_content_address;
+    while (fixed_size_ring_buffer_batch_iterator_next(&iterator, &message_content_address)) {
+        msg_read++;
+        if (!consumer(message_content_address, context)) {
+            break;
+        }
+    }
+    fixed_size_ring_buffer_commit_batch_read(buffer, header, &batch, msg_read);
+    return msg_read;
 }
 
 inline static uint32_t fixed_size_ring_buffer_stream_batch_read(
@@ -189,7 +619,7 @@ inline static uint32_t fixed_size_ring_buffer_stream_batch_read(
             return i;
         } else {
             const bool stop = !consumer(read_message_address, context);
-            fixed_size_ring_buffer_commit_read(read_message_address);
+            fixed_size_ring_buffer_commit_read(buffer, header, read_message_address);
             if (stop) {
                 return i + 1;
             }
@@ -198,14 +628,130 @@ inline static uint32_t fixed_size_ring_buffer_stream_batch_read(
     return count;
 }
 
-static inline index_t fixed_size_ring_buffer_size(const struct fixed_size_ring_buffer_header *const header) {
-    const _Atomic uint64_t *consumer_position_address = (_Atomic uint64_t *) header->consumer_position;
-    const _Atomic uint64_t *producer_position_address = (_Atomic uint64_t *) header->producer_position;
+static inline void
+fixed_size_ring_buffer_lookahead_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                       const uint32_t max_look_ahead_step, struct idle_strategy *const idle_strategy,
+                                       uint8_t **const claimed_message, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    while (!try_fixed_size_ring_buffer_lookahead_claim(buffer, header, max_look_ahead_step, claimed_message)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+}
+
+static inline void
+fixed_size_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                             struct idle_strategy *const idle_strategy,
+                             uint8_t **const claimed_message, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    while (!try_fixed_size_ring_buffer_claim(buffer, header, claimed_message)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+}
+
+static inline void
+fixed_size_ring_buffer_mp_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                struct idle_strategy *const idle_strategy,
+                                uint8_t **const claimed_message, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    while (!try_fixed_size_ring_buffer_mp_claim(buffer, header, claimed_message)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+}
+
+static inline void fixed_size_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                               struct idle_strategy *const idle_strategy,
+                                               uint8_t **const read_message_address, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    while (!try_fixed_size_ring_buffer_read(buffer, header, read_message_address)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+}
+
+inline static uint32_t fixed_size_ring_buffer_blocking_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context,
+        struct idle_strategy *const idle_strategy, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    uint32_t msg_read;
+    while ((msg_read = fixed_size_ring_buffer_batch_read(buffer, header, consumer, count, context)) == 0) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return msg_read;
+}
+
+inline static uint32_t fixed_size_ring_buffer_blocking_scan_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context,
+        struct idle_strategy *const idle_strategy, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    uint32_t msg_read;
+    while ((msg_read = fixed_size_ring_buffer_scan_batch_read(buffer, header, consumer, count, context)) == 0) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return msg_read;
+}
+
+inline static uint32_t fixed_size_ring_buffer_blocking_stream_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context,
+        struct idle_strategy *const idle_strategy, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    uint32_t msg_read;
+    while ((msg_read = fixed_size_ring_buffer_stream_batch_read(buffer, header, consumer, count, context)) == 0) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return msg_read;
+}
+
+static inline index_t fixed_size_ring_buffer_size(const uint8_t *const buffer,
+                                                  const struct fixed_size_ring_buffer_header *const header) {
+    const _Atomic uint64_t *consumer_position_address = (_Atomic uint64_t *) (buffer + header->consumer_position_index);
+    const _Atomic uint64_t *producer_position_address = (_Atomic uint64_t *) (buffer + header->producer_position_index);
     const uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);
     const uint64_t producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);
     const index_t size = (index_t) (producer_position - consumer_position);
     return size;
 }
 
-
-
+#endif //FRANZ_FLOW_FIXED_SIZE_RING_BUFFER_C
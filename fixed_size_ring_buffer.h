@@ -8,23 +8,79 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include "index.h"
+#include "idle_strategy.h"
+
+/**
+ * How the state and the content of the messages are laid out:
+ * - PACKED: each slot is a 4 bytes state followed by the content, with the slots one after the other: the cheapest on
+ * memory and the best on throughput, but the producer and the consumer share the cache lines of the states and of the
+ * contents of nearby slots
+ * - SEPARATED: an array of the states, packed, followed by an array of the contents: the states can be scanned 16 per
+ * cache line, but each message touches 2 cache lines
+ * - CACHE_LINE: as PACKED, but each slot starts on its own cache line: no false sharing between nearby slots, at the
+ * cost of the padding, for the best latency
+ * The content of each message is aligned to the payload alignment, ie 4 (as the states), 8, 16, 32 or 64 bytes,
+ * relative to the start of the buffer: the buffer must be aligned at least as much.
+ */
+enum fixed_size_slot_layout {
+    FIXED_SIZE_SLOT_LAYOUT_PACKED,
+    FIXED_SIZE_SLOT_LAYOUT_SEPARATED,
+    FIXED_SIZE_SLOT_LAYOUT_CACHE_LINE
+};
 
 struct fixed_size_ring_buffer_header {
-    uint8_t *producer_position;
-    uint8_t *consumer_cache_position;
-    uint8_t *consumer_position;
+    index_t producer_position_index;
+    index_t consumer_cache_position_index;
+    index_t consumer_position_index;
+    index_t producer_stats_index;
+    index_t consumer_stats_index;
     index_t mask;
     index_t capacity;
+    //of the content of the first message
+    index_t message_offset;
+    //the distance between the contents of 2 consecutive messages
     uint32_t aligned_message_size;
+    //the distance between the states of 2 consecutive messages
+    uint32_t state_stride;
+    enum fixed_size_slot_layout slot_layout;
+};
+
+/**
+ * A run of consecutive slots, claimed or read together: it continues from the start of the buffer if it reaches
+ * its end.
+ */
+struct fixed_size_ring_buffer_batch {
+    uint64_t position;
+    uint32_t count;
+};
+
+struct fixed_size_ring_buffer_batch_iterator {
+    uint8_t *message;
+    //where the batch continues after the end of the buffer
+    uint8_t *wrapped_message;
+    index_t aligned_message_size;
+    uint32_t until_wrap;
+    uint32_t remaining;
 };
 
 static inline index_t fixed_size_ring_buffer_capacity(const index_t requested_capacity, const uint32_t message_size);
 
+static inline index_t
+fixed_size_ring_buffer_layout_capacity(const index_t requested_capacity, const uint32_t message_size,
+                                       const enum fixed_size_slot_layout slot_layout,
+                                       const uint32_t payload_alignment);
+
 static inline bool
 init_fixed_size_ring_buffer_header(uint8_t *const buffer, struct fixed_size_ring_buffer_header *const header,
                                    const index_t requested_capacity,
                                    const uint32_t message_size);
 
+static inline bool
+init_fixed_size_ring_buffer_layout_header(uint8_t *const buffer, struct fixed_size_ring_buffer_header *const header,
+                                          const index_t requested_capacity, const uint32_t message_size,
+                                          const enum fixed_size_slot_layout slot_layout,
+                                          const uint32_t payload_alignment);
+
 static inline bool
 try_fixed_size_ring_buffer_lookahead_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
                                            const uint32_t max_look_ahead_step,
@@ -34,12 +90,49 @@ static inline bool
 try_fixed_size_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
                                  uint8_t **const claimed_message);
 
-static inline void fixed_size_ring_buffer_commit_claim(const uint8_t *const claimed_message_address);
+static inline bool
+try_fixed_size_ring_buffer_mp_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                    uint8_t **const claimed_message);
+
+static inline void fixed_size_ring_buffer_commit_claim(uint8_t *const buffer,
+                                                       const struct fixed_size_ring_buffer_header *const header,
+                                                       const uint8_t *const claimed_message_address);
+
+static inline bool
+try_fixed_size_ring_buffer_batch_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                       const uint32_t count, struct fixed_size_ring_buffer_batch *const batch);
+
+static inline void
+fixed_size_ring_buffer_commit_batch_claim(uint8_t *const buffer,
+                                          const struct fixed_size_ring_buffer_header *const header,
+                                          const struct fixed_size_ring_buffer_batch *const batch);
+
+static inline bool
+try_fixed_size_ring_buffer_batch_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                      const uint32_t max_count, struct fixed_size_ring_buffer_batch *const batch);
+
+static inline void
+fixed_size_ring_buffer_commit_batch_read(uint8_t *const buffer,
+                                         const struct fixed_size_ring_buffer_header *const header,
+                                         const struct fixed_size_ring_buffer_batch *const batch,
+                                         const uint32_t read);
+
+static inline void
+fixed_size_ring_buffer_batch_iterator_init(uint8_t *const buffer,
+                                           const struct fixed_size_ring_buffer_header *const header,
+                                           const struct fixed_size_ring_buffer_batch *const batch,
+                                           struct fixed_size_ring_buffer_batch_iterator *const iterator);
+
+static inline bool
+fixed_size_ring_buffer_batch_iterator_next(struct fixed_size_ring_buffer_batch_iterator *const iterator,
+                                           uint8_t **const message);
 
 static inline bool try_fixed_size_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
                                                    uint8_t **const read_message_address);
 
-static inline void fixed_size_ring_buffer_commit_read(const uint8_t *const read_message_address);
+static inline void fixed_size_ring_buffer_commit_read(uint8_t *const buffer,
+                                                      const struct fixed_size_ring_buffer_header *const header,
+                                                      const uint8_t *const read_message_address);
 
 typedef bool(*const fixed_size_message_consumer)(uint8_t *const, void *const);
 
@@ -49,12 +142,59 @@ inline static uint32_t fixed_size_ring_buffer_batch_read(
         const fixed_size_message_consumer consumer,
         const uint32_t count, void *const context);
 
+inline static uint32_t fixed_size_ring_buffer_scan_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context);
+
 inline static uint32_t fixed_size_ring_buffer_stream_batch_read(
         uint8_t *const buffer,
         const struct fixed_size_ring_buffer_header *const header,
         const fixed_size_message_consumer consumer,
         const uint32_t count, void *const context);
 
-static inline index_t fixed_size_ring_buffer_size(const struct fixed_size_ring_buffer_header *const header);
+static inline void
+fixed_size_ring_buffer_lookahead_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                       const uint32_t max_look_ahead_step, struct idle_strategy *const idle_strategy,
+                                       uint8_t **const claimed_message, uint64_t *const idles);
+
+static inline void
+fixed_size_ring_buffer_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                             struct idle_strategy *const idle_strategy,
+                             uint8_t **const claimed_message, uint64_t *const idles);
+
+static inline void
+fixed_size_ring_buffer_mp_claim(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                struct idle_strategy *const idle_strategy,
+                                uint8_t **const claimed_message, uint64_t *const idles);
+
+static inline void fixed_size_ring_buffer_read(uint8_t *const buffer, const struct fixed_size_ring_buffer_header *const header,
+                                               struct idle_strategy *const idle_strategy,
+                                               uint8_t **const read_message_address, uint64_t *const idles);
+
+inline static uint32_t fixed_size_ring_buffer_blocking_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context,
+        struct idle_strategy *const idle_strategy, uint64_t *const idles);
+
+inline static uint32_t fixed_size_ring_buffer_blocking_scan_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context,
+        struct idle_strategy *const idle_strategy, uint64_t *const idles);
+
+inline static uint32_t fixed_size_ring_buffer_blocking_stream_batch_read(
+        uint8_t *const buffer,
+        const struct fixed_size_ring_buffer_header *const header,
+        const fixed_size_message_consumer consumer,
+        const uint32_t count, void *const context,
+        struct idle_strategy *const idle_strategy, uint64_t *const idles);
+
+static inline index_t fixed_size_ring_buffer_size(const uint8_t *const buffer,
+                                                  const struct fixed_size_ring_buffer_header *const header);
 
 #endif //FRANZ_FLOW_FIXED_SIZE_RING_BUFFER_H
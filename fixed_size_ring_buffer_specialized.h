@@ -0,0 +1,101 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_FIXED_SIZE_RING_BUFFER_SPECIALIZED_H
+#define FRANZ_FLOW_FIXED_SIZE_RING_BUFFER_SPECIALIZED_H
+
+#include <stdatomic.h>
+#include "fixed_size_ring_buffer.c"
+
+/**
+ * Defines a single producer single consumer fixed size ring whose message size, capacity and consumer are compile
+ * time constants: the slot offsets are computed by shifts (or a constant multiply), the trailer indexes are constants
+ * and the consumer, a fixed_size_message_consumer function, is inlined into the batch read loop.
+ * It has the same layout of the PACKED 4 bytes aligned generic ring, hence its buffer is sized by
+ * fixed_size_ring_buffer_capacity and initialized by init_fixed_size_ring_buffer_header as any other, and it can be
+ * mixed with the generic calls: ie a specialized consumer of a generic producer.
+ * The generated functions are try_<name>_claim, <name>_claim, <name>_commit_claim and <name>_batch_read.
+ */
+#define DEFINE_FIXED_SIZE_RING_BUFFER(name, message_size, capacity, consumer)                                          \
+_Static_assert((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0, #name " capacity must be a power of 2");        \
+                                                                                                                       \
+inline static index_t name##_aligned_message_size(void) {                                                              \
+    return (((index_t) (message_size)) + MESSAGE_STATE_SIZE + (MESSAGE_STATE_SIZE - 1)) &                              \
+           ~((index_t) MESSAGE_STATE_SIZE - 1);                                                                        \
+}                                                                                                                      \
+                                                                                                                       \
+inline static index_t name##_slot_offset(const uint64_t position) {                                                    \
+    return (index_t) (position & ((capacity) - 1)) * name##_aligned_message_size();                                    \
+}                                                                                                                      \
+                                                                                                                       \
+inline static index_t name##_trailer_index(const index_t offset) {                                                     \
+    return ((index_t) (capacity) * name##_aligned_message_size()) + offset;                                            \
+}                                                                                                                      \
+                                                                                                                       \
+inline static bool try_##name##_claim(uint8_t *const buffer, uint8_t **const claimed_message) {                        \
+    const _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) (buffer +                           \
+                                                              name##_trailer_index(PRODUCER_POSITION_OFFSET));         \
+    const uint64_t producer_position = atomic_load_explicit(producer_position_address, memory_order_relaxed);          \
+    uint8_t *const message_state_address = buffer + name##_slot_offset(producer_position);                             \
+    if (atomic_load_explicit((_Atomic uint32_t *) message_state_address, memory_order_relaxed) !=                      \
+        MESSAGE_STATE_FREE) {                                                                                          \
+        ring_stats_record_full_event(buffer, name##_trailer_index(PRODUCER_STATS_OFFSET), false);                      \
+        ring_stats_record_failed_claim(buffer, name##_trailer_index(PRODUCER_STATS_OFFSET), false);                    \
+        return false;                                                                                                  \
+    }                                                                                                                  \
+    atomic_thread_fence(memory_order_acquire);                                                                         \
+    atomic_store_explicit(producer_position_address, producer_position + 1, memory_order_relaxed);                     \
+    ring_stats_record_claim(buffer, name##_trailer_index(PRODUCER_STATS_OFFSET), false, 0, 0);                         \
+    *claimed_message = message_state_address + MESSAGE_STATE_SIZE;                                                     \
+    return true;                                                                                                       \
+}                                                                                                                      \
+                                                                                                                       \
+inline static void name##_claim(uint8_t *const buffer, struct idle_strategy *const idle_strategy,                      \
+                                uint8_t **const claimed_message, uint64_t *const idles) {                              \
+    uint64_t idle_count = 0;                                                                                           \
+    while (!try_##name##_claim(buffer, claimed_message)) {                                                             \
+        idle_strategy_idle(idle_strategy);                                                                             \
+        idle_count++;                                                                                                  \
+    }                                                                                                                  \
+    if (idle_count != 0) {                                                                                             \
+        idle_strategy_reset(idle_strategy);                                                                            \
+    }                                                                                                                  \
+    *idles = idle_count;                                                                                               \
+}                                                                                                                      \
+                                                                                                                       \
+inline static void name##_commit_claim(const uint8_t *const claimed_message) {                                         \
+    _Atomic uint32_t *const message_state = (_Atomic uint32_t *) (claimed_message - MESSAGE_STATE_SIZE);               \
+    atomic_store_explicit(message_state, MESSAGE_STATE_BUSY, memory_order_release);                                    \
+}                                                                                                                      \
+                                                                                                                       \
+inline static uint32_t name##_batch_read(uint8_t *const buffer, const uint32_t count, void *const context) {           \
+    const _Atomic uint64_t *const consumer_position_address = (_Atomic uint64_t *) (buffer +                           \
+                                                              name##_trailer_index(CONSUMER_POSITION_OFFSET));         \
+    const uint64_t consumer_position = atomic_load_explicit(consumer_position_address, memory_order_relaxed);          \
+    uint32_t msg_read = 0;                                                                                             \
+    while (msg_read < count) {                                                                                         \
+        const uint64_t message_position = consumer_position + msg_read;                                                \
+        uint8_t *const message_state_address = buffer + name##_slot_offset(message_position);                          \
+        _Atomic uint32_t *const message_state = (_Atomic uint32_t *) message_state_address;                            \
+        if (atomic_load_explicit(message_state, memory_order_relaxed) == MESSAGE_STATE_FREE) {                         \
+            break;                                                                                                     \
+        }                                                                                                              \
+        atomic_thread_fence(memory_order_acquire);                                                                     \
+        atomic_store_explicit(consumer_position_address, message_position + 1, memory_order_release);                  \
+        const bool stop = !consumer(message_state_address + MESSAGE_STATE_SIZE, context);                              \
+        atomic_store_explicit(message_state, MESSAGE_STATE_FREE, memory_order_release);                                \
+        msg_read++;                                                                                                    \
+        if (stop) {                                                                                                    \
+            break;                                                                                                     \
+        }                                                                                                              \
+    }                                                                                                                  \
+    if (msg_read != 0) {                                                                                               \
+        ring_stats_record_read(buffer, name##_trailer_index(CONSUMER_STATS_OFFSET),                                    \
+                               name##_trailer_index(PRODUCER_POSITION_OFFSET), consumer_position, msg_read,            \
+                               (uint64_t) msg_read * name##_aligned_message_size());                                   \
+    }                                                                                                                  \
+    return msg_read;                                                                                                   \
+}
+
+#endif //FRANZ_FLOW_FIXED_SIZE_RING_BUFFER_SPECIALIZED_H
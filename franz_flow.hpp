@@ -0,0 +1,488 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_HPP
+#define FRANZ_FLOW_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+//before the C11 atomics are mapped: from C++23 it defines its own _Atomic(T) and the atomic functions
+#include <stdatomic.h>
+
+/**
+ * Header-only C++20 front-end of ring_buffer.h and fixed_size_ring_buffer.h.
+ * The C headers are included as they are, with the C11 atomics they use mapped on the GCC __atomic builtins, that
+ * are the same instructions on the same layout: the C++ calls inline the very same hot paths of the C ones, and a
+ * ring can be shared with C producers or consumers.
+ * The consumers are any callable, invoked through a trampoline that the compiler inlines with the C read loop:
+ * there is no function pointer nor context cast left in the generated code.
+ */
+
+namespace franz_flow::detail {
+
+//the C code updates atomics through pointers to const, that C accepts and C++ doesn't
+template<typename T>
+inline T *c_atomic_address(const T *const address) {
+    return const_cast<T *>(address);
+}
+
+}
+
+//the mapping is undone after the C headers: any macro of the includer (or of <stdatomic.h>) with the same name
+//is restored as it was
+#pragma push_macro("_Atomic")
+#pragma push_macro("memory_order_relaxed")
+#pragma push_macro("memory_order_acquire")
+#pragma push_macro("memory_order_release")
+#pragma push_macro("memory_order_acq_rel")
+#pragma push_macro("memory_order_seq_cst")
+#pragma push_macro("atomic_load_explicit")
+#pragma push_macro("atomic_store_explicit")
+#pragma push_macro("atomic_fetch_add_explicit")
+#pragma push_macro("atomic_compare_exchange_strong_explicit")
+#pragma push_macro("atomic_compare_exchange_weak_explicit")
+#pragma push_macro("atomic_thread_fence")
+#undef _Atomic
+#define _Atomic
+#undef memory_order_relaxed
+#define memory_order_relaxed __ATOMIC_RELAXED
+#undef memory_order_acquire
+#define memory_order_acquire __ATOMIC_ACQUIRE
+#undef memory_order_release
+#define memory_order_release __ATOMIC_RELEASE
+#undef memory_order_acq_rel
+#define memory_order_acq_rel __ATOMIC_ACQ_REL
+#undef memory_order_seq_cst
+#define memory_order_seq_cst __ATOMIC_SEQ_CST
+#undef atomic_load_explicit
+#define atomic_load_explicit(address, order) __atomic_load_n(address, order)
+#undef atomic_store_explicit
+#define atomic_store_explicit(address, value, order)                                                                   \
+    __atomic_store_n(::franz_flow::detail::c_atomic_address(address), value, order)
+#undef atomic_fetch_add_explicit
+#define atomic_fetch_add_explicit(address, value, order)                                                               \
+    __atomic_fetch_add(::franz_flow::detail::c_atomic_address(address), value, order)
+#undef atomic_compare_exchange_strong_explicit
+#define atomic_compare_exchange_strong_explicit(address, expected, desired, success, failure)                          \
+    __atomic_compare_exchange_n(::franz_flow::detail::c_atomic_address(address),                                      \
+                                ::franz_flow::detail::c_atomic_address(expected), desired, false, success, failure)
+#undef atomic_compare_exchange_weak_explicit
+#define atomic_compare_exchange_weak_explicit(address, expected, desired, success, failure)                            \
+    __atomic_compare_exchange_n(::franz_flow::detail::c_atomic_address(address),                                      \
+                                ::franz_flow::detail::c_atomic_address(expected), desired, true, success, failure)
+#undef atomic_thread_fence
+#define atomic_thread_fence(order) __atomic_thread_fence(order)
+
+#pragma GCC diagnostic push
+//C code: it compares the unsigned msg type ids with the signed padding one and initializes the structs narrowing
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#pragma GCC diagnostic ignored "-Wnarrowing"
+
+#include "ring_buffer.h"
+#include "fixed_size_ring_buffer.h"
+#include "fixed_size_ring_buffer.c"
+
+#pragma GCC diagnostic pop
+
+#pragma pop_macro("_Atomic")
+#pragma pop_macro("memory_order_relaxed")
+#pragma pop_macro("memory_order_acquire")
+#pragma pop_macro("memory_order_release")
+#pragma pop_macro("memory_order_acq_rel")
+#pragma pop_macro("memory_order_seq_cst")
+#pragma pop_macro("atomic_load_explicit")
+#pragma pop_macro("atomic_store_explicit")
+#pragma pop_macro("atomic_fetch_add_explicit")
+#pragma pop_macro("atomic_compare_exchange_strong_explicit")
+#pragma pop_macro("atomic_compare_exchange_weak_explicit")
+#pragma pop_macro("atomic_thread_fence")
+
+namespace franz_flow {
+
+namespace detail {
+
+struct free_deleter {
+    void operator()(uint8_t *const buffer) const {
+        std::free(buffer);
+    }
+};
+
+using owned_buffer = std::unique_ptr<uint8_t[], free_deleter>;
+
+/**
+ * A zeroed buffer aligned to a cache line, as a new ring needs: empty if length is 0 or it can't be allocated.
+ */
+inline owned_buffer allocate_zeroed(const index_t length) {
+    if (length <= 0) {
+        return owned_buffer();
+    }
+    const size_t aligned_length = align(length, CACHE_LINE_LENGTH);
+    auto *const buffer = static_cast<uint8_t *>(std::aligned_alloc(CACHE_LINE_LENGTH, aligned_length));
+    if (buffer != nullptr) {
+        std::memset(buffer, 0, aligned_length);
+    }
+    return owned_buffer(buffer);
+}
+
+//a consumer can return void to never stop the batch
+template<typename Consumer, typename... Args>
+inline bool consume(Consumer &consumer, Args &&... args) {
+    if constexpr (std::is_void_v<std::invoke_result_t<Consumer &, Args...>>) {
+        consumer(std::forward<Args>(args)...);
+        return true;
+    } else {
+        return consumer(std::forward<Args>(args)...);
+    }
+}
+
+template<typename Consumer>
+inline bool message_trampoline(const uint32_t msg_type_id, const uint8_t *const buffer,
+                               const index_t msg_content_index, const index_t msg_content_length,
+                               void *const context) {
+    const std::span<const uint8_t> payload(buffer + msg_content_index, static_cast<size_t>(msg_content_length));
+    return consume(*static_cast<Consumer *>(context), msg_type_id, payload);
+}
+
+template<typename Consumer>
+inline controlled_read_action controlled_trampoline(const uint32_t msg_type_id, const uint8_t *const buffer,
+                                                    const index_t msg_content_index, const index_t msg_content_length,
+                                                    void *const context) {
+    const std::span<const uint8_t> payload(buffer + msg_content_index, static_cast<size_t>(msg_content_length));
+    return (*static_cast<Consumer *>(context))(msg_type_id, payload);
+}
+
+template<typename T>
+inline T *message_at(uint8_t *const content) {
+    return std::launder(reinterpret_cast<T *>(content));
+}
+
+template<typename T, typename Consumer>
+inline bool fixed_size_trampoline(uint8_t *const content, void *const context) {
+    return consume(*static_cast<Consumer *>(context), *message_at<T>(content));
+}
+
+}
+
+/**
+ * A ring of variable length records, owning its buffer or wrapping an external one (ie shared memory): it can be
+ * moved, but not while there are pending claims or reads.
+ * The claims are single producer (try_claim) or multi producer (try_mp_claim), the consumer is single.
+ */
+class ring_buffer {
+public:
+    /**
+     * A claimed record: the payload is committed when the claim goes out of scope, if not committed before.
+     */
+    class claim {
+    public:
+        claim(const claim &) = delete;
+
+        claim &operator=(const claim &) = delete;
+
+        claim(claim &&other) noexcept: buffer_(other.buffer_), index_(other.index_), msg_type_id_(other.msg_type_id_),
+                                       length_(other.length_) {
+            other.buffer_ = nullptr;
+        }
+
+        claim &operator=(claim &&) = delete;
+
+        ~claim() {
+            commit();
+        }
+
+        std::span<uint8_t> payload() const {
+            return {buffer_ + encoded_msg_offset(index_), static_cast<size_t>(length_)};
+        }
+
+        void commit() {
+            if (buffer_ != nullptr) {
+                ring_buffer_commit(buffer_, index_, msg_type_id_, length_);
+                buffer_ = nullptr;
+            }
+        }
+
+    private:
+        friend class ring_buffer;
+
+        claim(uint8_t *const buffer, const index_t index, const uint32_t msg_type_id, const index_t length) :
+                buffer_(buffer), index_(index), msg_type_id_(msg_type_id), length_(length) {
+        }
+
+        //null once committed
+        uint8_t *buffer_;
+        index_t index_;
+        uint32_t msg_type_id_;
+        index_t length_;
+    };
+
+    /**
+     * A ring of at least requested_capacity bytes, rounded up to a power of 2: empty if it can't be allocated.
+     */
+    static std::optional<ring_buffer> allocate(const index_t requested_capacity) {
+        const index_t length = ring_buffer_capacity(requested_capacity);
+        detail::owned_buffer owned = detail::allocate_zeroed(length);
+        if (!owned) {
+            return std::nullopt;
+        }
+        std::optional<ring_buffer> ring = wrap(std::span<uint8_t>(owned.get(), static_cast<size_t>(length)));
+        if (ring) {
+            ring->owned_ = std::move(owned);
+        }
+        return ring;
+    }
+
+    /**
+     * Wraps a zeroed buffer or one already used as a ring of the same length, not owning it: empty if its length
+     * isn't a power of 2 plus RING_BUFFER_TRAILER_LENGTH.
+     */
+    static std::optional<ring_buffer> wrap(const std::span<uint8_t> memory) {
+        ring_buffer ring;
+        if (memory.size() > static_cast<size_t>(INDEX_MAX) ||
+            !init_ring_buffer_header(&ring.header_, static_cast<index_t>(memory.size()))) {
+            return std::nullopt;
+        }
+        ring.buffer_ = memory.data();
+        return ring;
+    }
+
+    /**
+     * Single producer claim of a record of length bytes: empty if the ring is full or length is too big.
+     */
+    std::optional<claim> try_claim(const uint32_t msg_type_id, const index_t length) {
+        uint64_t claimed_position;
+        index_t claimed_index;
+        if (!try_ring_buffer_sp_claim(&header_, buffer_, length, &claimed_position, &claimed_index)) {
+            return std::nullopt;
+        }
+        return claim(buffer_, claimed_index, msg_type_id, length);
+    }
+
+    /**
+     * Same as try_claim, but for many concurrent producers.
+     */
+    std::optional<claim> try_mp_claim(const uint32_t msg_type_id, const index_t length) {
+        uint64_t claimed_position;
+        index_t claimed_index;
+        if (!try_ring_buffer_mp_claim(&header_, buffer_, length, &claimed_position, &claimed_index)) {
+            return std::nullopt;
+        }
+        return claim(buffer_, claimed_index, msg_type_id, length);
+    }
+
+    /**
+     * Reads up to count records, calling consumer(uint32_t msg_type_id, std::span<const uint8_t> payload) on each:
+     * the batch stops after a consumer returning false. Returns the read records.
+     */
+    template<typename Consumer>
+    uint32_t batch_read(Consumer &&consumer, const uint32_t count) {
+        using consumer_type = std::remove_reference_t<Consumer>;
+        return ring_buffer_batch_read(&header_, buffer_, &detail::message_trampoline<consumer_type>, count,
+                                      const_cast<std::remove_const_t<consumer_type> *>(&consumer));
+    }
+
+    /**
+     * Same as batch_read, but consumer returns the controlled_read_action to apply to each record: read is set to
+     * the consumed records.
+     */
+    template<typename Consumer>
+    controlled_read_status controlled_read(Consumer &&consumer, const uint32_t count, uint32_t &read) {
+        using consumer_type = std::remove_reference_t<Consumer>;
+        return ring_buffer_controlled_read(&header_, buffer_, &detail::controlled_trampoline<consumer_type>, count,
+                                           const_cast<std::remove_const_t<consumer_type> *>(&consumer), &read);
+    }
+
+    /**
+     * Turns a claim never committed, that the consumer is stuck on, into padding: see ring_buffer_unblock.
+     */
+    bool unblock() {
+        return ring_buffer_unblock(&header_, buffer_);
+    }
+
+    index_t capacity() const {
+        return header_.capacity;
+    }
+
+    index_t max_msg_length() const {
+        return header_.max_msg_length;
+    }
+
+    index_t size() const {
+        return ring_buffer_size(&header_, buffer_);
+    }
+
+    const ring_buffer_header &header() const {
+        return header_;
+    }
+
+    uint8_t *buffer() const {
+        return buffer_;
+    }
+
+private:
+    ring_buffer() : header_(), buffer_(nullptr) {
+    }
+
+    ring_buffer_header header_;
+    uint8_t *buffer_;
+    //empty if the buffer is external
+    detail::owned_buffer owned_;
+};
+
+/**
+ * A single producer single consumer ring of T messages, owning its buffer or wrapping an external one: it can be
+ * moved, but not while there are pending claims or reads.
+ * The contents are aligned to T, hence the consumers get a T reference, with the slots laid out by Layout.
+ */
+template<typename T, fixed_size_slot_layout Layout = FIXED_SIZE_SLOT_LAYOUT_PACKED>
+class fixed_size_ring {
+    static_assert(std::is_trivially_copyable_v<T>, "the messages are copied by bytes across processes");
+    static_assert(alignof(T) <= MAX_PAYLOAD_ALIGNMENT, "the messages can be at most cache line aligned");
+
+public:
+    static constexpr uint32_t payload_alignment = alignof(T) < MESSAGE_STATE_SIZE ? MESSAGE_STATE_SIZE : alignof(T);
+
+    /**
+     * A claimed message, default initialized: it is committed when the claim goes out of scope, if not committed
+     * before.
+     */
+    class claim {
+    public:
+        claim(const claim &) = delete;
+
+        claim &operator=(const claim &) = delete;
+
+        claim(claim &&other) noexcept: ring_(other.ring_), content_(other.content_) {
+            other.ring_ = nullptr;
+        }
+
+        claim &operator=(claim &&) = delete;
+
+        ~claim() {
+            commit();
+        }
+
+        T &message() const {
+            return *detail::message_at<T>(content_);
+        }
+
+        T *operator->() const {
+            return detail::message_at<T>(content_);
+        }
+
+        void commit() {
+            if (ring_ != nullptr) {
+                fixed_size_ring_buffer_commit_claim(ring_->buffer_, &ring_->header_, content_);
+                ring_ = nullptr;
+            }
+        }
+
+    private:
+        friend class fixed_size_ring;
+
+        claim(const fixed_size_ring *const ring, uint8_t *const content) : ring_(ring), content_(content) {
+            ::new(static_cast<void *>(content)) T;
+        }
+
+        //null once committed
+        const fixed_size_ring *ring_;
+        uint8_t *content_;
+    };
+
+    /**
+     * The bytes of a ring of at least requested_capacity messages: 0 if they can't fit an index_t.
+     */
+    static index_t length_of(const index_t requested_capacity) {
+        return fixed_size_ring_buffer_layout_capacity(requested_capacity, sizeof(T), Layout, payload_alignment);
+    }
+
+    /**
+     * A ring of at least requested_capacity messages, rounded up to a power of 2: empty if it can't be allocated.
+     */
+    static std::optional<fixed_size_ring> allocate(const index_t requested_capacity) {
+        const index_t length = length_of(requested_capacity);
+        detail::owned_buffer owned = detail::allocate_zeroed(length);
+        if (!owned) {
+            return std::nullopt;
+        }
+        std::optional<fixed_size_ring> ring = wrap(std::span<uint8_t>(owned.get(), static_cast<size_t>(length)),
+                                                   requested_capacity);
+        if (ring) {
+            ring->owned_ = std::move(owned);
+        }
+        return ring;
+    }
+
+    /**
+     * Wraps a zeroed buffer or one already used as the same ring, not owning it: empty if it is smaller than
+     * length_of(requested_capacity) or not aligned as T.
+     */
+    static std::optional<fixed_size_ring> wrap(const std::span<uint8_t> memory, const index_t requested_capacity) {
+        const index_t length = length_of(requested_capacity);
+        if (length == 0 || memory.size() < static_cast<size_t>(length) ||
+            reinterpret_cast<uintptr_t>(memory.data()) % payload_alignment != 0) {
+            return std::nullopt;
+        }
+        fixed_size_ring ring;
+        if (!init_fixed_size_ring_buffer_layout_header(memory.data(), &ring.header_, requested_capacity, sizeof(T),
+                                                       Layout, payload_alignment)) {
+            return std::nullopt;
+        }
+        ring.buffer_ = memory.data();
+        return ring;
+    }
+
+    /**
+     * Empty if the ring is full.
+     */
+    std::optional<claim> try_claim() {
+        uint8_t *content;
+        if (!try_fixed_size_ring_buffer_claim(buffer_, &header_, &content)) {
+            return std::nullopt;
+        }
+        return claim(this, content);
+    }
+
+    /**
+     * Reads up to count messages, calling consumer(T &message) on each: the batch stops after a consumer returning
+     * false. Returns the read messages.
+     */
+    template<typename Consumer>
+    uint32_t batch_read(Consumer &&consumer, const uint32_t count) {
+        using consumer_type = std::remove_reference_t<Consumer>;
+        return fixed_size_ring_buffer_batch_read(buffer_, &header_, &detail::fixed_size_trampoline<T, consumer_type>,
+                                                 count, const_cast<std::remove_const_t<consumer_type> *>(&consumer));
+    }
+
+    index_t capacity() const {
+        return header_.capacity;
+    }
+
+    const fixed_size_ring_buffer_header &header() const {
+        return header_;
+    }
+
+    uint8_t *buffer() const {
+        return buffer_;
+    }
+
+private:
+    fixed_size_ring() : header_(), buffer_(nullptr) {
+    }
+
+    fixed_size_ring_buffer_header header_;
+    uint8_t *buffer_;
+    //empty if the buffer is external
+    detail::owned_buffer owned_;
+};
+
+}
+
+#endif //FRANZ_FLOW_HPP
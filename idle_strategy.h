@@ -0,0 +1,114 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_IDLE_STRATEGY_H
+#define FRANZ_FLOW_IDLE_STRATEGY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <time.h>
+
+enum idle_strategy_kind {
+    //return immediately: the caller loop is a pure busy spin without any cpu hint
+    IDLE_STRATEGY_NO_OP,
+    //compiler barrier only: forces the caller to reload the shared state on each try
+    IDLE_STRATEGY_BUSY_SPIN,
+    //pause instruction: saves power and avoids the memory order violation on exiting the loop
+    IDLE_STRATEGY_PAUSE_SPIN,
+    //pause spin -> sched_yield -> nanosleep, doubling the sleep up to max_park_nanos
+    IDLE_STRATEGY_BACKOFF
+};
+
+struct idle_strategy {
+    enum idle_strategy_kind kind;
+    uint64_t max_spins;
+    uint64_t max_yields;
+    uint64_t min_park_nanos;
+    uint64_t max_park_nanos;
+    //backoff state
+    uint64_t spins;
+    uint64_t yields;
+    uint64_t park_nanos;
+};
+
+static const uint64_t IDLE_STRATEGY_DEFAULT_MAX_SPINS = 10;
+static const uint64_t IDLE_STRATEGY_DEFAULT_MAX_YIELDS = 20;
+static const uint64_t IDLE_STRATEGY_DEFAULT_MIN_PARK_NANOS = 1000;
+static const uint64_t IDLE_STRATEGY_DEFAULT_MAX_PARK_NANOS = 1000000;
+
+inline static void idle_strategy_reset(struct idle_strategy *const idle_strategy) {
+    idle_strategy->spins = 0;
+    idle_strategy->yields = 0;
+    idle_strategy->park_nanos = idle_strategy->min_park_nanos;
+}
+
+inline static void init_idle_strategy(struct idle_strategy *const idle_strategy, const enum idle_strategy_kind kind) {
+    idle_strategy->kind = kind;
+    idle_strategy->max_spins = IDLE_STRATEGY_DEFAULT_MAX_SPINS;
+    idle_strategy->max_yields = IDLE_STRATEGY_DEFAULT_MAX_YIELDS;
+    idle_strategy->min_park_nanos = IDLE_STRATEGY_DEFAULT_MIN_PARK_NANOS;
+    idle_strategy->max_park_nanos = IDLE_STRATEGY_DEFAULT_MAX_PARK_NANOS;
+    idle_strategy_reset(idle_strategy);
+}
+
+inline static void
+init_backoff_idle_strategy(struct idle_strategy *const idle_strategy, const uint64_t max_spins, const uint64_t max_yields,
+                           const uint64_t min_park_nanos, const uint64_t max_park_nanos) {
+    idle_strategy->kind = IDLE_STRATEGY_BACKOFF;
+    idle_strategy->max_spins = max_spins;
+    idle_strategy->max_yields = max_yields;
+    idle_strategy->min_park_nanos = min_park_nanos;
+    idle_strategy->max_park_nanos = max_park_nanos;
+    idle_strategy_reset(idle_strategy);
+}
+
+inline static void backoff_idle(struct idle_strategy *const idle_strategy) {
+    if (idle_strategy->spins < idle_strategy->max_spins) {
+        idle_strategy->spins++;
+        __asm__ __volatile__("pause;");
+    } else if (idle_strategy->yields < idle_strategy->max_yields) {
+        idle_strategy->yields++;
+        sched_yield();
+    } else {
+        const uint64_t park_nanos = idle_strategy->park_nanos;
+        const struct timespec park_time = {.tv_sec = park_nanos / 1000000000, .tv_nsec = park_nanos % 1000000000};
+        nanosleep(&park_time, NULL);
+        const uint64_t next_park_nanos = park_nanos * 2;
+        idle_strategy->park_nanos =
+                next_park_nanos > idle_strategy->max_park_nanos ? idle_strategy->max_park_nanos : next_park_nanos;
+    }
+}
+
+/**
+ * Performs one idle step: it has to be called each time a try on the ring buffer fails.
+ */
+inline static void idle_strategy_idle(struct idle_strategy *const idle_strategy) {
+    switch (idle_strategy->kind) {
+        case IDLE_STRATEGY_NO_OP:
+            break;
+        case IDLE_STRATEGY_BUSY_SPIN:
+            __asm__ __volatile__("" ::: "memory");
+            break;
+        case IDLE_STRATEGY_PAUSE_SPIN:
+            __asm__ __volatile__("pause;");
+            break;
+        case IDLE_STRATEGY_BACKOFF:
+            backoff_idle(idle_strategy);
+            break;
+    }
+}
+
+/**
+ * Idles only if no work has been done, otherwise resets the backoff state.
+ */
+inline static void idle_strategy_idle_work(struct idle_strategy *const idle_strategy, const uint64_t work_count) {
+    if (work_count > 0) {
+        idle_strategy_reset(idle_strategy);
+    } else {
+        idle_strategy_idle(idle_strategy);
+    }
+}
+
+#endif //FRANZ_FLOW_IDLE_STRATEGY_H
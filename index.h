@@ -6,7 +6,20 @@
 #define FRANZ_FLOW_INDEX_H
 
 #include <stdint.h>
+#include <inttypes.h>
 
+/**
+ * FRANZ_FLOW_INDEX_64 makes index_t 64 bit to address buffers bigger than 2 GiB: by default it is 32 bit, to keep the
+ * offsets math and the headers of the hot paths smaller.
+ */
+#ifdef FRANZ_FLOW_INDEX_64
+typedef int64_t index_t;
+#define INDEX_MAX INT64_MAX
+#define PRIdINDEX PRId64
+#else
 typedef int32_t index_t;
+#define INDEX_MAX INT32_MAX
+#define PRIdINDEX PRId32
+#endif
 
 #endif //FRANZ_FLOW_INDEX_H
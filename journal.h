@@ -0,0 +1,370 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_JOURNAL_H
+#define FRANZ_FLOW_JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "message_layout.h"
+#include "index.h"
+#include "bytes_utils.h"
+#include "ring_buffer.h"
+
+/**
+ * Append only journal of message_layout.h records on pre-allocated and memory mapped segment files, named after
+ * their index in the journal directory: each record is written with the same header it has on the ring_buffer and
+ * it is addressed by its position ie segment index * segment length + offset within the segment.
+ * The records can't span over segments and a zero header marks the end of the journal.
+ */
+
+enum journal_sync_policy {
+    //the kernel writes back the dirty pages whenever it wants
+    JOURNAL_SYNC_NONE,
+    //a full segment is synced before appending on the next one
+    JOURNAL_SYNC_ON_ROTATION,
+    //each journal_drain syncs what it has appended before returning
+    JOURNAL_SYNC_ON_DRAIN
+};
+
+/**
+ * Sparse index entry: the position of the record with the given sequence ie the count of the records before it.
+ */
+struct journal_index_entry {
+    uint64_t sequence;
+    uint64_t position;
+};
+
+struct journal {
+    char directory[PATH_MAX];
+    index_t segment_length;
+    enum journal_sync_policy sync_policy;
+    //one index entry every index_interval records
+    uint32_t index_interval;
+    uint8_t **segments;
+    uint64_t segment_count;
+    uint64_t segments_capacity;
+    uint64_t position;
+    uint64_t synced_position;
+    uint64_t sequence;
+    struct journal_index_entry *index;
+    uint64_t index_length;
+    uint64_t index_capacity;
+    //a failed append stops any further append: the journal can't have holes
+    bool failed;
+};
+
+inline static bool journal_segment_path(const struct journal *const journal, const uint64_t segment_index,
+                                        char *const path) {
+    const int length = snprintf(path, PATH_MAX, "%s/%020" PRIu64 ".journal", journal->directory, segment_index);
+    return length > 0 && length < PATH_MAX;
+}
+
+inline static uint8_t *map_journal_segment(const struct journal *const journal, const uint64_t segment_index,
+                                           const bool create) {
+    char path[PATH_MAX];
+    if (!journal_segment_path(journal, segment_index, path)) {
+        return NULL;
+    }
+    const int fd = open(path, create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat file_stat;
+    //the blocks are allocated upfront: a full disk fails here and not with a SIGBUS on a store
+    const bool allocated = create ? posix_fallocate(fd, 0, journal->segment_length) == 0 :
+                           fstat(fd, &file_stat) == 0 && file_stat.st_size == journal->segment_length;
+    void *address = MAP_FAILED;
+    if (allocated) {
+        address = mmap(NULL, journal->segment_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    //the mapping stays valid after the close
+    close(fd);
+    if (address == MAP_FAILED) {
+        if (create) {
+            unlink(path);
+        }
+        return NULL;
+    }
+    return (uint8_t *) address;
+}
+
+inline static bool add_journal_segment(struct journal *const journal, const bool create) {
+    if (journal->segment_count == journal->segments_capacity) {
+        const uint64_t segments_capacity = journal->segments_capacity == 0 ? 16 : journal->segments_capacity * 2;
+        uint8_t **const segments = realloc(journal->segments, segments_capacity * sizeof(uint8_t *));
+        if (segments == NULL) {
+            return false;
+        }
+        journal->segments = segments;
+        journal->segments_capacity = segments_capacity;
+    }
+    uint8_t *const segment = map_journal_segment(journal, journal->segment_count, create);
+    if (segment == NULL) {
+        return false;
+    }
+    journal->segments[journal->segment_count] = segment;
+    journal->segment_count++;
+    return true;
+}
+
+inline static bool add_journal_index_entry(struct journal *const journal) {
+    if (journal->index_length == journal->index_capacity) {
+        const uint64_t index_capacity = journal->index_capacity == 0 ? 1024 : journal->index_capacity * 2;
+        struct journal_index_entry *const index = realloc(journal->index,
+                                                          index_capacity * sizeof(struct journal_index_entry));
+        if (index == NULL) {
+            return false;
+        }
+        journal->index = index;
+        journal->index_capacity = index_capacity;
+    }
+    struct journal_index_entry *const entry = &journal->index[journal->index_length];
+    entry->sequence = journal->sequence;
+    entry->position = journal->position;
+    journal->index_length++;
+    return true;
+}
+
+inline static uint64_t journal_segment_index(const struct journal *const journal, const uint64_t position) {
+    return position / journal->segment_length;
+}
+
+inline static index_t journal_segment_offset(const struct journal *const journal, const uint64_t position) {
+    return (index_t) (position & (journal->segment_length - 1));
+}
+
+/**
+ * Syncs on disk the appended records not synced yet.
+ */
+inline static bool journal_sync(struct journal *const journal) {
+    const uint64_t position = journal->position;
+    const index_t page_mask = (index_t) sysconf(_SC_PAGESIZE) - 1;
+    uint64_t synced_position = journal->synced_position;
+    while (synced_position < position) {
+        const uint64_t segment_index = journal_segment_index(journal, synced_position);
+        const uint64_t segment_end = (segment_index + 1) * journal->segment_length;
+        const uint64_t sync_end = position < segment_end ? position : segment_end;
+        const index_t sync_start_offset = journal_segment_offset(journal, synced_position) & ~page_mask;
+        const index_t sync_end_offset = (index_t) (sync_end - (segment_index * journal->segment_length));
+        if (msync(journal->segments[segment_index] + sync_start_offset, sync_end_offset - sync_start_offset,
+                  MS_SYNC) != 0) {
+            return false;
+        }
+        synced_position = sync_end;
+    }
+    journal->synced_position = synced_position;
+    return true;
+}
+
+/**
+ * Scans the records of the existing segments to find the end of the journal and rebuild its index.
+ */
+inline static void recover_journal(struct journal *const journal) {
+    const index_t segment_length = journal->segment_length;
+    for (uint64_t segment_index = 0; segment_index < journal->segment_count; segment_index++) {
+        const uint8_t *const segment = journal->segments[segment_index];
+        index_t offset = journal_segment_offset(journal, journal->position);
+        while (offset < segment_length) {
+            const index_t msg_length = record_length(*((uint64_t *) (segment + offset)));
+            if (msg_length <= 0 || msg_length > (segment_length - offset)) {
+                //end of the journal: the next segment, if any, has never been appended
+                return;
+            }
+            if (message_type_id(*((uint64_t *) (segment + offset))) != RECORD_PADDING_MSG_TYPE_ID) {
+                if ((journal->sequence % journal->index_interval) == 0 && !add_journal_index_entry(journal)) {
+                    journal->failed = true;
+                    return;
+                }
+                journal->sequence++;
+            }
+            offset += align(msg_length, RECORD_ALIGNMENT);
+            journal->position = (segment_index * segment_length) + offset;
+        }
+    }
+}
+
+/**
+ * Opens the journal in an existing directory, recovering the segments already there if any.
+ * segment_length must be a power of 2 multiple of the page size.
+ */
+inline static bool
+open_journal(struct journal *const journal, const char *const directory, const index_t segment_length,
+             const enum journal_sync_policy sync_policy, const uint32_t index_interval) {
+    memset(journal, 0, sizeof(struct journal));
+    const index_t page_size = (index_t) sysconf(_SC_PAGESIZE);
+    if (!is_pow_2(segment_length) || segment_length < page_size || index_interval == 0 ||
+        strlen(directory) >= PATH_MAX) {
+        return false;
+    }
+    strcpy(journal->directory, directory);
+    journal->segment_length = segment_length;
+    journal->sync_policy = sync_policy;
+    journal->index_interval = index_interval;
+    while (add_journal_segment(journal, false)) {
+    }
+    if (journal->segment_count == 0 && !add_journal_segment(journal, true)) {
+        return false;
+    }
+    recover_journal(journal);
+    journal->synced_position = journal->position;
+    return !journal->failed;
+}
+
+inline static void close_journal(struct journal *const journal) {
+    if (journal->sync_policy != JOURNAL_SYNC_NONE) {
+        journal_sync(journal);
+    }
+    for (uint64_t i = 0; i < journal->segment_count; i++) {
+        munmap(journal->segments[i], journal->segment_length);
+    }
+    free(journal->segments);
+    free(journal->index);
+    journal->segments = NULL;
+    journal->index = NULL;
+    journal->segment_count = 0;
+    journal->index_length = 0;
+}
+
+inline static bool rotate_journal_segment(struct journal *const journal) {
+    if (journal->sync_policy == JOURNAL_SYNC_ON_ROTATION && !journal_sync(journal)) {
+        return false;
+    }
+    return add_journal_segment(journal, true);
+}
+
+inline static bool
+journal_append(struct journal *const journal, const uint32_t msg_type_id, const uint8_t *const msg,
+               const index_t msg_length) {
+    if (journal->failed) {
+        return false;
+    }
+    const index_t segment_length = journal->segment_length;
+    const index_t record_length = msg_length + RECORD_HEADER_LENGTH;
+    const index_t aligned_record_length = align(record_length, RECORD_ALIGNMENT);
+    if (msg_length < 0 || msg_length > RECORD_MAX_MSG_LENGTH || aligned_record_length > segment_length) {
+        return false;
+    }
+    uint64_t position = journal->position;
+    index_t offset = journal_segment_offset(journal, position);
+    const index_t remaining_segment_bytes = segment_length - offset;
+    if (remaining_segment_bytes < aligned_record_length) {
+        uint8_t *const segment = journal->segments[journal_segment_index(journal, position)];
+        *((uint64_t *) (segment + offset)) = make_header(RECORD_PADDING_MSG_TYPE_ID, remaining_segment_bytes);
+        position += remaining_segment_bytes;
+        journal->position = position;
+        offset = 0;
+    }
+    const uint64_t segment_index = journal_segment_index(journal, position);
+    if (segment_index == journal->segment_count && !rotate_journal_segment(journal)) {
+        journal->failed = true;
+        return false;
+    }
+    if ((journal->sequence % journal->index_interval) == 0 && !add_journal_index_entry(journal)) {
+        journal->failed = true;
+        return false;
+    }
+    uint8_t *const segment = journal->segments[segment_index];
+    memcpy(segment + encoded_msg_offset(offset), msg, msg_length);
+    *((uint64_t *) (segment + offset)) = make_header(msg_type_id, record_length);
+    journal->position = position + aligned_record_length;
+    journal->sequence++;
+    return true;
+}
+
+inline static bool journal_message_consumer(const uint32_t msg_type_id, const uint8_t *const buffer,
+                                            const index_t msg_content_index, const index_t msg_content_length,
+                                            void *const context) {
+    return journal_append((struct journal *) context, msg_type_id, buffer + msg_content_index, msg_content_length);
+}
+
+/**
+ * Drains up to count records from the ring buffer into the journal, syncing them if requested by the policy.
+ * The ring buffer releases the records as soon as they're read: if the journal fails the record that has failed
+ * is lost, but the journal stops accepting any other record.
+ */
+inline static uint32_t
+journal_drain(struct journal *const journal, const struct ring_buffer_header *const header, uint8_t *const buffer,
+              const uint32_t count) {
+    if (journal->failed) {
+        return 0;
+    }
+    const uint32_t msg_read = ring_buffer_batch_read(header, buffer, &journal_message_consumer, count, journal);
+    if (msg_read != 0 && journal->sync_policy == JOURNAL_SYNC_ON_DRAIN && !journal_sync(journal)) {
+        journal->failed = true;
+    }
+    return msg_read;
+}
+
+/**
+ * Finds the position of the record with the given sequence: a binary search on the sparse index and a scan of
+ * at most index_interval records.
+ */
+inline static bool
+journal_seek(const struct journal *const journal, const uint64_t sequence, uint64_t *const position) {
+    if (sequence >= journal->sequence || journal->index_length == 0) {
+        return false;
+    }
+    uint64_t low = 0;
+    uint64_t high = journal->index_length - 1;
+    while (low < high) {
+        const uint64_t middle = low + ((high - low + 1) / 2);
+        if (journal->index[middle].sequence <= sequence) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    uint64_t current_sequence = journal->index[low].sequence;
+    uint64_t current_position = journal->index[low].position;
+    while (true) {
+        const uint8_t *const segment = journal->segments[journal_segment_index(journal, current_position)];
+        const uint64_t record_header = *((uint64_t *) (segment + journal_segment_offset(journal, current_position)));
+        if (message_type_id(record_header) != RECORD_PADDING_MSG_TYPE_ID) {
+            if (current_sequence == sequence) {
+                *position = current_position;
+                return true;
+            }
+            current_sequence++;
+        }
+        current_position += align(record_length(record_header), RECORD_ALIGNMENT);
+    }
+}
+
+/**
+ * Streams up to count records from position back through the consumer, returning the position of the next record.
+ */
+inline static uint32_t
+journal_replay(const struct journal *const journal, const uint64_t position, const message_consumer consumer,
+               const uint32_t count, void *const context, uint64_t *const next_position) {
+    uint64_t current_position = position;
+    uint32_t msg_read = 0;
+    bool stop = false;
+    while (!stop && msg_read < count && current_position < journal->position) {
+        const uint8_t *const segment = journal->segments[journal_segment_index(journal, current_position)];
+        const index_t offset = journal_segment_offset(journal, current_position);
+        const uint64_t record_header = *((uint64_t *) (segment + offset));
+        const index_t msg_length = record_length(record_header);
+        const uint32_t msg_type_id = message_type_id(record_header);
+        if (msg_type_id != RECORD_PADDING_MSG_TYPE_ID) {
+            msg_read++;
+            stop = !consumer(msg_type_id, segment, encoded_msg_offset(offset), msg_length - RECORD_HEADER_LENGTH,
+                             context);
+        }
+        current_position += align(msg_length, RECORD_ALIGNMENT);
+    }
+    *next_position = current_position;
+    return msg_read;
+}
+
+#endif //FRANZ_FLOW_JOURNAL_H
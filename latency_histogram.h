@@ -0,0 +1,114 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_LATENCY_HISTOGRAM_H
+#define FRANZ_FLOW_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ * Log bucketed histogram, HdrHistogram style: each power of 2 range is split in LATENCY_HISTOGRAM_SUB_BUCKETS / 2
+ * linear sub buckets, hence any recorded value is reported with a relative error below 2 / SUB_BUCKETS, whatever is
+ * its magnitude, and the recording is just a count increment.
+ */
+
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 8
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+#define LATENCY_HISTOGRAM_HALF_SUB_BUCKETS (LATENCY_HISTOGRAM_SUB_BUCKETS / 2)
+#define LATENCY_HISTOGRAM_BUCKETS \
+    (((64 - LATENCY_HISTOGRAM_SUB_BUCKET_BITS) * LATENCY_HISTOGRAM_HALF_SUB_BUCKETS) + LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+struct latency_histogram {
+    uint64_t total_count;
+    uint64_t min;
+    uint64_t max;
+    //to compute the mean
+    double sum;
+    uint64_t counts[LATENCY_HISTOGRAM_BUCKETS];
+};
+
+inline static void reset_latency_histogram(struct latency_histogram *const histogram) {
+    memset(histogram, 0, sizeof(struct latency_histogram));
+    histogram->min = UINT64_MAX;
+}
+
+inline static uint32_t latency_histogram_index(const uint64_t value) {
+    if (value < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return (uint32_t) value;
+    }
+    const uint32_t exponent = (63 - __builtin_clzll(value)) - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1;
+    //the sub bucket is in [SUB_BUCKETS / 2, SUB_BUCKETS)
+    const uint32_t sub_bucket = (uint32_t) (value >> exponent);
+    return (exponent * LATENCY_HISTOGRAM_HALF_SUB_BUCKETS) + sub_bucket;
+}
+
+/**
+ * The highest value that falls in the bucket at index.
+ */
+inline static uint64_t latency_histogram_value(const uint32_t index) {
+    if (index < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    const uint32_t exponent = (index / LATENCY_HISTOGRAM_HALF_SUB_BUCKETS) - 1;
+    const uint64_t sub_bucket = index - (exponent * LATENCY_HISTOGRAM_HALF_SUB_BUCKETS);
+    return ((sub_bucket + 1) << exponent) - 1;
+}
+
+inline static void latency_histogram_record(struct latency_histogram *const histogram, const uint64_t value) {
+    histogram->counts[latency_histogram_index(value)]++;
+    histogram->total_count++;
+    histogram->sum += value;
+    if (value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+inline static void
+latency_histogram_merge(struct latency_histogram *const histogram, const struct latency_histogram *const other) {
+    for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        histogram->counts[i] += other->counts[i];
+    }
+    histogram->total_count += other->total_count;
+    histogram->sum += other->sum;
+    if (other->min < histogram->min) {
+        histogram->min = other->min;
+    }
+    if (other->max > histogram->max) {
+        histogram->max = other->max;
+    }
+}
+
+/**
+ * The value below or equal to which falls the given percentile of the recorded values, capped by the max.
+ */
+inline static uint64_t
+latency_histogram_percentile(const struct latency_histogram *const histogram, const double percentile) {
+    if (histogram->total_count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t) ((percentile / 100.0) * histogram->total_count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        count += histogram->counts[i];
+        if (count >= rank) {
+            const uint64_t value = latency_histogram_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+inline static double latency_histogram_mean(const struct latency_histogram *const histogram) {
+    return histogram->total_count == 0 ? 0 : histogram->sum / histogram->total_count;
+}
+
+#endif //FRANZ_FLOW_LATENCY_HISTOGRAM_H
@@ -0,0 +1,239 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_LOG_H
+#define FRANZ_FLOW_LOG_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "message_layout.h"
+#include "index.h"
+#include "bytes_utils.h"
+#include "log_layout.h"
+#include "ring_buffer.h"
+
+/**
+ * Append only log of message_layout.h records, addressed by monotonically increasing positions: a single appender
+ * writes the tail while any number of consumers read it from their own cursors, without releasing anything.
+ * The records are stored in a ring of segments and the retention is by segment: entering a new segment drops the
+ * oldest one, hence the log retains always segment_count - 1 whole segments besides the one being appended.
+ */
+
+inline static uint64_t load_log_record_header(const uint8_t *const buffer, const index_t index) {
+    //the appender could be overwriting a dropped segment: at least it can't be torn
+    const _Atomic uint64_t *record_header_address = (_Atomic uint64_t *) (buffer + index);
+    return atomic_load_explicit(record_header_address, memory_order_relaxed);
+}
+
+inline static void store_log_record_header(const uint8_t *const buffer, const index_t index, const uint64_t header) {
+    const _Atomic uint64_t *record_header_address = (_Atomic uint64_t *) (buffer + index);
+    atomic_store_explicit(record_header_address, header, memory_order_relaxed);
+}
+
+inline static void
+enter_log_segment(const struct log_header *const header, const uint8_t *const buffer, const uint64_t segment_start) {
+    const index_t capacity = header->capacity;
+    if (segment_start < capacity) {
+        //first lap: nothing to drop
+        return;
+    }
+    //drops the segment that is going to be overwritten
+    store_release_start_position(header, buffer, segment_start + header->segment_capacity - capacity);
+    //StoreStore: the consumers must see the new start position before any of the dropped bytes is overwritten
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * Appends a record and returns its position, that can be used to rewind any cursor to it.
+ * It is safe to be called only by a single appender per log.
+ */
+inline static bool
+log_append(const struct log_header *const header, uint8_t *const buffer, const uint32_t msg_type_id,
+           const uint8_t *const msg, const index_t msg_length, uint64_t *const position) {
+    if (!check_msg_type_id(msg_type_id) || msg_length < 0 || msg_length > header->max_msg_length) {
+        return false;
+    }
+    const index_t segment_mask = header->segment_capacity - 1;
+    const index_t mask = header->capacity - 1;
+    uint64_t tail_position = load_tail_position(header, buffer);
+    const index_t record_length = msg_length + RECORD_HEADER_LENGTH;
+    const index_t aligned_record_length = align(record_length, RECORD_ALIGNMENT);
+    const index_t segment_offset = tail_position & segment_mask;
+    const index_t remaining_segment_bytes = header->segment_capacity - segment_offset;
+    if (remaining_segment_bytes < aligned_record_length) {
+        //the records can't span over segments: pads the rest of the current one
+        store_log_record_header(buffer, tail_position & mask,
+                                make_header(RECORD_PADDING_MSG_TYPE_ID, remaining_segment_bytes));
+        tail_position += remaining_segment_bytes;
+        enter_log_segment(header, buffer, tail_position);
+    } else if (segment_offset == 0) {
+        enter_log_segment(header, buffer, tail_position);
+    }
+    const index_t record_index = tail_position & mask;
+    memcpy(buffer + encoded_msg_offset(record_index), msg, msg_length);
+    store_log_record_header(buffer, record_index, make_header(msg_type_id, record_length));
+    store_release_tail_position(header, buffer, tail_position + aligned_record_length);
+    *position = tail_position;
+    return true;
+}
+
+/**
+ * A consumer offset on the log: it can be moved anywhere between the start and the tail, as long as it points to
+ * a record position returned by log_append.
+ */
+struct log_cursor {
+    uint64_t position;
+    //how many times the cursor has fallen behind the retained segments and how many bytes it has lost due to it
+    uint64_t truncated_count;
+    uint64_t lost_bytes;
+};
+
+inline static void init_log_cursor(struct log_cursor *const cursor, const uint64_t position) {
+    cursor->position = position;
+    cursor->truncated_count = 0;
+    cursor->lost_bytes = 0;
+}
+
+inline static void log_cursor_seek(struct log_cursor *const cursor, const uint64_t position) {
+    cursor->position = position;
+}
+
+inline static void
+log_cursor_seek_to_start(const struct log_header *const header, const uint8_t *const buffer,
+                         struct log_cursor *const cursor) {
+    cursor->position = load_acquire_start_position(header, buffer);
+}
+
+inline static void
+log_cursor_seek_to_tail(const struct log_header *const header, const uint8_t *const buffer,
+                        struct log_cursor *const cursor) {
+    cursor->position = load_acquire_tail_position(header, buffer);
+}
+
+inline static uint64_t truncate_log_cursor(const struct log_header *const header, const uint8_t *const buffer,
+                                           struct log_cursor *const cursor, const uint64_t position) {
+    //restarts from the oldest record retained
+    const uint64_t start_position = load_acquire_start_position(header, buffer);
+    cursor->truncated_count++;
+    cursor->lost_bytes += start_position - position;
+    return start_position;
+}
+
+/**
+ * Reads up to count records from the cursor position, without modifying the log.
+ * The records are read in place: a consumer too slow to keep up with segment_count - 1 segments could see
+ * a record while it is being overwritten, but its cursor is truncated to the start as soon as it is detected.
+ */
+inline static uint32_t
+log_batch_read(const struct log_header *const header, const uint8_t *const buffer, struct log_cursor *const cursor,
+               const message_consumer consumer, const uint32_t count, void *const context) {
+    const uint64_t tail_position = load_acquire_tail_position(header, buffer);
+    const index_t mask = header->capacity - 1;
+    uint64_t position = cursor->position;
+    uint32_t msg_read = 0;
+    bool stop = false;
+    while (!stop && msg_read < count && position < tail_position) {
+        if (position < load_acquire_start_position(header, buffer)) {
+            position = truncate_log_cursor(header, buffer, cursor, position);
+            continue;
+        }
+        const index_t record_index = position & mask;
+        const uint64_t record_header = load_log_record_header(buffer, record_index);
+        const index_t msg_length = record_length(record_header);
+        const uint32_t msg_type_id = message_type_id(record_header);
+        //LoadLoad: the record header is valid only if it hasn't been dropped after being read
+        atomic_thread_fence(memory_order_acquire);
+        if (position < load_acquire_start_position(header, buffer)) {
+            position = truncate_log_cursor(header, buffer, cursor, position);
+            continue;
+        }
+        if (msg_type_id != RECORD_PADDING_MSG_TYPE_ID) {
+            msg_read++;
+            stop = !consumer(msg_type_id, buffer, encoded_msg_offset(record_index),
+                             msg_length - RECORD_HEADER_LENGTH, context);
+        }
+        position += align(msg_length, RECORD_ALIGNMENT);
+    }
+    cursor->position = position;
+    return msg_read;
+}
+
+/**
+ * Waits until at least one record is read.
+ */
+inline static uint32_t
+log_blocking_batch_read(const struct log_header *const header, const uint8_t *const buffer,
+                        struct log_cursor *const cursor, const message_consumer consumer, const uint32_t count,
+                        void *const context, struct idle_strategy *const idle_strategy, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    uint32_t msg_read;
+    while ((msg_read = log_batch_read(header, buffer, cursor, consumer, count, context)) == 0) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return msg_read;
+}
+
+/**
+ * How many bytes the cursor has still to read.
+ */
+inline static uint64_t
+log_cursor_lag(const struct log_header *const header, const uint8_t *const buffer,
+               const struct log_cursor *const cursor) {
+    const uint64_t tail_position = load_acquire_tail_position(header, buffer);
+    return tail_position > cursor->position ? tail_position - cursor->position : 0;
+}
+
+/**
+ * Partitions share the same segments layout and are laid out one after the other in the same buffer: each of them
+ * is a log on its own, with its own appender.
+ */
+struct partitioned_log {
+    struct log_header header;
+    index_t partition_count;
+    index_t partition_length;
+};
+
+inline static int64_t partitioned_log_length(const index_t segment_capacity, const index_t segment_count,
+                                             const index_t partition_count) {
+    return ((int64_t) log_partition_length(segment_capacity, segment_count)) * partition_count;
+}
+
+inline static bool
+init_partitioned_log(struct partitioned_log *const log, const index_t segment_capacity, const index_t segment_count,
+                     const index_t partition_count) {
+    if (partition_count <= 0 || !init_log_header(&log->header, segment_capacity, segment_count)) {
+        return false;
+    }
+    log->partition_count = partition_count;
+    //keeps the trailers of the partitions on different cache lines
+    log->partition_length = log_partition_length(segment_capacity, segment_count);
+    return true;
+}
+
+inline static uint8_t *
+log_partition(const struct partitioned_log *const log, uint8_t *const buffer, const index_t partition) {
+    return buffer + ((int64_t) log->partition_length * partition);
+}
+
+/**
+ * Picks the partition of a key: records with the same key are appended on the same partition, hence they're ordered.
+ */
+inline static index_t log_partition_of(const struct partitioned_log *const log, const uint64_t key) {
+    //fmix64 of MurmurHash3 to spread sequential keys too
+    uint64_t hash = key;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdUL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53UL;
+    hash ^= hash >> 33;
+    return (index_t) (hash % log->partition_count);
+}
+
+#endif //FRANZ_FLOW_LOG_H
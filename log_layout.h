@@ -0,0 +1,105 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_LOG_LAYOUT_H
+#define FRANZ_FLOW_LOG_LAYOUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "message_layout.h"
+#include "index.h"
+#include "bytes_utils.h"
+
+/**
+ * Offset within the trailer for where the tail position is stored: the end position of the last record appended.
+ */
+static const index_t LOG_TAIL_POSITION_OFFSET = 0;
+/**
+ * Offset within the trailer for where the start position is stored: the position of the oldest record retained.
+ */
+static const index_t LOG_START_POSITION_OFFSET = sizeof(uint64_t);
+/**
+ * Total length of the trailer in bytes: the positions are written only by the appender and read by all the
+ * consumers, then they can share the same cache line.
+ */
+static const index_t LOG_TRAILER_LENGTH = CACHE_LINE_LENGTH * 2;
+
+/**
+ * The length in bytes of a partition made by segment_count segments of segment_capacity bytes, trailer included,
+ * or 0 if it can't fit an index_t.
+ */
+inline static index_t log_partition_length(const index_t segment_capacity, const index_t segment_count) {
+    index_t capacity;
+    index_t partition_length;
+    if (!checked_multiply(segment_capacity, segment_count, &capacity) ||
+        !checked_add(capacity, LOG_TRAILER_LENGTH, &partition_length)) {
+        return 0;
+    }
+    return partition_length;
+}
+
+struct log_header {
+    index_t max_msg_length;
+    index_t segment_capacity;
+    index_t segment_count;
+    index_t capacity;
+    index_t tail_position_index;
+    index_t start_position_index;
+};
+
+inline static bool
+init_log_header(struct log_header *const header, const index_t segment_capacity, const index_t segment_count) {
+    //at least one segment retained while another one is being appended
+    if (!is_pow_2(segment_capacity) || !is_pow_2(segment_count) || segment_count < 2 ||
+        segment_capacity < RECORD_HEADER_LENGTH) {
+        return false;
+    }
+    if (log_partition_length(segment_capacity, segment_count) == 0) {
+        return false;
+    }
+    const index_t capacity = segment_capacity * segment_count;
+    header->segment_capacity = segment_capacity;
+    header->segment_count = segment_count;
+    header->capacity = capacity;
+    //records can't span over segments
+    header->max_msg_length = clamp_max_msg_length(segment_capacity - RECORD_HEADER_LENGTH);
+    header->tail_position_index = capacity + LOG_TAIL_POSITION_OFFSET;
+    header->start_position_index = capacity + LOG_START_POSITION_OFFSET;
+    return true;
+}
+
+inline static uint64_t load_tail_position(const struct log_header *const header, const uint8_t *const buffer) {
+    //only the appender writes it
+    const uint64_t *tail_position_address = (uint64_t *) (buffer + header->tail_position_index);
+    return *tail_position_address;
+}
+
+inline static uint64_t
+load_acquire_tail_position(const struct log_header *const header, const uint8_t *const buffer) {
+    const _Atomic uint64_t *tail_position_address = (_Atomic uint64_t *) (buffer + header->tail_position_index);
+    return atomic_load_explicit(tail_position_address, memory_order_acquire);
+}
+
+inline static void
+store_release_tail_position(const struct log_header *const header, const uint8_t *const buffer,
+                            const uint64_t value) {
+    const _Atomic uint64_t *tail_position_address = (_Atomic uint64_t *) (buffer + header->tail_position_index);
+    atomic_store_explicit(tail_position_address, value, memory_order_release);
+}
+
+inline static uint64_t
+load_acquire_start_position(const struct log_header *const header, const uint8_t *const buffer) {
+    const _Atomic uint64_t *start_position_address = (_Atomic uint64_t *) (buffer + header->start_position_index);
+    return atomic_load_explicit(start_position_address, memory_order_acquire);
+}
+
+inline static void
+store_release_start_position(const struct log_header *const header, const uint8_t *const buffer,
+                             const uint64_t value) {
+    const _Atomic uint64_t *start_position_address = (_Atomic uint64_t *) (buffer + header->start_position_index);
+    atomic_store_explicit(start_position_address, value, memory_order_release);
+}
+
+#endif //FRANZ_FLOW_LOG_LAYOUT_H
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+
+/**
+ * log appends and cursors on 4 segments of 256 bytes, and the key mapping of a partitioned_log: exits with 1 if any
+ * check fails.
+ */
+
+#define MSG_TYPE_ID 1
+#define SEGMENT_CAPACITY 256
+#define SEGMENT_COUNT 4
+//16 bytes messages are 24 bytes records: a segment ends with a padding record
+#define MSG_LENGTH 16
+#define RECORDS 200
+#define PARTITIONS 4
+#define KEYS 32
+
+struct test_log {
+    struct log_header header;
+    uint8_t *buffer;
+    uint64_t positions[RECORDS + 1];
+};
+
+struct test_consumer_context {
+    uint64_t last_value;
+    uint64_t last_key;
+    uint32_t received;
+};
+
+static uint32_t failures = 0;
+
+static void check(const bool condition, const char *const test, const char *const what) {
+    if (!condition) {
+        fprintf(stderr, "%s: %s\n", test, what);
+        failures++;
+    }
+}
+
+static uint8_t *allocate_zeroed(const int64_t length) {
+    uint8_t *const buffer = (uint8_t *) aligned_alloc(CACHE_LINE_LENGTH, align(length, CACHE_LINE_LENGTH));
+    if (buffer != NULL) {
+        memset(buffer, 0, length);
+    }
+    return buffer;
+}
+
+static bool append(const struct log_header *const header, uint8_t *const buffer, const uint64_t key,
+                   const uint64_t value, uint64_t *const position) {
+    uint8_t msg[MSG_LENGTH];
+    memcpy(msg, &key, sizeof(key));
+    memcpy(msg + sizeof(key), &value, sizeof(value));
+    return log_append(header, buffer, MSG_TYPE_ID, msg, MSG_LENGTH, position);
+}
+
+static bool on_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                       const index_t msg_content_length, void *context) {
+    struct test_consumer_context *const consumer_context = (struct test_consumer_context *) context;
+    memcpy(&consumer_context->last_key, buffer + msg_content_index, sizeof(uint64_t));
+    memcpy(&consumer_context->last_value, buffer + msg_content_index + sizeof(uint64_t), sizeof(uint64_t));
+    consumer_context->received++;
+    return true;
+}
+
+/**
+ * Appends the values 1..RECORDS, recording their positions.
+ */
+static bool init_test_log(struct test_log *const log) {
+    log->buffer = allocate_zeroed(log_partition_length(SEGMENT_CAPACITY, SEGMENT_COUNT));
+    if (log->buffer == NULL || !init_log_header(&log->header, SEGMENT_CAPACITY, SEGMENT_COUNT)) {
+        return false;
+    }
+    log->positions[0] = 0;
+    for (uint64_t value = 1; value <= RECORDS; value++) {
+        if (!append(&log->header, log->buffer, 0, value, &log->positions[value])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_positions_across_segments(void) {
+    struct test_log log;
+    check(init_test_log(&log), __func__, "can't init");
+    for (uint64_t value = 1; value <= RECORDS; value++) {
+        const uint64_t position = log.positions[value];
+        check(value == 1 || position > log.positions[value - 1], __func__, "position not monotonic");
+        check((position & (SEGMENT_CAPACITY - 1)) + 24 <= SEGMENT_CAPACITY, __func__, "record spans 2 segments");
+    }
+    //the segment being appended and the segment_count - 1 before it are retained
+    const uint64_t tail_position = load_acquire_tail_position(&log.header, log.buffer);
+    const uint64_t tail_segment_start = (tail_position - 1) & ~((uint64_t) SEGMENT_CAPACITY - 1);
+    check(tail_position == log.positions[RECORDS] + 24, __func__, "wrong tail position");
+    check(load_acquire_start_position(&log.header, log.buffer) ==
+          tail_segment_start - ((SEGMENT_COUNT - 1) * SEGMENT_CAPACITY), __func__, "wrong start position");
+    free(log.buffer);
+}
+
+static void test_lagging_cursor_truncated(void) {
+    struct test_log log;
+    check(init_test_log(&log), __func__, "can't init");
+    const uint64_t start_position = load_acquire_start_position(&log.header, log.buffer);
+    check(start_position != 0, __func__, "no segment dropped");
+    struct log_cursor cursor;
+    init_log_cursor(&cursor, log.positions[1]);
+    struct test_consumer_context context = {0};
+    check(log_batch_read(&log.header, log.buffer, &cursor, &on_message, 1, &context) == 1, __func__, "not read");
+    check(cursor.truncated_count == 1, __func__, "wrong truncated count");
+    check(cursor.lost_bytes == start_position - log.positions[1], __func__, "wrong lost bytes");
+    //the first value read is the oldest retained: a segment starts with a record
+    uint64_t first_retained_value = 1;
+    while (log.positions[first_retained_value] < start_position) {
+        first_retained_value++;
+    }
+    check(log.positions[first_retained_value] == start_position, __func__, "a segment doesn't start with a record");
+    check(context.last_value == first_retained_value, __func__, "not restarted from the start position");
+    //the rest of the log, in order
+    while (log_batch_read(&log.header, log.buffer, &cursor, &on_message, 16, &context) != 0) {
+    }
+    check(context.last_value == RECORDS && context.received == RECORDS - first_retained_value + 1, __func__,
+          "not read until the tail");
+    check(cursor.position == load_acquire_tail_position(&log.header, log.buffer), __func__, "cursor not at the tail");
+    free(log.buffer);
+}
+
+static void test_seek_back(void) {
+    struct test_log log;
+    check(init_test_log(&log), __func__, "can't init");
+    struct log_cursor cursor;
+    init_log_cursor(&cursor, 0);
+    log_cursor_seek_to_tail(&log.header, log.buffer, &cursor);
+    struct test_consumer_context context = {0};
+    check(log_batch_read(&log.header, log.buffer, &cursor, &on_message, 16, &context) == 0, __func__,
+          "read past the tail");
+    //a position returned by log_append that is still retained
+    const uint64_t value = RECORDS - 10;
+    check(log.positions[value] >= load_acquire_start_position(&log.header, log.buffer), __func__,
+          "position not retained");
+    log_cursor_seek(&cursor, log.positions[value]);
+    check(log_batch_read(&log.header, log.buffer, &cursor, &on_message, 1, &context) == 1, __func__, "not read");
+    check(context.last_value == value, __func__, "wrong record after the seek");
+    check(log_cursor_lag(&log.header, log.buffer, &cursor) ==
+          load_acquire_tail_position(&log.header, log.buffer) - (log.positions[value] + 24), __func__, "wrong lag");
+    check(cursor.truncated_count == 0, __func__, "truncated on a retained position");
+    log_cursor_seek_to_start(&log.header, log.buffer, &cursor);
+    check(log_batch_read(&log.header, log.buffer, &cursor, &on_message, 1, &context) == 1, __func__,
+          "not read from the start");
+    check(cursor.truncated_count == 0, __func__, "truncated from the start");
+    free(log.buffer);
+}
+
+static void test_partition_keys(void) {
+    struct partitioned_log log;
+    struct partitioned_log same_log;
+    check(init_partitioned_log(&log, SEGMENT_CAPACITY, SEGMENT_COUNT, PARTITIONS) &&
+          init_partitioned_log(&same_log, SEGMENT_CAPACITY, SEGMENT_COUNT, PARTITIONS), __func__, "can't init");
+    uint32_t keys_per_partition[PARTITIONS] = {0};
+    for (uint64_t key = 0; key < KEYS; key++) {
+        const index_t partition = log_partition_of(&log, key);
+        check(partition >= 0 && partition < PARTITIONS, __func__, "partition out of range");
+        check(partition == log_partition_of(&log, key) && partition == log_partition_of(&same_log, key), __func__,
+              "key not mapped stably");
+        keys_per_partition[partition]++;
+    }
+    for (index_t partition = 0; partition < PARTITIONS; partition++) {
+        check(keys_per_partition[partition] != 0, __func__, "sequential keys not spread");
+    }
+    //each key is appended and read back from its own partition only
+    uint8_t *const buffer = allocate_zeroed(partitioned_log_length(SEGMENT_CAPACITY, SEGMENT_COUNT, PARTITIONS));
+    check(buffer != NULL, __func__, "can't allocate");
+    for (uint64_t key = 0; key < KEYS; key++) {
+        uint64_t position;
+        check(append(&log.header, log_partition(&log, buffer, log_partition_of(&log, key)), key, key, &position),
+              __func__, "can't append");
+    }
+    uint32_t received = 0;
+    for (index_t partition = 0; partition < PARTITIONS; partition++) {
+        struct log_cursor cursor;
+        init_log_cursor(&cursor, 0);
+        struct test_consumer_context context = {0};
+        while (log_batch_read(&log.header, log_partition(&log, buffer, partition), &cursor, &on_message, 1,
+                              &context) == 1) {
+            check(log_partition_of(&log, context.last_key) == partition, __func__, "key on the wrong partition");
+        }
+        received += context.received;
+    }
+    check(received == KEYS, __func__, "wrong records count");
+    free(buffer);
+}
+
+int main(int argc, char *argv[]) {
+    test_positions_across_segments();
+    test_lagging_cursor_truncated();
+    test_seek_back();
+    test_partition_keys();
+    if (failures != 0) {
+        fprintf(stderr, "%u checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
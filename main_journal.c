@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/user.h>
+#include "ring_buffer.h"
+#include "journal.h"
+
+#define DEFAULT_MSG_TYPE_ID 1
+#define DEFAULT_MSG_LENGTH 64
+#define SEGMENT_LENGTH (64 * 1024 * 1024)
+#define INDEX_INTERVAL 4096
+
+struct journal_test {
+    struct ring_buffer_header *header;
+    uint8_t *buffer;
+    struct journal *journal;
+    uint64_t messages;
+    enum idle_strategy_kind idle_strategy_kind;
+};
+
+static void *producer(void *arg) {
+    struct journal_test *test = (struct journal_test *) arg;
+    struct ring_buffer_header *header = test->header;
+    uint8_t *buffer = test->buffer;
+    const uint64_t messages = test->messages;
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, test->idle_strategy_kind);
+    uint64_t claimed_position = 0;
+    index_t claimed_index = 0;
+    for (uint64_t m = 0; m < messages; m++) {
+        uint64_t idles = 0;
+        ring_buffer_sp_claim(header, buffer, DEFAULT_MSG_LENGTH, &idle_strategy, &claimed_position, &claimed_index,
+                             &idles);
+        uint64_t *content_offset = (uint64_t *) (buffer + encoded_msg_offset(claimed_index));
+        *content_offset = m;
+        ring_buffer_commit(buffer, claimed_index, DEFAULT_MSG_TYPE_ID, DEFAULT_MSG_LENGTH);
+    }
+    return NULL;
+}
+
+static void *journaler(void *arg) {
+    struct journal_test *test = (struct journal_test *) arg;
+    const uint32_t batch_size = test->header->capacity / required_record_capacity(DEFAULT_MSG_LENGTH);
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, test->idle_strategy_kind);
+    uint64_t read_messages = 0;
+    while (read_messages < test->messages && !test->journal->failed) {
+        const uint32_t read = journal_drain(test->journal, test->header, test->buffer, batch_size);
+        read_messages += read;
+        idle_strategy_idle_work(&idle_strategy, read);
+    }
+    return NULL;
+}
+
+inline static bool on_replayed_message(const uint32_t msg_type_id, const uint8_t *buffer,
+                                       const index_t msg_content_index, const index_t msg_content_length,
+                                       void *context) {
+    uint64_t *expected_content = (uint64_t *) context;
+    const uint64_t *msg_content_address = (uint64_t *) (buffer + msg_content_index);
+    if (msg_type_id != DEFAULT_MSG_TYPE_ID || msg_content_length != DEFAULT_MSG_LENGTH ||
+        *msg_content_address != *expected_content) {
+        return false;
+    }
+    *expected_content = *expected_content + 1;
+    return true;
+}
+
+static uint64_t elapsed_nanos(const struct timespec *const start_time, const struct timespec *const end_time) {
+    return ((end_time->tv_sec - start_time->tv_sec) * 1000000000) + (end_time->tv_nsec - start_time->tv_nsec);
+}
+
+static void delete_journal(const struct journal *const journal, const uint64_t segment_count) {
+    char path[PATH_MAX];
+    for (uint64_t i = 0; i < segment_count; i++) {
+        if (journal_segment_path(journal, i, path)) {
+            unlink(path);
+        }
+    }
+    rmdir(journal->directory);
+}
+
+int main() {
+    const uint64_t messages = 20000000;
+    struct ring_buffer_header header;
+    const index_t buffer_capacity = ring_buffer_capacity(64 * 1024 * required_record_capacity(DEFAULT_MSG_LENGTH));
+    if (!init_ring_buffer_header(&header, buffer_capacity)) {
+        return 1;
+    }
+    uint8_t *buffer = aligned_alloc(PAGE_SIZE, buffer_capacity);
+    memset(buffer, 0, buffer_capacity);
+    char directory[] = "/tmp/franz_flow_journal_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        return 1;
+    }
+    struct journal journal;
+    if (!open_journal(&journal, directory, SEGMENT_LENGTH, JOURNAL_SYNC_NONE, INDEX_INTERVAL)) {
+        rmdir(directory);
+        return 1;
+    }
+    struct journal_test test;
+    test.header = &header;
+    test.buffer = buffer;
+    test.journal = &journal;
+    test.messages = messages;
+    test.idle_strategy_kind = IDLE_STRATEGY_PAUSE_SPIN;
+    struct timespec start_time;
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    pthread_t journaler_processor;
+    pthread_t producer_processor;
+    pthread_create(&journaler_processor, NULL, journaler, &test);
+    pthread_create(&producer_processor, NULL, producer, &test);
+    pthread_join(producer_processor, NULL);
+    pthread_join(journaler_processor, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    const uint64_t journal_bytes = journal.position;
+    const uint64_t journal_nanos = elapsed_nanos(&start_time, &end_time);
+    printf("journal:\t%ldM ops/sec %ld MB/sec on %ld segments\n", (messages * 1000L) / journal_nanos,
+           (journal_bytes * 1000L) / journal_nanos, journal.segment_count);
+
+    //the same bytes copied from the ring buffer on the anonymous memory, with no page already mapped
+    uint8_t *const copy = malloc(journal_bytes);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    for (uint64_t copied = 0; copied < journal_bytes; copied += header.capacity) {
+        const uint64_t remaining = journal_bytes - copied;
+        memcpy(copy + copied, buffer, remaining < header.capacity ? remaining : header.capacity);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    const uint64_t copy_nanos = elapsed_nanos(&start_time, &end_time);
+    printf("memcpy:\t\t%ld MB/sec\n", (journal_bytes * 1000L) / copy_nanos);
+    free(copy);
+
+    //replay from a sequence in the middle
+    const uint64_t from_sequence = messages / 2 + 1;
+    uint64_t position = 0;
+    uint64_t expected_content = from_sequence;
+    bool replayed = journal_seek(&journal, from_sequence, &position);
+    uint64_t replayed_messages = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    while (replayed && position < journal.position) {
+        const uint32_t read = journal_replay(&journal, position, &on_replayed_message, 4096, &expected_content,
+                                             &position);
+        replayed_messages += read;
+        replayed = read != 0 && expected_content == from_sequence + replayed_messages;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    const uint64_t replay_nanos = elapsed_nanos(&start_time, &end_time);
+    const uint64_t segment_count = journal.segment_count;
+    close_journal(&journal);
+    delete_journal(&journal, segment_count);
+    free(buffer);
+    if (!replayed || replayed_messages != messages - from_sequence) {
+        printf("replayed %ld messages instead of %ld!\n", replayed_messages, messages - from_sequence);
+        return 1;
+    }
+    printf("replay:\t\t%ldM ops/sec\n", (replayed_messages * 1000L) / replay_nanos);
+    return 0;
+}
@@ -14,6 +14,10 @@
 static const index_t RECORD_HEADER_LENGTH = sizeof(uint32_t) * 2;
 static const index_t RECORD_ALIGNMENT = sizeof(uint32_t) * 2;
 static const int32_t RECORD_PADDING_MSG_TYPE_ID = -1;
+/**
+ * The record length is stored on 32 bits whatever is the width of index_t.
+ */
+static const index_t RECORD_MAX_MSG_LENGTH = (INT32_MAX & ~(sizeof(uint32_t) * 2 - 1)) - sizeof(uint32_t) * 2;
 
 inline static index_t required_record_capacity(const index_t record_length){
     return align(record_length + RECORD_HEADER_LENGTH, RECORD_ALIGNMENT);
@@ -36,7 +40,11 @@ inline static uint64_t make_header(const int32_t msgTypeId, const index_t length
 }
 
 inline static index_t record_length(const uint64_t header) {
-    return (index_t) header;
+    return (index_t) (int32_t) header;
+}
+
+inline static index_t clamp_max_msg_length(const index_t max_msg_length) {
+    return max_msg_length < RECORD_MAX_MSG_LENGTH ? max_msg_length : RECORD_MAX_MSG_LENGTH;
 }
 
 inline static uint32_t message_type_id(const uint64_t header) {
@@ -0,0 +1,169 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_PERF_COUNTERS_H
+#define FRANZ_FLOW_PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+
+#endif
+
+/**
+ * Hardware counters of the calling thread, through perf_event_open: no libpfm or perf tool is required.
+ * Each counter is opened on its own, hence any of them can be missing (eg on a VM not exposing the PMU) and, if the
+ * PMU has not enough of them, the kernel multiplexes them: the values are scaled by the time they were counting.
+ * Only the user space is counted, as allowed by a perf_event_paranoid of 2.
+ */
+
+enum perf_counter_kind {
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_L1D_MISSES,
+    PERF_COUNTER_LLC_MISSES,
+    //loads served by a modified line in another core's cache: the cost of the false and the true sharing
+    PERF_COUNTER_HITM,
+    PERF_COUNTER_KINDS
+};
+
+static const char *const PERF_COUNTER_NAMES[] = {"cycles", "instructions", "l1d_misses", "llc_misses", "hitm", NULL};
+
+/**
+ * MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM (MEM_LOAD_UOPS_LLC_HIT_RETIRED.XSNP_HITM before Skylake): the same raw encoding
+ * on the Intel cores from Sandy Bridge on. There is no generic HITM event, hence other cpus need it explicitly.
+ */
+static const uint64_t PERF_COUNTER_INTEL_HITM_RAW_CONFIG = 0x04D2;
+
+struct perf_counters {
+    int fds[PERF_COUNTER_KINDS];
+};
+
+struct perf_counter_values {
+    bool available[PERF_COUNTER_KINDS];
+    uint64_t values[PERF_COUNTER_KINDS];
+};
+
+/**
+ * The raw config of the HITM event on this cpu or 0 if it isn't known.
+ */
+inline static uint64_t default_hitm_raw_config() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid(0, &eax, &ebx, &ecx, &edx) && ebx == 0x756e6547 && edx == 0x49656e69 && ecx == 0x6c65746e) {
+        //GenuineIntel
+        return PERF_COUNTER_INTEL_HITM_RAW_CONFIG;
+    }
+#endif
+    return 0;
+}
+
+inline static int open_perf_counter(const uint32_t type, const uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    //the calling thread on any cpu
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+inline static uint64_t perf_cache_config(const uint64_t cache, const uint64_t op, const uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+/**
+ * Opens the counters of the calling thread, disabled: hitm_raw_config 0 leaves the HITM counter out.
+ * Returns false if none of them can be opened.
+ */
+inline static bool open_perf_counters(struct perf_counters *const counters, const uint64_t hitm_raw_config) {
+    counters->fds[PERF_COUNTER_CYCLES] = open_perf_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters->fds[PERF_COUNTER_INSTRUCTIONS] = open_perf_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters->fds[PERF_COUNTER_L1D_MISSES] = open_perf_counter(
+            PERF_TYPE_HW_CACHE,
+            perf_cache_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    counters->fds[PERF_COUNTER_LLC_MISSES] = open_perf_counter(
+            PERF_TYPE_HW_CACHE,
+            perf_cache_config(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    counters->fds[PERF_COUNTER_HITM] = hitm_raw_config == 0 ? -1 : open_perf_counter(PERF_TYPE_RAW, hitm_raw_config);
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        if (counters->fds[i] >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline static void close_perf_counters(struct perf_counters *const counters) {
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        if (counters->fds[i] >= 0) {
+            close(counters->fds[i]);
+            counters->fds[i] = -1;
+        }
+    }
+}
+
+inline static void start_perf_counters(const struct perf_counters *const counters) {
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+inline static void stop_perf_counters(const struct perf_counters *const counters) {
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        if (counters->fds[i] >= 0) {
+            ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+inline static void reset_perf_counter_values(struct perf_counter_values *const values) {
+    memset(values, 0, sizeof(struct perf_counter_values));
+}
+
+inline static void
+read_perf_counters(const struct perf_counters *const counters, struct perf_counter_values *const values) {
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        //value, time enabled, time running
+        uint64_t read_values[3];
+        values->available[i] = counters->fds[i] >= 0 &&
+                               read(counters->fds[i], read_values, sizeof(read_values)) == sizeof(read_values) &&
+                               read_values[2] != 0;
+        if (!values->available[i]) {
+            values->values[i] = 0;
+        } else if (read_values[2] < read_values[1]) {
+            //multiplexed
+            values->values[i] = (uint64_t) (((double) read_values[0]) * read_values[1] / read_values[2]);
+        } else {
+            values->values[i] = read_values[0];
+        }
+    }
+}
+
+inline static void
+add_perf_counter_values(struct perf_counter_values *const values, const struct perf_counter_values *const other) {
+    for (int i = 0; i < PERF_COUNTER_KINDS; i++) {
+        if (other->available[i]) {
+            values->available[i] = true;
+            values->values[i] += other->values[i];
+        }
+    }
+}
+
+#endif //FRANZ_FLOW_PERF_COUNTERS_H
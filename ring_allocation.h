@@ -0,0 +1,199 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_RING_ALLOCATION_H
+#define FRANZ_FLOW_RING_ALLOCATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "index.h"
+#include "bytes_utils.h"
+
+/**
+ * Allocates the memory of a ring out of the heap, to choose its pages, its NUMA node and to pay the page faults
+ * before the first lap instead of during it.
+ */
+
+static const size_t RING_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+/**
+ * The memory policy constants of <numaif.h>: libnuma isn't required.
+ */
+static const int RING_MPOL_BIND = 2;
+static const unsigned RING_MPOL_MF_STRICT = 1;
+static const unsigned RING_MPOL_MF_MOVE = 1 << 1;
+
+enum ring_page_kind {
+    RING_PAGES_DEFAULT,
+    //transparent huge pages: best effort, the kernel could back the ring with base pages
+    RING_PAGES_TRANSPARENT_HUGE,
+    //explicit huge pages from the hugetlbfs pool: the allocation fails if the pool can't back the ring
+    RING_PAGES_HUGETLB
+};
+
+enum ring_numa_node {
+    //no binding: the pages land on the node of the first thread touching them
+    RING_NUMA_NODE_ANY = -2,
+    //the node of the calling thread ie the consumer's, if it is the consumer to allocate the ring
+    RING_NUMA_NODE_CURRENT = -1
+};
+
+struct ring_allocation_options {
+    enum ring_page_kind page_kind;
+    //RING_NUMA_NODE_ANY, RING_NUMA_NODE_CURRENT or a node id
+    int numa_node;
+    //touches every page, after the NUMA binding, to not have page faults on the first lap
+    bool prefault;
+    //locks the pages in memory: they can't be swapped out, but it is capped by RLIMIT_MEMLOCK
+    bool lock;
+};
+
+struct ring_allocation {
+    uint8_t *address;
+    size_t length;
+    size_t page_size;
+    uint8_t *buffer;
+    index_t buffer_length;
+    int numa_node;
+};
+
+inline static void init_ring_allocation_options(struct ring_allocation_options *const options) {
+    options->page_kind = RING_PAGES_DEFAULT;
+    options->numa_node = RING_NUMA_NODE_CURRENT;
+    options->prefault = true;
+    options->lock = false;
+}
+
+inline static int current_numa_node() {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+        return RING_NUMA_NODE_ANY;
+    }
+    return (int) node;
+}
+
+/**
+ * The node of a cpu, from its node<N> entry in sysfs: it doesn't need the calling thread to be pinned on it.
+ */
+inline static int cpu_numa_node(const int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *const cpu_dir = opendir(path);
+    if (cpu_dir == NULL) {
+        return RING_NUMA_NODE_ANY;
+    }
+    int numa_node = RING_NUMA_NODE_ANY;
+    const struct dirent *entry;
+    while (numa_node == RING_NUMA_NODE_ANY && (entry = readdir(cpu_dir)) != NULL) {
+        int node;
+        char tail;
+        if (sscanf(entry->d_name, "node%d%c", &node, &tail) == 1 && node >= 0) {
+            numa_node = node;
+        }
+    }
+    closedir(cpu_dir);
+    return numa_node;
+}
+
+inline static bool bind_numa_node(uint8_t *const address, const size_t length, const int numa_node) {
+    if (numa_node < 0 || numa_node >= (int) (sizeof(unsigned long) * 8)) {
+        return false;
+    }
+    const unsigned long node_mask = 1UL << numa_node;
+    //a kernel without NUMA support fails it, but then there is just one node anyway
+    return syscall(SYS_mbind, address, length, RING_MPOL_BIND, &node_mask, sizeof(node_mask) * 8,
+                   RING_MPOL_MF_STRICT | RING_MPOL_MF_MOVE) == 0;
+}
+
+inline static uint8_t *map_ring_pages(const size_t length, const enum ring_page_kind page_kind) {
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (page_kind == RING_PAGES_HUGETLB) {
+        void *const address = mmap(NULL, length, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        return address == MAP_FAILED ? NULL : (uint8_t *) address;
+    }
+    void *const address = mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (address == MAP_FAILED) {
+        return NULL;
+    }
+    if (page_kind == RING_PAGES_TRANSPARENT_HUGE) {
+        //just an hint: a system with THP disabled keeps the base pages
+        madvise(address, length, MADV_HUGEPAGE);
+    }
+    return (uint8_t *) address;
+}
+
+/**
+ * Allocates length bytes of zeroed memory aligned to the page size, as required by any ring.
+ */
+inline static bool
+allocate_ring(const index_t length, const struct ring_allocation_options *const options,
+              struct ring_allocation *const allocation) {
+    if (length <= 0) {
+        return false;
+    }
+    const size_t base_page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t page_size = options->page_kind == RING_PAGES_DEFAULT ? base_page_size : RING_HUGE_PAGE_SIZE;
+    const size_t mapped_length = (((size_t) length + page_size - 1) / page_size) * page_size;
+    //THP needs the ring aligned to the huge page size: a bigger mapping is trimmed around it
+    const size_t reserved_length = options->page_kind == RING_PAGES_TRANSPARENT_HUGE ? mapped_length + page_size :
+                                   mapped_length;
+    uint8_t *const reserved = map_ring_pages(reserved_length, options->page_kind);
+    if (reserved == NULL) {
+        return false;
+    }
+    uint8_t *address = reserved;
+    if (reserved_length != mapped_length) {
+        address = (uint8_t *) ((((uintptr_t) reserved) + page_size - 1) & ~(page_size - 1));
+        const size_t head_length = address - reserved;
+        const size_t tail_length = reserved_length - head_length - mapped_length;
+        if (head_length != 0) {
+            munmap(reserved, head_length);
+        }
+        if (tail_length != 0) {
+            munmap(address + mapped_length, tail_length);
+        }
+        madvise(address, mapped_length, MADV_HUGEPAGE);
+    }
+    int numa_node = options->numa_node == RING_NUMA_NODE_CURRENT ? current_numa_node() : options->numa_node;
+    if (numa_node != RING_NUMA_NODE_ANY && !bind_numa_node(address, mapped_length, numa_node)) {
+        numa_node = RING_NUMA_NODE_ANY;
+    }
+    if (options->prefault) {
+        //a write per page: a read would map the shared zero page instead
+        for (size_t offset = 0; offset < mapped_length; offset += base_page_size) {
+            ((volatile uint8_t *) address)[offset] = 0;
+        }
+    }
+    if (options->lock && mlock(address, mapped_length) != 0) {
+        munmap(address, mapped_length);
+        return false;
+    }
+    //the positions in the trailers are accessed as 8 bytes atomics and are cache line aligned
+    if ((((uintptr_t) address) & (CACHE_LINE_LENGTH - 1)) != 0) {
+        munmap(address, mapped_length);
+        return false;
+    }
+    allocation->address = address;
+    allocation->length = mapped_length;
+    allocation->page_size = page_size;
+    allocation->buffer = address;
+    allocation->buffer_length = length;
+    allocation->numa_node = numa_node;
+    return true;
+}
+
+inline static void free_ring(struct ring_allocation *const allocation) {
+    munmap(allocation->address, allocation->length);
+    allocation->address = NULL;
+    allocation->buffer = NULL;
+    allocation->length = 0;
+    allocation->buffer_length = 0;
+}
+
+#endif //FRANZ_FLOW_RING_ALLOCATION_H
@@ -7,10 +7,12 @@
 
 #include <stdint.h>
 #include <stdatomic.h>
+#include <string.h>
 #include "message_layout.h"
 #include "index.h"
 #include "bytes_utils.h"
 #include "ring_buffer_layout.h"
+#include "idle_strategy.h"
 
 inline static bool
 try_claim_when_full(const struct ring_buffer_header *const header, const uint8_t *const buffer, const uint64_t producer_position,
@@ -59,20 +61,19 @@ inline static bool try_claim_when_need_pad(const struct ring_buffer_header *cons
     return true;
 }
 
+/**
+ * Claims required_msg_capacity contiguous bytes, ie 1 or more aligned records with their headers.
+ */
 inline static bool
-try_ring_buffer_mp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
-                         const index_t required_capacity,
-                         uint64_t *const claimed_position, index_t *const claimed_index) {
-    if (required_capacity > header->max_msg_length) {
-        return false;
-    }
+try_mp_claim_capacity(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                      const index_t required_msg_capacity,
+                      uint64_t *const claimed_position, index_t *const claimed_index) {
     const index_t capacity = header->capacity;
     const index_t mask = capacity - 1;
     uint64_t consumer_position = load_consumer_cache_position(header, buffer);
     index_t padding = 0;
     uint64_t producer_position = 0;
     index_t producer_index = 0;
-    const index_t required_msg_capacity = required_record_capacity(required_capacity);
     producer_position = load_acquire_producer_position(header, buffer);
     do {
         //producer position is the last read every time: on the first iteration or due to a previous failed cas
@@ -80,7 +81,9 @@ try_ring_buffer_mp_claim(const struct ring_buffer_header *const header, const ui
         //the available capacity could be negative due to a stale/cached consumer_position value
         const int64_t available_capacity = (int64_t) capacity - size;
         if (required_msg_capacity > available_capacity) {
+            ring_stats_record_full_event(buffer, header->producer_stats_index, true);
             if (!try_claim_when_full(header, buffer, producer_position, required_msg_capacity, &consumer_position)) {
+                ring_stats_record_failed_claim(buffer, header->producer_stats_index, true);
                 return false;
             }
         }
@@ -91,12 +94,14 @@ try_ring_buffer_mp_claim(const struct ring_buffer_header *const header, const ui
         if (required_msg_capacity > bytes_until_end_of_buffer) {
             //need padding before claim the record...but there will be enough space from the start of the buffer?
             if (!try_claim_when_need_pad(header, buffer, required_msg_capacity, mask, &consumer_position)) {
+                ring_stats_record_failed_claim(buffer, header->producer_stats_index, true);
                 return false;
             }
             padding = bytes_until_end_of_buffer;
         }
     } while (!cas_release_producer_position(header, buffer, &producer_position,
                                             producer_position + required_msg_capacity + padding));
+    ring_stats_record_claim(buffer, header->producer_stats_index, true, padding != 0, padding);
     //the cas while succeed doesn't modify the producer_position local value
     if (padding != 0) {
         store_release_msg_header(buffer, producer_index, make_header(RECORD_PADDING_MSG_TYPE_ID, padding));
@@ -110,28 +115,41 @@ try_ring_buffer_mp_claim(const struct ring_buffer_header *const header, const ui
         const index_t msg_index = producer_index;
         *claimed_index = msg_index;
     }
+    store_claimed_msg_header(buffer, *claimed_index, required_msg_capacity);
     return true;
 }
 
-
 inline static bool
-try_ring_buffer_sp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+try_ring_buffer_mp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
                          const index_t required_capacity,
                          uint64_t *const claimed_position, index_t *const claimed_index) {
     if (required_capacity > header->max_msg_length) {
         return false;
     }
+    return try_mp_claim_capacity(header, buffer, required_record_capacity(required_capacity), claimed_position,
+                                 claimed_index);
+}
+
+
+/**
+ * Claims required_msg_capacity contiguous bytes, ie 1 or more aligned records with their headers.
+ */
+inline static bool
+try_sp_claim_capacity(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                      const index_t required_msg_capacity,
+                      uint64_t *const claimed_position, index_t *const claimed_index) {
     const index_t capacity = header->capacity;
     const index_t mask = capacity - 1;
     uint64_t consumer_position = load_consumer_cache_position(header, buffer);
     const uint64_t producer_position = load_producer_position(header, buffer);
-    const index_t required_msg_capacity = required_record_capacity(required_capacity);
     const int64_t size = producer_position - consumer_position;
     //the available capacity can't be negative due to a stale/cached consumer_position value,
     //because only one producer could progress the consumer!
     const int64_t available_capacity = (int64_t) capacity - size;
     if (required_msg_capacity > available_capacity) {
+        ring_stats_record_full_event(buffer, header->producer_stats_index, false);
         if (!try_claim_when_full(header, buffer, producer_position, required_msg_capacity, &consumer_position)) {
+            ring_stats_record_failed_claim(buffer, header->producer_stats_index, false);
             return false;
         }
     }
@@ -142,12 +160,14 @@ try_ring_buffer_sp_claim(const struct ring_buffer_header *const header, const ui
     if (required_msg_capacity > bytes_until_end_of_buffer) {
         //need padding before claim the record...but there will be enough space from the start of the buffer?
         if (!try_claim_when_need_pad(header, buffer, required_msg_capacity, mask, &consumer_position)) {
+            ring_stats_record_failed_claim(buffer, header->producer_stats_index, false);
             return false;
         }
         padding = bytes_until_end_of_buffer;
     }
     const uint64_t new_producer_position = producer_position + required_msg_capacity + padding;
     store_release_producer_position(header, buffer, new_producer_position);
+    ring_stats_record_claim(buffer, header->producer_stats_index, false, padding != 0, padding);
     if (padding != 0) {
         store_release_msg_header(buffer, producer_index, make_header(RECORD_PADDING_MSG_TYPE_ID, padding));
         const uint64_t msg_position = producer_position + padding;
@@ -160,9 +180,384 @@ try_ring_buffer_sp_claim(const struct ring_buffer_header *const header, const ui
         const index_t msg_index = producer_index;
         *claimed_index = msg_index;
     }
+    store_claimed_msg_header(buffer, *claimed_index, required_msg_capacity);
+    return true;
+}
+
+inline static bool
+try_ring_buffer_sp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                         const index_t required_capacity,
+                         uint64_t *const claimed_position, index_t *const claimed_index) {
+    if (required_capacity > header->max_msg_length) {
+        return false;
+    }
+    return try_sp_claim_capacity(header, buffer, required_record_capacity(required_capacity), claimed_position,
+                                 claimed_index);
+}
+
+
+/**
+ * Waits until the consumer has freed the bytes before claim_end_position: it never gives up, because a claim made
+ * with a fetch-add can't be undone.
+ */
+inline static void
+wait_consumer_position(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                       const uint64_t claim_end_position, struct idle_strategy *const idle_strategy) {
+    //the first lap doesn't need to wait any consumer
+    if (claim_end_position <= (uint64_t) header->capacity) {
+        return;
+    }
+    const uint64_t min_consumer_position = claim_end_position - header->capacity;
+    uint64_t consumer_position = load_consumer_cache_position(header, buffer);
+    if (consumer_position >= min_consumer_position) {
+        return;
+    }
+    while ((consumer_position = load_acquire_consumer_position(header, buffer)) < min_consumer_position) {
+        idle_strategy_idle(idle_strategy);
+    }
+    idle_strategy_reset(idle_strategy);
+    store_consumer_cache_position(header, buffer, consumer_position);
+}
+
+/**
+ * Claims required_msg_capacity contiguous bytes with a fetch-add on the producer position: a claim can't be undone
+ * nor retried on contention, then:
+ * - a claim that straddles the end of the buffer is turned into 2 padding records (one until the end of the buffer
+ *   and one from its start) and claimed again
+ * - the buffer being full is checked before the fetch-add, making the claim fail without any side effect, but
+ *   concurrent producers could over-claim past the checked capacity: who has over-claimed waits, idling on
+ *   idle_strategy, until the consumer frees the claimed bytes, that's at most the records concurrently claimed by the
+ *   other producers
+ * Hence it isn't a non-blocking try: it blocks for as long as the consumer doesn't free the over-claimed bytes, that
+ * is forever if the consumer is dead.
+ */
+inline static bool
+xadd_claim_capacity(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                    const index_t required_msg_capacity, struct idle_strategy *const idle_strategy,
+                    uint64_t *const claimed_position, index_t *const claimed_index) {
+    const index_t capacity = header->capacity;
+    const index_t mask = capacity - 1;
+    while (true) {
+        const uint64_t producer_position = load_acquire_producer_position(header, buffer);
+        uint64_t consumer_position = load_consumer_cache_position(header, buffer);
+        const int64_t size = producer_position - consumer_position;
+        const int64_t available_capacity = (int64_t) capacity - size;
+        if (required_msg_capacity > available_capacity) {
+            ring_stats_record_full_event(buffer, header->producer_stats_index, true);
+            if (!try_claim_when_full(header, buffer, producer_position, required_msg_capacity, &consumer_position)) {
+                ring_stats_record_failed_claim(buffer, header->producer_stats_index, true);
+                return false;
+            }
+        }
+        const uint64_t msg_position = fetch_add_release_producer_position(header, buffer, required_msg_capacity);
+        //the claimed bytes can be written only after the consumer has zeroed them
+        wait_consumer_position(header, buffer, msg_position + required_msg_capacity, idle_strategy);
+        const index_t msg_index = msg_position & mask;
+        const index_t bytes_until_end_of_buffer = capacity - msg_index;
+        if (required_msg_capacity <= bytes_until_end_of_buffer) {
+            ring_stats_record_claim(buffer, header->producer_stats_index, true, 0, 0);
+            *claimed_position = msg_position;
+            *claimed_index = msg_index;
+            store_claimed_msg_header(buffer, msg_index, required_msg_capacity);
+            return true;
+        }
+        //the padded claim isn't counted as a claim: it is claimed again
+        ring_stats_add(buffer, header->producer_stats_index, RING_STATS_PADDING_RECORDS_OFFSET, true, 2);
+        ring_stats_add(buffer, header->producer_stats_index, RING_STATS_PADDING_BYTES_OFFSET, true,
+                       required_msg_capacity);
+        //the consumer reads the padding at the end of the buffer first: store it last
+        store_release_msg_header(buffer, 0,
+                                 make_header(RECORD_PADDING_MSG_TYPE_ID,
+                                             required_msg_capacity - bytes_until_end_of_buffer));
+        store_release_msg_header(buffer, msg_index, make_header(RECORD_PADDING_MSG_TYPE_ID, bytes_until_end_of_buffer));
+    }
+}
+
+/**
+ * A single xadd claim attempt: it fails if the buffer is full, but it can block after claiming, see
+ * xadd_claim_capacity.
+ */
+inline static bool
+ring_buffer_xadd_claim_once(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                            const index_t required_capacity, struct idle_strategy *const idle_strategy,
+                            uint64_t *const claimed_position, index_t *const claimed_index) {
+    if (required_capacity > header->max_msg_length) {
+        return false;
+    }
+    return xadd_claim_capacity(header, buffer, required_record_capacity(required_capacity), idle_strategy,
+                               claimed_position, claimed_index);
+}
+
+
+/**
+ * A batch of contiguous records claimed with a single producer position update.
+ */
+struct ring_buffer_batch {
+    uint64_t position;
+    index_t index;
+    index_t length;
+    uint32_t count;
+};
+
+struct ring_buffer_batch_iterator {
+    index_t msg_index;
+    uint32_t remaining;
+};
+
+/**
+ * The records of a batch are contiguous: a batch that doesn't fit until the end of the buffer is claimed from its
+ * start, only when the consumer is past the batch length there. With the producer at index p, a batch longer than
+ * max(capacity - p, p) could never be claimed, even on an empty ring: half of the ring always fits either way.
+ */
+inline static index_t max_batch_capacity(const struct ring_buffer_header *const header) {
+    return header->capacity / 2;
+}
+
+inline static bool
+batch_required_capacity(const struct ring_buffer_header *const header, const index_t *const msg_lengths,
+                        const uint32_t count, index_t *const required_msg_capacity) {
+    if (count == 0) {
+        return false;
+    }
+    int64_t total_msg_capacity = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const index_t msg_length = msg_lengths[i];
+        if (msg_length > header->max_msg_length) {
+            return false;
+        }
+        total_msg_capacity += required_record_capacity(msg_length);
+    }
+    if (total_msg_capacity > max_batch_capacity(header)) {
+        return false;
+    }
+    *required_msg_capacity = (index_t) total_msg_capacity;
     return true;
 }
 
+inline static bool
+uniform_batch_required_capacity(const struct ring_buffer_header *const header, const index_t msg_length,
+                                const uint32_t count, index_t *const required_msg_capacity) {
+    if (count == 0 || msg_length > header->max_msg_length) {
+        return false;
+    }
+    const int64_t total_msg_capacity = (int64_t) required_record_capacity(msg_length) * count;
+    if (total_msg_capacity > max_batch_capacity(header)) {
+        return false;
+    }
+    *required_msg_capacity = (index_t) total_msg_capacity;
+    return true;
+}
+
+inline static void
+init_ring_buffer_batch(struct ring_buffer_batch *const batch, const uint64_t claimed_position,
+                       const index_t claimed_index, const index_t required_msg_capacity, const uint32_t count) {
+    batch->position = claimed_position;
+    batch->index = claimed_index;
+    batch->length = required_msg_capacity;
+    batch->count = count;
+}
+
+/**
+ * Claims count records of msg_lengths contents: if they don't fit until the end of the buffer, a single padding
+ * record is written and all of them are claimed from the start of the buffer.
+ */
+inline static bool
+try_ring_buffer_sp_batch_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                               const index_t *const msg_lengths, const uint32_t count,
+                               struct ring_buffer_batch *const batch) {
+    index_t required_msg_capacity;
+    if (!batch_required_capacity(header, msg_lengths, count, &required_msg_capacity)) {
+        return false;
+    }
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!try_sp_claim_capacity(header, buffer, required_msg_capacity, &claimed_position, &claimed_index)) {
+        return false;
+    }
+    init_ring_buffer_batch(batch, claimed_position, claimed_index, required_msg_capacity, count);
+    return true;
+}
+
+inline static bool
+try_ring_buffer_mp_batch_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                               const index_t *const msg_lengths, const uint32_t count,
+                               struct ring_buffer_batch *const batch) {
+    index_t required_msg_capacity;
+    if (!batch_required_capacity(header, msg_lengths, count, &required_msg_capacity)) {
+        return false;
+    }
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!try_mp_claim_capacity(header, buffer, required_msg_capacity, &claimed_position, &claimed_index)) {
+        return false;
+    }
+    init_ring_buffer_batch(batch, claimed_position, claimed_index, required_msg_capacity, count);
+    return true;
+}
+
+/**
+ * Same as ring_buffer_xadd_claim_once, for a batch: it can block after claiming.
+ */
+inline static bool
+ring_buffer_xadd_batch_claim_once(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                                  const index_t *const msg_lengths, const uint32_t count,
+                                  struct idle_strategy *const idle_strategy, struct ring_buffer_batch *const batch) {
+    index_t required_msg_capacity;
+    if (!batch_required_capacity(header, msg_lengths, count, &required_msg_capacity)) {
+        return false;
+    }
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!xadd_claim_capacity(header, buffer, required_msg_capacity, idle_strategy, &claimed_position,
+                             &claimed_index)) {
+        return false;
+    }
+    init_ring_buffer_batch(batch, claimed_position, claimed_index, required_msg_capacity, count);
+    return true;
+}
+
+/**
+ * Claims count records with the same msg_length content.
+ */
+inline static bool
+try_ring_buffer_sp_uniform_batch_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                                       const index_t msg_length, const uint32_t count,
+                                       struct ring_buffer_batch *const batch) {
+    index_t required_msg_capacity;
+    if (!uniform_batch_required_capacity(header, msg_length, count, &required_msg_capacity)) {
+        return false;
+    }
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!try_sp_claim_capacity(header, buffer, required_msg_capacity, &claimed_position, &claimed_index)) {
+        return false;
+    }
+    init_ring_buffer_batch(batch, claimed_position, claimed_index, required_msg_capacity, count);
+    return true;
+}
+
+inline static bool
+try_ring_buffer_mp_uniform_batch_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                                       const index_t msg_length, const uint32_t count,
+                                       struct ring_buffer_batch *const batch) {
+    index_t required_msg_capacity;
+    if (!uniform_batch_required_capacity(header, msg_length, count, &required_msg_capacity)) {
+        return false;
+    }
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!try_mp_claim_capacity(header, buffer, required_msg_capacity, &claimed_position, &claimed_index)) {
+        return false;
+    }
+    init_ring_buffer_batch(batch, claimed_position, claimed_index, required_msg_capacity, count);
+    return true;
+}
+
+/**
+ * Same as ring_buffer_xadd_claim_once, for count records with the same msg_length content: it can block after claiming.
+ */
+inline static bool
+ring_buffer_xadd_uniform_batch_claim_once(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                                          const index_t msg_length, const uint32_t count,
+                                          struct idle_strategy *const idle_strategy,
+                                          struct ring_buffer_batch *const batch) {
+    index_t required_msg_capacity;
+    if (!uniform_batch_required_capacity(header, msg_length, count, &required_msg_capacity)) {
+        return false;
+    }
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!xadd_claim_capacity(header, buffer, required_msg_capacity, idle_strategy, &claimed_position,
+                             &claimed_index)) {
+        return false;
+    }
+    init_ring_buffer_batch(batch, claimed_position, claimed_index, required_msg_capacity, count);
+    return true;
+}
+
+inline static void
+ring_buffer_batch_iterator_init(const struct ring_buffer_batch *const batch,
+                                struct ring_buffer_batch_iterator *const iterator) {
+    iterator->msg_index = batch->index;
+    iterator->remaining = batch->count;
+}
+
+/**
+ * Provides the index of the next claimed record: msg_length must be the same used to claim it.
+ */
+inline static bool
+ring_buffer_batch_iterator_next(struct ring_buffer_batch_iterator *const iterator, const index_t msg_length,
+                                index_t *const msg_index) {
+    if (iterator->remaining == 0) {
+        return false;
+    }
+    *msg_index = iterator->msg_index;
+    iterator->msg_index += required_record_capacity(msg_length);
+    iterator->remaining--;
+    return true;
+}
+
+
+inline static bool
+ring_buffer_sp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                     const index_t required_capacity, struct idle_strategy *const idle_strategy,
+                     uint64_t *const claimed_position, index_t *const claimed_index, uint64_t *const idles) {
+    //a claim bigger than the max message length will never succeed
+    if (required_capacity > header->max_msg_length) {
+        return false;
+    }
+    uint64_t idle_count = 0;
+    while (!try_ring_buffer_sp_claim(header, buffer, required_capacity, claimed_position, claimed_index)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return true;
+}
+
+inline static bool
+ring_buffer_mp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                     const index_t required_capacity, struct idle_strategy *const idle_strategy,
+                     uint64_t *const claimed_position, index_t *const claimed_index, uint64_t *const idles) {
+    //a claim bigger than the max message length will never succeed
+    if (required_capacity > header->max_msg_length) {
+        return false;
+    }
+    uint64_t idle_count = 0;
+    while (!try_ring_buffer_mp_claim(header, buffer, required_capacity, claimed_position, claimed_index)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return true;
+}
+
+inline static bool
+ring_buffer_xadd_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                       const index_t required_capacity, struct idle_strategy *const idle_strategy,
+                       uint64_t *const claimed_position, index_t *const claimed_index, uint64_t *const idles) {
+    //a claim bigger than the max message length will never succeed
+    if (required_capacity > header->max_msg_length) {
+        return false;
+    }
+    uint64_t idle_count = 0;
+    while (!ring_buffer_xadd_claim_once(header, buffer, required_capacity, idle_strategy, claimed_position,
+                                        claimed_index)) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return true;
+}
 
 inline static bool
 ring_buffer_commit(const uint8_t *const buffer, const index_t msg_index, const uint32_t msg_type_id,
@@ -175,19 +570,59 @@ ring_buffer_commit(const uint8_t *const buffer, const index_t msg_index, const u
     return true;
 }
 
+/**
+ * Publishes all the records of the batch: the first header is the last one to be stored with release semantic,
+ * hence the consumer, that reads them in order, will find all of them committed.
+ */
+inline static bool
+ring_buffer_batch_commit(const uint8_t *const buffer, const struct ring_buffer_batch *const batch,
+                         const uint32_t *const msg_type_ids, const index_t *const msg_lengths) {
+    const uint32_t count = batch->count;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!check_msg_type_id(msg_type_ids[i])) {
+            return false;
+        }
+    }
+    index_t msg_index = batch->index + required_record_capacity(msg_lengths[0]);
+    for (uint32_t i = 1; i < count; i++) {
+        const index_t msg_length = msg_lengths[i];
+        store_msg_header(buffer, msg_index, make_header(msg_type_ids[i], msg_length + RECORD_HEADER_LENGTH));
+        msg_index += required_record_capacity(msg_length);
+    }
+    store_release_msg_header(buffer, batch->index, make_header(msg_type_ids[0], msg_lengths[0] + RECORD_HEADER_LENGTH));
+    return true;
+}
+
+inline static bool
+ring_buffer_uniform_batch_commit(const uint8_t *const buffer, const struct ring_buffer_batch *const batch,
+                                 const uint32_t msg_type_id, const index_t msg_length) {
+    if (!check_msg_type_id(msg_type_id)) {
+        return false;
+    }
+    const uint64_t msg_header = make_header(msg_type_id, msg_length + RECORD_HEADER_LENGTH);
+    const index_t required_msg_capacity = required_record_capacity(msg_length);
+    const index_t end_index = batch->index + batch->length;
+    for (index_t msg_index = batch->index + required_msg_capacity; msg_index < end_index;
+         msg_index += required_msg_capacity) {
+        store_msg_header(buffer, msg_index, msg_header);
+    }
+    store_release_msg_header(buffer, batch->index, msg_header);
+    return true;
+}
+
 //declare a const pointer to a function with this signature
 typedef bool(*const message_consumer)(const uint32_t, const uint8_t *const,
                                       const index_t,
                                       const index_t, void *const);
 
-inline static uint32_t ring_buffer_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
-                                              const message_consumer consumer,
-                                              const uint32_t count, void *context) {
+/**
+ * Reads up to count records from consumer_index, without crossing the end of the buffer, and returns the consumed
+ * bytes, padding included: neither zeroes them nor moves the consumer position.
+ */
+inline static index_t read_records(uint8_t *const buffer, const index_t consumer_index, const index_t remaining_bytes,
+                                   const message_consumer consumer, const uint32_t count, void *context,
+                                   uint32_t *const read) {
     uint32_t msg_read = 0;
-    const uint64_t consumer_position = load_consumer_position(header, buffer);
-    const index_t capacity = header->capacity;
-    const index_t consumer_index = consumer_position & (capacity - 1);
-    const uint32_t remaining_bytes = capacity - consumer_index;
     index_t bytes_consumed = 0;
     bool stop = false;
     while (!stop && (bytes_consumed < remaining_bytes) && (msg_read < count)) {
@@ -195,7 +630,7 @@ inline static uint32_t ring_buffer_batch_read(const struct ring_buffer_header *c
         const uint64_t msg_header = load_acquire_msg_header(buffer, msg_index);
         const index_t msg_length = record_length(msg_header);
         if (msg_length <= 0) {
-            //backpressured -> need a special return value?
+            //not committed yet: a consumer applying backpressure needs ring_buffer_controlled_read instead
             stop = true;
         } else {
             const index_t required_msg_length = align(msg_length, RECORD_ALIGNMENT);
@@ -209,7 +644,23 @@ inline static uint32_t ring_buffer_batch_read(const struct ring_buffer_header *c
             }
         }
     }
+    *read = msg_read;
+    return bytes_consumed;
+}
+
+inline static uint32_t ring_buffer_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                                              const message_consumer consumer,
+                                              const uint32_t count, void *context) {
+    uint32_t msg_read = 0;
+    const uint64_t consumer_position = load_consumer_position(header, buffer);
+    const index_t capacity = header->capacity;
+    const index_t consumer_index = consumer_position & (capacity - 1);
+    const index_t remaining_bytes = capacity - consumer_index;
+    const index_t bytes_consumed = read_records(buffer, consumer_index, remaining_bytes, consumer, count, context,
+                                                &msg_read);
     if (bytes_consumed != 0) {
+        ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index,
+                               consumer_position, msg_read, bytes_consumed);
         //zeroes all the consumed bytes
         void *consumer_start_offset = buffer + consumer_index;
         memset(consumer_start_offset, 0, bytes_consumed);
@@ -219,6 +670,379 @@ inline static uint32_t ring_buffer_batch_read(const struct ring_buffer_header *c
     return msg_read;
 }
 
+/**
+ * Same as ring_buffer_batch_read, but zeroes the consumed bytes with streaming stores: they don't pollute the
+ * consumer's cache nor need to be read for ownership, but the producer will miss them in its cache on the next lap.
+ * It pays off with big records or rings bigger than the caches.
+ */
+inline static uint32_t ring_buffer_nt_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                                                 const message_consumer consumer,
+                                                 const uint32_t count, void *context) {
+    uint32_t msg_read = 0;
+    const uint64_t consumer_position = load_consumer_position(header, buffer);
+    const index_t capacity = header->capacity;
+    const index_t consumer_index = consumer_position & (capacity - 1);
+    const index_t remaining_bytes = capacity - consumer_index;
+    const index_t bytes_consumed = read_records(buffer, consumer_index, remaining_bytes, consumer, count, context,
+                                                &msg_read);
+    if (bytes_consumed != 0) {
+        ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index,
+                               consumer_position, msg_read, bytes_consumed);
+        //fenced: the zeroes are visible before the new consumer position
+        non_temporal_zero(buffer + consumer_index, bytes_consumed);
+        const uint64_t new_consumer_position = consumer_position + bytes_consumed;
+        store_release_consumer_position(header, buffer, new_consumer_position);
+    }
+    return msg_read;
+}
+
+/**
+ * State of a consumer that zeroes and releases the consumed bytes a chunk at time.
+ */
+struct ring_buffer_chunked_reader {
+    //the consumer position is behind it by the read bytes not released yet
+    uint64_t read_position;
+    index_t chunk_length;
+};
+
+/**
+ * chunk_length must be a power of 2 not bigger than the capacity: the chunks can't straddle the end of the buffer.
+ */
+inline static bool
+init_ring_buffer_chunked_reader(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                                const index_t chunk_length, struct ring_buffer_chunked_reader *const reader) {
+    if (!is_pow_2(chunk_length) || chunk_length > header->capacity || chunk_length < RECORD_ALIGNMENT) {
+        return false;
+    }
+    reader->read_position = load_consumer_position(header, buffer);
+    reader->chunk_length = chunk_length;
+    return true;
+}
+
+inline static void
+release_consumed_bytes(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                       const uint64_t consumer_position, const uint64_t new_consumer_position) {
+    const index_t capacity = header->capacity;
+    const index_t consumer_index = consumer_position & (capacity - 1);
+    const index_t length = (index_t) (new_consumer_position - consumer_position);
+    const index_t bytes_until_end_of_buffer = capacity - consumer_index;
+    if (length <= bytes_until_end_of_buffer) {
+        memset(buffer + consumer_index, 0, length);
+    } else {
+        memset(buffer + consumer_index, 0, bytes_until_end_of_buffer);
+        memset(buffer, 0, length - bytes_until_end_of_buffer);
+    }
+    store_release_consumer_position(header, buffer, new_consumer_position);
+}
+
+/**
+ * Same as ring_buffer_batch_read, but the consumed bytes are zeroed and released to the producers only when a
+ * whole chunk has been read, with a single memset and consumer position update per chunk, or when there is nothing
+ * to read, to not keep the producers waiting: the producers see a ring up to chunk_length bytes smaller.
+ */
+inline static uint32_t
+ring_buffer_chunked_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                               struct ring_buffer_chunked_reader *const reader, const message_consumer consumer,
+                               const uint32_t count, void *context) {
+    uint32_t msg_read = 0;
+    const uint64_t read_position = reader->read_position;
+    const index_t capacity = header->capacity;
+    const index_t read_index = read_position & (capacity - 1);
+    const index_t remaining_bytes = capacity - read_index;
+    const index_t bytes_consumed = read_records(buffer, read_index, remaining_bytes, consumer, count, context,
+                                                &msg_read);
+    const uint64_t consumer_position = load_consumer_position(header, buffer);
+    if (bytes_consumed == 0) {
+        if (consumer_position != read_position) {
+            release_consumed_bytes(header, buffer, consumer_position, read_position);
+        }
+        return 0;
+    }
+    ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index, read_position,
+                           msg_read, bytes_consumed);
+    const uint64_t new_read_position = read_position + bytes_consumed;
+    reader->read_position = new_read_position;
+    const uint64_t chunk_position = new_read_position & ~((uint64_t) reader->chunk_length - 1);
+    if (chunk_position > consumer_position) {
+        release_consumed_bytes(header, buffer, consumer_position, chunk_position);
+    }
+    return msg_read;
+}
+
+/**
+ * What a controlled consumer does with the record it has got:
+ * - ABORT: leaves it unconsumed, with the ones after it, and stops the read: it will be read again
+ * - BREAK: consumes it and stops the read
+ * - COMMIT: consumes it and releases it, with all the ones read before, to the producers right away
+ * - CONTINUE: consumes it and goes on, releasing it at the end of the read
+ */
+enum controlled_read_action {
+    CONTROLLED_READ_ABORT,
+    CONTROLLED_READ_BREAK,
+    CONTROLLED_READ_COMMIT,
+    CONTROLLED_READ_CONTINUE
+};
+
+enum controlled_read_status {
+    //there was nothing to read
+    CONTROLLED_READ_EMPTY,
+    //has read count records or all the available ones
+    CONTROLLED_READ_COMPLETED,
+    //stopped by a BREAK
+    CONTROLLED_READ_BROKEN,
+    //stopped by an ABORT: the consumer has applied backpressure
+    CONTROLLED_READ_BACKPRESSURED
+};
+
+//declare a const pointer to a function with this signature
+typedef enum controlled_read_action(*const controlled_message_consumer)(const uint32_t, const uint8_t *const,
+                                                                        const index_t,
+                                                                        const index_t, void *const);
+
+/**
+ * Same as ring_buffer_batch_read, but the consumer decides what to do with each record (see controlled_read_action):
+ * read is set to the consumed records, the aborted one excluded.
+ */
+inline static enum controlled_read_status
+ring_buffer_controlled_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                            const controlled_message_consumer consumer, const uint32_t count, void *context,
+                            uint32_t *const read) {
+    const uint64_t consumer_position = load_consumer_position(header, buffer);
+    const index_t capacity = header->capacity;
+    const index_t consumer_index = consumer_position & (capacity - 1);
+    const index_t remaining_bytes = capacity - consumer_index;
+    enum controlled_read_status status = CONTROLLED_READ_COMPLETED;
+    uint32_t msg_read = 0;
+    index_t bytes_consumed = 0;
+    //the bytes until there are already released
+    index_t bytes_committed = 0;
+    bool stop = false;
+    while (!stop && (bytes_consumed < remaining_bytes) && (msg_read < count)) {
+        const index_t msg_index = consumer_index + bytes_consumed;
+        const uint64_t msg_header = load_acquire_msg_header(buffer, msg_index);
+        const index_t msg_length = record_length(msg_header);
+        if (msg_length <= 0) {
+            stop = true;
+        } else {
+            const index_t required_msg_length = align(msg_length, RECORD_ALIGNMENT);
+            const uint32_t msg_type_id = message_type_id(msg_header);
+            if (msg_type_id == RECORD_PADDING_MSG_TYPE_ID) {
+                bytes_consumed += required_msg_length;
+            } else {
+                const enum controlled_read_action action = consumer(msg_type_id, buffer,
+                                                                    msg_index + RECORD_HEADER_LENGTH,
+                                                                    msg_length - RECORD_HEADER_LENGTH, context);
+                if (action == CONTROLLED_READ_ABORT) {
+                    status = CONTROLLED_READ_BACKPRESSURED;
+                    stop = true;
+                } else {
+                    msg_read++;
+                    bytes_consumed += required_msg_length;
+                    if (action == CONTROLLED_READ_BREAK) {
+                        status = CONTROLLED_READ_BROKEN;
+                        stop = true;
+                    } else if (action == CONTROLLED_READ_COMMIT) {
+                        release_consumed_bytes(header, buffer, consumer_position + bytes_committed,
+                                               consumer_position + bytes_consumed);
+                        bytes_committed = bytes_consumed;
+                    }
+                }
+            }
+        }
+    }
+    if (bytes_consumed != 0) {
+        ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index,
+                               consumer_position, msg_read, bytes_consumed);
+        if (bytes_consumed != bytes_committed) {
+            release_consumed_bytes(header, buffer, consumer_position + bytes_committed,
+                                   consumer_position + bytes_consumed);
+        }
+    }
+    *read = msg_read;
+    //a padding record alone doesn't make the ring not empty
+    return msg_read == 0 && status == CONTROLLED_READ_COMPLETED ? CONTROLLED_READ_EMPTY : status;
+}
+
+/**
+ * Waits until at least one message is read.
+ */
+inline static uint32_t
+ring_buffer_blocking_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                                const message_consumer consumer, const uint32_t count, void *context,
+                                struct idle_strategy *const idle_strategy, uint64_t *const idles) {
+    uint64_t idle_count = 0;
+    uint32_t msg_read;
+    while ((msg_read = ring_buffer_batch_read(header, buffer, consumer, count, context)) == 0) {
+        idle_strategy_idle(idle_strategy);
+        idle_count++;
+    }
+    if (idle_count != 0) {
+        idle_strategy_reset(idle_strategy);
+    }
+    *idles = idle_count;
+    return msg_read;
+}
+
+/**
+ * The index of the first not zeroed header in [from_index, to_index), or to_index if there isn't any.
+ */
+inline static index_t
+next_msg_header_index(const uint8_t *const buffer, const index_t from_index, const index_t to_index) {
+    index_t msg_index = from_index;
+    while (msg_index < to_index && load_acquire_msg_header(buffer, msg_index) == 0) {
+        msg_index += RECORD_ALIGNMENT;
+    }
+    return msg_index;
+}
+
+/**
+ * Checks again, backward, that the headers in [from_index, to_index) are zeroed: a producer could have marked or
+ * committed a record behind a forward scan meanwhile.
+ */
+inline static bool
+zeroed_msg_headers(const uint8_t *const buffer, const index_t from_index, const index_t to_index) {
+    for (index_t msg_index = to_index - RECORD_ALIGNMENT; msg_index >= from_index; msg_index -= RECORD_ALIGNMENT) {
+        if (load_acquire_msg_header(buffer, msg_index) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Turns the unmarked claim at msg_index into a padding record until end_index.
+ */
+inline static bool
+pad_unmarked_claim(const struct ring_buffer_header *const header, uint8_t *const buffer, const index_t msg_index,
+                   const index_t end_index) {
+    if (!zeroed_msg_headers(buffer, msg_index + RECORD_ALIGNMENT, end_index)) {
+        return false;
+    }
+    const index_t padding = end_index - msg_index;
+    if (!cas_msg_header(buffer, msg_index, 0, make_header(RECORD_PADDING_MSG_TYPE_ID, padding))) {
+        return false;
+    }
+    ring_stats_record_lost(buffer, header->consumer_stats_index, padding);
+    return true;
+}
+
+/**
+ * Turns the claim the consumer is stopped on into a padding record, if it is in progress or not claimed yet but
+ * followed by other records, hence the consumer can move past a producer died (or stalled) between claim and
+ * commit. Returns true if the ring has been unblocked, counting the lost record in the trailer (see ring_stats.h).
+ * The consumer can't tell a dead producer from a slow one: it must be called only after the consumer has been stuck
+ * on the same position for longer than any producer can take to commit (see ring_buffer_stall_detector), because a
+ * producer committing after it would corrupt the ring.
+ * An unmarked claim followed only by other claims in progress or by nothing can't be unblocked, because its length
+ * is unknown: it will be after the next commit.
+ * An unmarked claim that straddles the end of the buffer (ie a producer died right after moving the producer position)
+ * has neither its padding at the end nor its header at the start of the buffer: both are turned into padding records.
+ */
+inline static bool ring_buffer_unblock(const struct ring_buffer_header *const header, uint8_t *const buffer) {
+    const index_t capacity = header->capacity;
+    const index_t mask = capacity - 1;
+    const uint64_t consumer_position = load_acquire_consumer_position(header, buffer);
+    const uint64_t producer_position = load_acquire_producer_position(header, buffer);
+    if (producer_position == consumer_position) {
+        return false;
+    }
+    const index_t consumer_index = consumer_position & mask;
+    const uint64_t msg_header = load_acquire_msg_header(buffer, consumer_index);
+    const index_t msg_length = record_length(msg_header);
+    if (msg_length > 0) {
+        //committed: the consumer isn't blocked
+        return false;
+    }
+    if (msg_length < 0) {
+        if (!cas_msg_header(buffer, consumer_index, msg_header, make_header(RECORD_PADDING_MSG_TYPE_ID, -msg_length))) {
+            return false;
+        }
+        ring_stats_record_lost(buffer, header->consumer_stats_index, -msg_length);
+        return true;
+    }
+    //not marked: its length is up to the next record, that can be at the start of the buffer too
+    const index_t bytes_until_end_of_buffer = capacity - consumer_index;
+    const bool wrapped = producer_position - consumer_position > (uint64_t) bytes_until_end_of_buffer;
+    const index_t limit = wrapped ? capacity : (index_t) (producer_position & mask);
+    const index_t next_msg_index = next_msg_header_index(buffer, consumer_index + RECORD_ALIGNMENT, limit);
+    if (next_msg_index != limit) {
+        return pad_unmarked_claim(header, buffer, consumer_index, next_msg_index);
+    }
+    if (!wrapped) {
+        return false;
+    }
+    const index_t producer_index = producer_position & mask;
+    const index_t wrapped_msg_index = next_msg_header_index(buffer, 0, producer_index);
+    if (wrapped_msg_index == 0) {
+        //the start of the buffer is a record or a claim of its own
+        return pad_unmarked_claim(header, buffer, consumer_index, capacity);
+    }
+    if (wrapped_msg_index == producer_index ||
+        !zeroed_msg_headers(buffer, consumer_index + RECORD_ALIGNMENT, capacity) ||
+        !zeroed_msg_headers(buffer, RECORD_ALIGNMENT, wrapped_msg_index)) {
+        return false;
+    }
+    //the consumer reads the padding at the end of the buffer first: store it last
+    const uint64_t wrapped_padding_header = make_header(RECORD_PADDING_MSG_TYPE_ID, wrapped_msg_index);
+    if (!cas_msg_header(buffer, 0, 0, wrapped_padding_header)) {
+        return false;
+    }
+    if (!cas_msg_header(buffer, consumer_index, 0,
+                        make_header(RECORD_PADDING_MSG_TYPE_ID, bytes_until_end_of_buffer))) {
+        //a producer has marked or committed the claim meanwhile: the start of the buffer is its own
+        cas_msg_header(buffer, 0, wrapped_padding_header, 0);
+        return false;
+    }
+    ring_stats_record_lost(buffer, header->consumer_stats_index, bytes_until_end_of_buffer + wrapped_msg_index);
+    return true;
+}
+
+/**
+ * Consumer side detection of a ring stuck on a claim never committed.
+ */
+struct ring_buffer_stall_detector {
+    uint64_t timeout_nanos;
+    //the consumer position the consumer is stuck on, since stalled_since_nanos
+    uint64_t stalled_position;
+    uint64_t stalled_since_nanos;
+    bool stalled;
+};
+
+inline static void
+init_ring_buffer_stall_detector(struct ring_buffer_stall_detector *const detector, const uint64_t timeout_nanos) {
+    detector->timeout_nanos = timeout_nanos;
+    detector->stalled_position = 0;
+    detector->stalled_since_nanos = 0;
+    detector->stalled = false;
+}
+
+/**
+ * To be called by the consumer after a read that has found nothing, with the current time in nanos: unblocks the
+ * ring if the consumer has been stuck on the same position, with records claimed after it, for timeout_nanos.
+ * Returns true if the ring has been unblocked.
+ */
+inline static bool
+ring_buffer_check_stall(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                        struct ring_buffer_stall_detector *const detector, const uint64_t now_nanos) {
+    const uint64_t consumer_position = load_consumer_position(header, buffer);
+    if (load_acquire_producer_position(header, buffer) == consumer_position) {
+        detector->stalled = false;
+        return false;
+    }
+    if (!detector->stalled || detector->stalled_position != consumer_position) {
+        detector->stalled = true;
+        detector->stalled_position = consumer_position;
+        detector->stalled_since_nanos = now_nanos;
+        return false;
+    }
+    if (now_nanos - detector->stalled_since_nanos < detector->timeout_nanos) {
+        return false;
+    }
+    //on failure it waits for another timeout before retrying
+    detector->stalled_since_nanos = now_nanos;
+    return ring_buffer_unblock(header, buffer);
+}
+
 inline static index_t ring_buffer_size(const struct ring_buffer_header *const header, const uint8_t *const buffer) {
     uint64_t previousConsumerPosition;
     uint64_t producerPosition;
@@ -0,0 +1,178 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_RING_BUFFER_DISPATCH_H
+#define FRANZ_FLOW_RING_BUFFER_DISPATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "index.h"
+#include "message_layout.h"
+#include "ring_buffer.h"
+
+/**
+ * Dispatch of the records of a ring_buffer to a handler per msg_type_id, instead of a single consumer switching on it
+ * behind a function pointer:
+ * - a message_dispatch_table is a dense jump table indexed by msg_type_id, filled at runtime
+ * - DEFINE_RING_BUFFER_SWITCH_BATCH_READ generates a batch read with the handlers inlined in a switch, for the msg
+ *   type ids known at compile time
+ * On both the records without a handler go to a fallback handler.
+ * The handlers are message_consumer functions: they get the msg_type_id too, hence one of them can serve many.
+ */
+
+//the msg type ids of a table are in [1, MESSAGE_DISPATCH_TABLE_SIZE): the bigger ones go to the fallback
+#define MESSAGE_DISPATCH_TABLE_SIZE 64
+
+//a message_consumer that can be stored
+typedef bool(*message_handler)(const uint32_t, const uint8_t *const,
+                               const index_t,
+                               const index_t, void *const);
+
+struct message_dispatch_table {
+    message_handler fallback;
+    //the unregistered ids point to the fallback: the lookup has no null checks
+    message_handler handlers[MESSAGE_DISPATCH_TABLE_SIZE];
+};
+
+inline static void
+init_message_dispatch_table(struct message_dispatch_table *const table, const message_handler fallback) {
+    table->fallback = fallback;
+    for (uint32_t i = 0; i < MESSAGE_DISPATCH_TABLE_SIZE; i++) {
+        table->handlers[i] = fallback;
+    }
+}
+
+/**
+ * Returns false if msg_type_id isn't valid or doesn't fit the table.
+ */
+inline static bool
+message_dispatch_table_register(struct message_dispatch_table *const table, const int32_t msg_type_id,
+                                const message_handler handler) {
+    if (!check_msg_type_id(msg_type_id) || msg_type_id >= MESSAGE_DISPATCH_TABLE_SIZE) {
+        return false;
+    }
+    table->handlers[msg_type_id] = handler;
+    return true;
+}
+
+inline static message_handler
+message_dispatch_table_handler(const struct message_dispatch_table *const table, const uint32_t msg_type_id) {
+    return msg_type_id < MESSAGE_DISPATCH_TABLE_SIZE ? table->handlers[msg_type_id] : table->fallback;
+}
+
+/**
+ * Same as read_records, but each record goes to the handler of its msg_type_id: a single indirect branch per record.
+ */
+inline static index_t
+read_dispatched_records(uint8_t *const buffer, const index_t consumer_index, const index_t remaining_bytes,
+                        const struct message_dispatch_table *const table, const uint32_t count, void *context,
+                        uint32_t *const read) {
+    uint32_t msg_read = 0;
+    index_t bytes_consumed = 0;
+    bool stop = false;
+    while (!stop && (bytes_consumed < remaining_bytes) && (msg_read < count)) {
+        const index_t msg_index = consumer_index + bytes_consumed;
+        const uint64_t msg_header = load_acquire_msg_header(buffer, msg_index);
+        const index_t msg_length = record_length(msg_header);
+        if (msg_length <= 0) {
+            stop = true;
+        } else {
+            bytes_consumed += align(msg_length, RECORD_ALIGNMENT);
+            const uint32_t msg_type_id = message_type_id(msg_header);
+            if (msg_type_id != RECORD_PADDING_MSG_TYPE_ID) {
+                msg_read++;
+                const message_handler handler = message_dispatch_table_handler(table, msg_type_id);
+                stop = !handler(msg_type_id, buffer, msg_index + RECORD_HEADER_LENGTH,
+                                msg_length - RECORD_HEADER_LENGTH, context);
+            }
+        }
+    }
+    *read = msg_read;
+    return bytes_consumed;
+}
+
+/**
+ * Same as ring_buffer_batch_read, dispatching each record through table.
+ */
+inline static uint32_t
+ring_buffer_dispatch_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                                const struct message_dispatch_table *const table, const uint32_t count,
+                                void *context) {
+    uint32_t msg_read = 0;
+    const uint64_t consumer_position = load_consumer_position(header, buffer);
+    const index_t capacity = header->capacity;
+    const index_t consumer_index = consumer_position & (capacity - 1);
+    const index_t remaining_bytes = capacity - consumer_index;
+    const index_t bytes_consumed = read_dispatched_records(buffer, consumer_index, remaining_bytes, table, count,
+                                                           context, &msg_read);
+    if (bytes_consumed != 0) {
+        ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index,
+                               consumer_position, msg_read, bytes_consumed);
+        memset(buffer + consumer_index, 0, bytes_consumed);
+        store_release_consumer_position(header, buffer, consumer_position + bytes_consumed);
+    }
+    return msg_read;
+}
+
+//a case of the generated switch: the names are the parameters of the generated dispatch function
+#define RING_BUFFER_DISPATCH_CASE(id, handler)                                                                         \
+    case (id):                                                                                                         \
+        return handler(msg_type_id, buffer, msg_content_index, msg_content_length, context);
+
+/**
+ * Defines <name>_dispatch and <name>_batch_read, same as ring_buffer_batch_read but with the handlers inlined in a
+ * switch on msg_type_id, that the compiler can turn into a jump table or a few compares.
+ * handlers is an X-macro listing the msg type ids and their handlers, ie:
+ *
+ * #define ORDER_HANDLERS(CASE) CASE(1, on_new_order) CASE(2, on_cancel_order)
+ * DEFINE_RING_BUFFER_SWITCH_BATCH_READ(orders, ORDER_HANDLERS, on_unknown_message)
+ *
+ * The handlers and the fallback are message_consumer functions declared before it.
+ */
+#define DEFINE_RING_BUFFER_SWITCH_BATCH_READ(name, handlers, fallback)                                                 \
+inline static bool name##_dispatch(const uint32_t msg_type_id, const uint8_t *const buffer,                            \
+                                   const index_t msg_content_index, const index_t msg_content_length,                  \
+                                   void *const context) {                                                              \
+    switch (msg_type_id) {                                                                                             \
+        handlers(RING_BUFFER_DISPATCH_CASE)                                                                            \
+        default:                                                                                                       \
+            return fallback(msg_type_id, buffer, msg_content_index, msg_content_length, context);                      \
+    }                                                                                                                  \
+}                                                                                                                      \
+                                                                                                                       \
+inline static uint32_t name##_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,         \
+                                         const uint32_t count, void *context) {                                        \
+    uint32_t msg_read = 0;                                                                                             \
+    const uint64_t consumer_position = load_consumer_position(header, buffer);                                         \
+    const index_t capacity = header->capacity;                                                                         \
+    const index_t consumer_index = consumer_position & (capacity - 1);                                                 \
+    const index_t remaining_bytes = capacity - consumer_index;                                                         \
+    index_t bytes_consumed = 0;                                                                                        \
+    bool stop = false;                                                                                                 \
+    while (!stop && (bytes_consumed < remaining_bytes) && (msg_read < count)) {                                        \
+        const index_t msg_index = consumer_index + bytes_consumed;                                                     \
+        const uint64_t msg_header = load_acquire_msg_header(buffer, msg_index);                                        \
+        const index_t msg_length = record_length(msg_header);                                                          \
+        if (msg_length <= 0) {                                                                                         \
+            stop = true;                                                                                               \
+        } else {                                                                                                       \
+            bytes_consumed += align(msg_length, RECORD_ALIGNMENT);                                                     \
+            const uint32_t msg_type_id = message_type_id(msg_header);                                                  \
+            if (msg_type_id != RECORD_PADDING_MSG_TYPE_ID) {                                                           \
+                msg_read++;                                                                                            \
+                stop = !name##_dispatch(msg_type_id, buffer, msg_index + RECORD_HEADER_LENGTH,                         \
+                                        msg_length - RECORD_HEADER_LENGTH, context);                                   \
+            }                                                                                                          \
+        }                                                                                                              \
+    }                                                                                                                  \
+    if (bytes_consumed != 0) {                                                                                         \
+        ring_stats_record_read(buffer, header->consumer_stats_index, header->producer_position_index,                  \
+                               consumer_position, msg_read, bytes_consumed);                                           \
+        memset(buffer + consumer_index, 0, bytes_consumed);                                                            \
+        store_release_consumer_position(header, buffer, consumer_position + bytes_consumed);                           \
+    }                                                                                                                  \
+    return msg_read;                                                                                                   \
+}
+
+#endif //FRANZ_FLOW_RING_BUFFER_DISPATCH_H
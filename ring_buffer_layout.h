@@ -10,6 +10,7 @@
 #include "message_layout.h"
 #include "index.h"
 #include "bytes_utils.h"
+#include "ring_stats.h"
 
 /**
  * Offset within the trailer for where the producer value is stored.
@@ -23,17 +24,41 @@ static const index_t RING_BUFFER_CONSUMER_CACHE_POSITION_OFFSET = CACHE_LINE_LEN
  * Offset within the trailer for where the head value is stored.
  */
 static const index_t RING_BUFFER_CONSUMER_POSITION_OFFSET = CACHE_LINE_LENGTH * 6;
+/**
+ * Offset within the trailer for where the futex word of a parked consumer is stored.
+ */
+static const index_t RING_BUFFER_CONSUMER_PARK_OFFSET = CACHE_LINE_LENGTH * 8;
+/**
+ * Offset within the trailer for where the futex word of the parked producers is stored.
+ */
+static const index_t RING_BUFFER_PRODUCER_PARK_OFFSET = CACHE_LINE_LENGTH * 10;
+/**
+ * Offset within the trailer for where the counters written by the producers are stored.
+ */
+static const index_t RING_BUFFER_PRODUCER_STATS_OFFSET = CACHE_LINE_LENGTH * 12;
+/**
+ * Offset within the trailer for where the counters written by the consumer are stored.
+ */
+static const index_t RING_BUFFER_CONSUMER_STATS_OFFSET = CACHE_LINE_LENGTH * 14;
 /**
  * Total length of the trailer in bytes.
  */
-static const index_t RING_BUFFER_TRAILER_LENGTH = CACHE_LINE_LENGTH * 8;
+static const index_t RING_BUFFER_TRAILER_LENGTH = CACHE_LINE_LENGTH * 16;
 
 inline static bool ring_buffer_check_capacity(const index_t capacity) {
     return is_pow_2(capacity - RING_BUFFER_TRAILER_LENGTH);
 }
 
+/**
+ * Returns 0 if the length of the ring buffer can't fit an index_t.
+ */
 inline static index_t ring_buffer_capacity(const index_t requested_capacity) {
-    const index_t ring_buffer_capacity = next_pow_2(requested_capacity) + RING_BUFFER_TRAILER_LENGTH;
+    index_t capacity;
+    index_t ring_buffer_capacity;
+    if (!checked_next_pow_2(requested_capacity, &capacity) ||
+        !checked_add(capacity, RING_BUFFER_TRAILER_LENGTH, &ring_buffer_capacity)) {
+        return 0;
+    }
     return ring_buffer_capacity;
 }
 
@@ -42,6 +67,10 @@ struct ring_buffer_header {
     index_t producer_position_index;
     index_t consumer_cache_position_index;
     index_t consumer_position_index;
+    index_t consumer_park_index;
+    index_t producer_park_index;
+    index_t producer_stats_index;
+    index_t consumer_stats_index;
     index_t capacity;
 };
 
@@ -50,15 +79,23 @@ inline static bool init_ring_buffer_header(struct ring_buffer_header *const head
         return false;
     }
     const index_t capacity = length - RING_BUFFER_TRAILER_LENGTH;
-    const index_t max_msg_length = capacity - RECORD_HEADER_LENGTH;
+    const index_t max_msg_length = clamp_max_msg_length(capacity - RECORD_HEADER_LENGTH);
     const index_t producer_position_index = capacity + RING_BUFFER_PRODUCER_POSITION_OFFSET;
     const index_t consumer_cache_position_index = capacity + RING_BUFFER_CONSUMER_CACHE_POSITION_OFFSET;
     const index_t consumer_position_index = capacity + RING_BUFFER_CONSUMER_POSITION_OFFSET;
+    const index_t consumer_park_index = capacity + RING_BUFFER_CONSUMER_PARK_OFFSET;
+    const index_t producer_park_index = capacity + RING_BUFFER_PRODUCER_PARK_OFFSET;
+    const index_t producer_stats_index = capacity + RING_BUFFER_PRODUCER_STATS_OFFSET;
+    const index_t consumer_stats_index = capacity + RING_BUFFER_CONSUMER_STATS_OFFSET;
     header->capacity = capacity;
     header->max_msg_length = max_msg_length;
     header->producer_position_index = producer_position_index;
     header->consumer_cache_position_index = consumer_cache_position_index;
     header->consumer_position_index = consumer_position_index;
+    header->consumer_park_index = consumer_park_index;
+    header->producer_park_index = producer_park_index;
+    header->producer_stats_index = producer_stats_index;
+    header->consumer_stats_index = consumer_stats_index;
     return true;
 }
 
@@ -113,6 +150,30 @@ inline static uint64_t load_acquire_msg_header(const uint8_t *const buffer, cons
     return msg_header_value;
 }
 
+inline static void store_msg_header(const uint8_t *const buffer, const index_t index, const uint64_t msg_header) {
+    uint64_t *msg_header_address = (uint64_t *) (buffer + index);
+    *msg_header_address = msg_header;
+}
+
+/**
+ * Marks the claimed bytes as a record in progress, with a negative length: the consumer stops on it as on bytes not
+ * claimed yet, but ring_buffer_unblock can turn it into padding if its producer never commits it.
+ */
+inline static void
+store_claimed_msg_header(const uint8_t *const buffer, const index_t index, const index_t required_msg_capacity) {
+    const _Atomic uint64_t *msg_header_address = (_Atomic uint64_t *) (buffer + index);
+    atomic_store_explicit(msg_header_address, make_header(0, -required_msg_capacity), memory_order_relaxed);
+    //the content written after can't be seen before the mark: an unmarked claim is found empty by ring_buffer_unblock
+    atomic_thread_fence(memory_order_release);
+}
+
+inline static bool
+cas_msg_header(const uint8_t *const buffer, const index_t index, uint64_t expected, const uint64_t msg_header) {
+    const _Atomic uint64_t *msg_header_address = (_Atomic uint64_t *) (buffer + index);
+    return atomic_compare_exchange_strong_explicit(msg_header_address, &expected, msg_header, memory_order_release,
+                                                   memory_order_relaxed);
+}
+
 inline static void store_release_msg_header(const uint8_t *const buffer, const index_t index, const uint64_t msg_header) {
     const _Atomic uint64_t *msg_header_address = (_Atomic uint64_t *) (buffer + index);
     atomic_store_explicit(msg_header_address, msg_header, memory_order_release);
@@ -136,4 +197,12 @@ cas_release_producer_position(const struct ring_buffer_header *const header, con
                                                    memory_order_relaxed);
 }
 
+inline static uint64_t
+fetch_add_release_producer_position(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                                    const uint64_t delta) {
+    //as cas_release_producer_position: the record header's commit is what really matters for the consumer side
+    _Atomic uint64_t *producer_position_address = (_Atomic uint64_t *) (buffer + header->producer_position_index);
+    return atomic_fetch_add_explicit(producer_position_address, delta, memory_order_release);
+}
+
 #endif //FRANZ_FLOW_RING_BUFFER_LAYOUT_H
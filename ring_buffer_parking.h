@@ -0,0 +1,186 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_RING_BUFFER_PARKING_H
+#define FRANZ_FLOW_RING_BUFFER_PARKING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "index.h"
+#include "ring_buffer_layout.h"
+#include "ring_buffer.h"
+
+/**
+ * The park words are futex words on the ring buffer trailer: they are written only by a thread that is going to park
+ * or by the one that wakes it, hence the hot paths just load them from a shared (and unmodified) cache line.
+ * The futex operations aren't FUTEX_PRIVATE_FLAG ones, to allow parking on rings shared between processes.
+ *
+ * The waker side is a release store of the message header (or of the consumer position) followed by a load of the park
+ * word, with a full fence between them that pairs with the one of announce_park: either the parking thread sees the
+ * store or the waker sees the park word set. The fence is paid by the parking/waking wrappers only, the plain commit
+ * and read stay a single release store. Any park is still bounded by park_timeout_nanos.
+ */
+static const uint32_t RING_BUFFER_NOT_PARKED = 0;
+static const uint32_t RING_BUFFER_PARKED = 1;
+
+inline static _Atomic uint32_t *park_address(const uint8_t *const buffer, const index_t park_index) {
+    return (_Atomic uint32_t *) (buffer + park_index);
+}
+
+inline static void futex_wait(_Atomic uint32_t *const address, const uint32_t expected_value,
+                              const uint64_t timeout_nanos) {
+    const struct timespec timeout = {.tv_sec = timeout_nanos / 1000000000, .tv_nsec = timeout_nanos % 1000000000};
+    //any failure (EAGAIN, EINTR, ETIMEDOUT) is just a spurious wake up for the caller
+    syscall(SYS_futex, address, FUTEX_WAIT, expected_value, &timeout, NULL, 0);
+}
+
+inline static void futex_wake_all(_Atomic uint32_t *const address) {
+    syscall(SYS_futex, address, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+inline static void wake_parked(_Atomic uint32_t *const park_word) {
+    //StoreLoad: the park word can't be loaded before the store that the parked thread is waiting for is visible
+    atomic_thread_fence(memory_order_seq_cst);
+    //the exchange elects a single waker when many threads see the park word set
+    if (atomic_load_explicit(park_word, memory_order_relaxed) != RING_BUFFER_NOT_PARKED &&
+        atomic_exchange_explicit(park_word, RING_BUFFER_NOT_PARKED, memory_order_relaxed) != RING_BUFFER_NOT_PARKED) {
+        futex_wake_all(park_word);
+    }
+}
+
+inline static void announce_park(_Atomic uint32_t *const park_word) {
+    //StoreLoad: the parking condition has to be checked again only after the park word is visible to the wakers
+    atomic_store_explicit(park_word, RING_BUFFER_PARKED, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+inline static void park(_Atomic uint32_t *const park_word, const uint64_t park_timeout_nanos) {
+    //if a waker has already cleared the park word the futex won't sleep at all
+    futex_wait(park_word, RING_BUFFER_PARKED, park_timeout_nanos);
+}
+
+inline static void ring_buffer_wake_consumer(const struct ring_buffer_header *const header, const uint8_t *const buffer) {
+    wake_parked(park_address(buffer, header->consumer_park_index));
+}
+
+inline static void ring_buffer_wake_producers(const struct ring_buffer_header *const header, const uint8_t *const buffer) {
+    wake_parked(park_address(buffer, header->producer_park_index));
+}
+
+inline static bool
+ring_buffer_parking_commit(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                           const index_t msg_index, const uint32_t msg_type_id, const index_t msg_content_length) {
+    if (!ring_buffer_commit(buffer, msg_index, msg_type_id, msg_content_length)) {
+        return false;
+    }
+    ring_buffer_wake_consumer(header, buffer);
+    return true;
+}
+
+/**
+ * Same as ring_buffer_batch_read, but wakes any producer parked waiting for the consumer to make room.
+ */
+inline static uint32_t
+ring_buffer_waking_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                              const message_consumer consumer, const uint32_t count, void *context) {
+    const uint32_t msg_read = ring_buffer_batch_read(header, buffer, consumer, count, context);
+    if (msg_read != 0) {
+        ring_buffer_wake_producers(header, buffer);
+    }
+    return msg_read;
+}
+
+/**
+ * Waits until at least one message is read: after max_spins failed reads the consumer parks until a producer
+ * commits a message or park_timeout_nanos elapsed.
+ */
+inline static uint32_t
+ring_buffer_parking_batch_read(const struct ring_buffer_header *const header, uint8_t *const buffer,
+                               const message_consumer consumer, const uint32_t count, void *context,
+                               const uint64_t max_spins, const uint64_t park_timeout_nanos, uint64_t *const parks) {
+    _Atomic uint32_t *const park_word = park_address(buffer, header->consumer_park_index);
+    const index_t mask = header->capacity - 1;
+    uint64_t spins = 0;
+    uint64_t park_count = 0;
+    uint32_t msg_read;
+    while ((msg_read = ring_buffer_waking_batch_read(header, buffer, consumer, count, context)) == 0) {
+        if (spins < max_spins) {
+            spins++;
+            __asm__ __volatile__("pause;");
+        } else {
+            announce_park(park_word);
+            //the next message to be read is the one that a producer will commit: not claimed or in progress
+            const index_t consumer_index = load_consumer_position(header, buffer) & mask;
+            if (record_length(load_acquire_msg_header(buffer, consumer_index)) <= 0) {
+                park(park_word, park_timeout_nanos);
+                park_count++;
+            }
+        }
+    }
+    *parks = park_count;
+    return msg_read;
+}
+
+inline static bool
+parking_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+              const index_t required_capacity, const bool multi_producer,
+              const uint64_t max_spins, const uint64_t park_timeout_nanos,
+              uint64_t *const claimed_position, index_t *const claimed_index, uint64_t *const parks) {
+    //a claim bigger than the max message length will never succeed
+    if (required_capacity > header->max_msg_length) {
+        return false;
+    }
+    _Atomic uint32_t *const park_word = park_address(buffer, header->producer_park_index);
+    uint64_t spins = 0;
+    uint64_t park_count = 0;
+    while (true) {
+        const uint64_t consumer_position = load_acquire_consumer_position(header, buffer);
+        const bool claimed = multi_producer ?
+                             try_ring_buffer_mp_claim(header, buffer, required_capacity, claimed_position,
+                                                      claimed_index) :
+                             try_ring_buffer_sp_claim(header, buffer, required_capacity, claimed_position,
+                                                      claimed_index);
+        if (claimed) {
+            *parks = park_count;
+            return true;
+        }
+        if (spins < max_spins) {
+            spins++;
+            __asm__ __volatile__("pause;");
+        } else {
+            announce_park(park_word);
+            //any claim failure is due to a slow consumer: it is worth to park only if it hasn't moved since then
+            if (load_acquire_consumer_position(header, buffer) == consumer_position) {
+                park(park_word, park_timeout_nanos);
+                park_count++;
+            }
+        }
+    }
+}
+
+inline static bool
+ring_buffer_parking_sp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                             const index_t required_capacity, const uint64_t max_spins,
+                             const uint64_t park_timeout_nanos,
+                             uint64_t *const claimed_position, index_t *const claimed_index, uint64_t *const parks) {
+    return parking_claim(header, buffer, required_capacity, false, max_spins, park_timeout_nanos, claimed_position,
+                         claimed_index, parks);
+}
+
+inline static bool
+ring_buffer_parking_mp_claim(const struct ring_buffer_header *const header, const uint8_t *const buffer,
+                             const index_t required_capacity, const uint64_t max_spins,
+                             const uint64_t park_timeout_nanos,
+                             uint64_t *const claimed_position, index_t *const claimed_index, uint64_t *const parks) {
+    return parking_claim(header, buffer, required_capacity, true, max_spins, park_timeout_nanos, claimed_position,
+                         claimed_index, parks);
+}
+
+#endif //FRANZ_FLOW_RING_BUFFER_PARKING_H
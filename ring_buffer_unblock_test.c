@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ring_buffer.h"
+
+/**
+ * ring_buffer_unblock on the claims a dead producer can leave behind, on a ring of 1024 bytes whose consumer is at
+ * index 1000, 24 bytes before the end of the buffer, and ring_buffer_check_stall on a fake clock: exits with 1 if any
+ * check fails.
+ */
+
+#define MSG_TYPE_ID 1
+#define RING_CAPACITY 1024
+#define CONSUMER_INDEX 1000
+#define STALL_TIMEOUT_NANOS 1000000
+
+struct test_ring {
+    struct ring_buffer_header header;
+    uint8_t *buffer;
+};
+
+static uint32_t failures = 0;
+
+static void check(const bool condition, const char *const test, const char *const what) {
+    if (!condition) {
+        fprintf(stderr, "%s: %s\n", test, what);
+        failures++;
+    }
+}
+
+static bool on_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                       const index_t msg_content_length, void *context) {
+    uint64_t value;
+    memcpy(&value, buffer + msg_content_index, sizeof(value));
+    *((uint64_t *) context) += value;
+    return true;
+}
+
+/**
+ * An empty ring with both the producer and the consumer at CONSUMER_INDEX.
+ */
+static bool init_test_ring(struct test_ring *const ring) {
+    const index_t length = ring_buffer_capacity(RING_CAPACITY);
+    ring->buffer = (uint8_t *) aligned_alloc(CACHE_LINE_LENGTH, length);
+    if (ring->buffer == NULL) {
+        return false;
+    }
+    memset(ring->buffer, 0, length);
+    if (!init_ring_buffer_header(&ring->header, length)) {
+        return false;
+    }
+    uint64_t claimed_position;
+    index_t claimed_index;
+    uint64_t sum = 0;
+    return try_ring_buffer_sp_claim(&ring->header, ring->buffer, CONSUMER_INDEX - RECORD_HEADER_LENGTH,
+                                    &claimed_position, &claimed_index) &&
+           ring_buffer_commit(ring->buffer, claimed_index, MSG_TYPE_ID, CONSUMER_INDEX - RECORD_HEADER_LENGTH) &&
+           ring_buffer_batch_read(&ring->header, ring->buffer, &on_message, 1, &sum) == 1;
+}
+
+/**
+ * The producer position moved by a producer that dies before writing anything, as after the cas of an mp claim.
+ */
+static void dead_claim(const struct test_ring *const ring, const index_t length) {
+    uint64_t producer_position = load_acquire_producer_position(&ring->header, ring->buffer);
+    cas_release_producer_position(&ring->header, ring->buffer, &producer_position, producer_position + length);
+}
+
+static bool send(const struct test_ring *const ring, const uint64_t value) {
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!try_ring_buffer_mp_claim(&ring->header, ring->buffer, sizeof(value), &claimed_position, &claimed_index)) {
+        return false;
+    }
+    memcpy(ring->buffer + encoded_msg_offset(claimed_index), &value, sizeof(value));
+    return ring_buffer_commit(ring->buffer, claimed_index, MSG_TYPE_ID, sizeof(value));
+}
+
+static uint64_t lost_bytes(const struct test_ring *const ring) {
+    return load_ring_stats_counter(ring->buffer, ring->header.consumer_stats_index, RING_STATS_LOST_BYTES_OFFSET);
+}
+
+/**
+ * Checks that an unblocked ring has lost lost bytes and that the consumer then reads the value sent after the dead
+ * claim.
+ */
+static void check_read_after_unblock(const char *const test, const struct test_ring *const ring, const uint64_t lost,
+                                     const uint64_t value) {
+    uint64_t sum = 0;
+    check(lost_bytes(ring) == lost, test, "wrong lost bytes");
+    //the padding at the end of the buffer and the rest are read on 2 batches
+    ring_buffer_batch_read(&ring->header, ring->buffer, &on_message, 16, &sum);
+    ring_buffer_batch_read(&ring->header, ring->buffer, &on_message, 16, &sum);
+    check(sum == value, test, "value sent after the dead claim not read");
+    check(load_acquire_consumer_position(&ring->header, ring->buffer) ==
+          load_acquire_producer_position(&ring->header, ring->buffer), test, "not read until the producer position");
+}
+
+/**
+ * Checks that the consumer is blocked, that it is unblocked losing lost bytes and then reads the value sent after
+ * the dead claim.
+ */
+static void check_unblocked(const char *const test, const struct test_ring *const ring, const uint64_t lost,
+                            const uint64_t value) {
+    uint64_t sum = 0;
+    check(ring_buffer_batch_read(&ring->header, ring->buffer, &on_message, 16, &sum) == 0, test, "not blocked");
+    check(ring_buffer_unblock(&ring->header, ring->buffer), test, "not unblocked");
+    check_read_after_unblock(test, ring, lost, value);
+}
+
+static void test_dead_claim(void) {
+    struct test_ring ring;
+    check(init_test_ring(&ring), __func__, "can't init");
+    //not straddling the end of the buffer: the next record is at its start
+    dead_claim(&ring, RING_CAPACITY - CONSUMER_INDEX);
+    check(send(&ring, 42), __func__, "can't send");
+    check_unblocked(__func__, &ring, RING_CAPACITY - CONSUMER_INDEX, 42);
+    free(ring.buffer);
+}
+
+static void test_dead_marked_claim(void) {
+    struct test_ring ring;
+    check(init_test_ring(&ring), __func__, "can't init");
+    uint64_t claimed_position;
+    index_t claimed_index;
+    check(try_ring_buffer_mp_claim(&ring.header, ring.buffer, sizeof(uint64_t), &claimed_position, &claimed_index),
+          __func__, "can't claim");
+    check(send(&ring, 42), __func__, "can't send");
+    check_unblocked(__func__, &ring, required_record_capacity(sizeof(uint64_t)), 42);
+    free(ring.buffer);
+}
+
+static void test_dead_wrapped_claim(void) {
+    struct test_ring ring;
+    check(init_test_ring(&ring), __func__, "can't init");
+    //the padding until the end of the buffer and the 64 bytes record claimed at its start are both unwritten
+    const index_t wrapped_length = 64;
+    dead_claim(&ring, (RING_CAPACITY - CONSUMER_INDEX) + wrapped_length);
+    check(send(&ring, 42), __func__, "can't send");
+    check_unblocked(__func__, &ring, (RING_CAPACITY - CONSUMER_INDEX) + wrapped_length, 42);
+    free(ring.buffer);
+}
+
+static void test_dead_last_claim(void) {
+    struct test_ring ring;
+    check(init_test_ring(&ring), __func__, "can't init");
+    //nothing after it: its length is unknown
+    dead_claim(&ring, (RING_CAPACITY - CONSUMER_INDEX) + 64);
+    check(!ring_buffer_unblock(&ring.header, ring.buffer), __func__, "unblocked without a next record");
+    check(lost_bytes(&ring) == 0, __func__, "lost bytes without an unblock");
+    free(ring.buffer);
+}
+
+static void test_stall_timeout(void) {
+    struct test_ring ring;
+    check(init_test_ring(&ring), __func__, "can't init");
+    dead_claim(&ring, RING_CAPACITY - CONSUMER_INDEX);
+    check(send(&ring, 42), __func__, "can't send");
+    struct ring_buffer_stall_detector detector;
+    init_ring_buffer_stall_detector(&detector, STALL_TIMEOUT_NANOS);
+    //the first check starts the timer
+    check(!ring_buffer_check_stall(&ring.header, ring.buffer, &detector, 1000), __func__,
+          "unblocked on the first check");
+    check(!ring_buffer_check_stall(&ring.header, ring.buffer, &detector, 1000 + STALL_TIMEOUT_NANOS - 1), __func__,
+          "unblocked before the timeout");
+    check(lost_bytes(&ring) == 0, __func__, "lost bytes before the timeout");
+    check(ring_buffer_check_stall(&ring.header, ring.buffer, &detector, 1000 + STALL_TIMEOUT_NANOS), __func__,
+          "not unblocked after the timeout");
+    check_read_after_unblock(__func__, &ring, RING_CAPACITY - CONSUMER_INDEX, 42);
+    free(ring.buffer);
+}
+
+static void test_stall_timer_reset(void) {
+    struct test_ring ring;
+    check(init_test_ring(&ring), __func__, "can't init");
+    struct ring_buffer_stall_detector detector;
+    init_ring_buffer_stall_detector(&detector, STALL_TIMEOUT_NANOS);
+    //a slow consumer, not a stalled ring: the timer starts on a record committed but not read yet
+    check(send(&ring, 1), __func__, "can't send");
+    check(!ring_buffer_check_stall(&ring.header, ring.buffer, &detector, 0), __func__, "unblocked on the first check");
+    uint64_t sum = 0;
+    check(ring_buffer_batch_read(&ring.header, ring.buffer, &on_message, 16, &sum) == 1, __func__, "not read");
+    //the consumer has moved: the timer restarts on the dead claim after it
+    dead_claim(&ring, 64);
+    check(send(&ring, 42), __func__, "can't send");
+    check(!ring_buffer_check_stall(&ring.header, ring.buffer, &detector, STALL_TIMEOUT_NANOS), __func__,
+          "unblocked after the consumer has moved");
+    check(!ring_buffer_check_stall(&ring.header, ring.buffer, &detector, (2 * STALL_TIMEOUT_NANOS) - 1), __func__,
+          "unblocked before the timeout from the move");
+    check(lost_bytes(&ring) == 0, __func__, "lost bytes before the timeout");
+    check(ring_buffer_check_stall(&ring.header, ring.buffer, &detector, 2 * STALL_TIMEOUT_NANOS), __func__,
+          "not unblocked after the timeout from the move");
+    check_read_after_unblock(__func__, &ring, 64, 42);
+    free(ring.buffer);
+}
+
+static void test_stall_empty(void) {
+    struct test_ring ring;
+    check(init_test_ring(&ring), __func__, "can't init");
+    struct ring_buffer_stall_detector detector;
+    init_ring_buffer_stall_detector(&detector, STALL_TIMEOUT_NANOS);
+    //producer and consumer on the same position: an empty ring never stalls, however long it stays empty
+    check(!ring_buffer_check_stall(&ring.header, ring.buffer, &detector, 0), __func__, "unblocked an empty ring");
+    check(!ring_buffer_check_stall(&ring.header, ring.buffer, &detector, 10 * STALL_TIMEOUT_NANOS), __func__,
+          "unblocked an empty ring after the timeout");
+    check(!detector.stalled, __func__, "an empty ring is stalled");
+    check(lost_bytes(&ring) == 0, __func__, "lost bytes on an empty ring");
+    check(load_acquire_consumer_position(&ring.header, ring.buffer) == CONSUMER_INDEX, __func__,
+          "consumer position moved");
+    free(ring.buffer);
+}
+
+int main(int argc, char *argv[]) {
+    test_dead_claim();
+    test_dead_marked_claim();
+    test_dead_wrapped_claim();
+    test_dead_last_claim();
+    test_stall_timeout();
+    test_stall_timer_reset();
+    test_stall_empty();
+    if (failures != 0) {
+        fprintf(stderr, "%u checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include "ring_buffer.h"
+#include "fixed_size_ring_buffer.h"
+#include "fixed_size_ring_buffer.c"
+#include "shared_ring_buffer.h"
+#include "ring_stats.h"
+
+/**
+ * Samples the counters of a shared ring (see ring_stats.h) from another process: the producers and the consumer
+ * must be built with FRANZ_FLOW_RING_STATS, otherwise all the counters but the size stay at 0.
+ * It only reads the trailer, hence it can be attached and detached at any time.
+ */
+
+struct sampled_ring {
+    struct shared_ring_buffer shared;
+    struct ring_buffer_header header;
+    struct fixed_size_ring_buffer_header fixed_size_header;
+    index_t producer_stats_index;
+    index_t consumer_stats_index;
+    index_t producer_position_index;
+    index_t consumer_position_index;
+    //in the unit of the positions: bytes or messages
+    index_t capacity;
+};
+
+static void usage(const char *const program) {
+    fprintf(stderr,
+            "usage: %s [options] NAME\n"
+            "  --file                   (NAME is a file instead of a POSIX shared memory object)\n"
+            "  --interval-ms=MILLIS     (default 1000)\n"
+            "  --samples=N              (default 0, ie until killed)\n",
+            program);
+}
+
+static bool attach_sampled_ring(const char *const name, const enum shared_memory_kind kind,
+                                struct sampled_ring *const ring) {
+    if (attach_shared_ring_buffer(name, kind, &ring->shared, &ring->header)) {
+        ring->producer_stats_index = ring->header.producer_stats_index;
+        ring->consumer_stats_index = ring->header.consumer_stats_index;
+        ring->producer_position_index = ring->header.producer_position_index;
+        ring->consumer_position_index = ring->header.consumer_position_index;
+        ring->capacity = ring->header.capacity;
+        return true;
+    }
+    if (attach_shared_fixed_size_ring_buffer(name, kind, &ring->shared, &ring->fixed_size_header)) {
+        ring->producer_stats_index = ring->fixed_size_header.producer_stats_index;
+        ring->consumer_stats_index = ring->fixed_size_header.consumer_stats_index;
+        ring->producer_position_index = ring->fixed_size_header.producer_position_index;
+        ring->consumer_position_index = ring->fixed_size_header.consumer_position_index;
+        ring->capacity = ring->fixed_size_header.capacity;
+        return true;
+    }
+    return false;
+}
+
+static uint64_t load_position(const struct sampled_ring *const ring, const index_t position_index) {
+    const _Atomic uint64_t *const position_address = (_Atomic uint64_t *) (ring->shared.buffer + position_index);
+    return atomic_load_explicit(position_address, memory_order_acquire);
+}
+
+static double rate(const uint64_t current, const uint64_t previous, const double seconds) {
+    return seconds <= 0 ? 0 : (current - previous) / seconds;
+}
+
+static void print_sample(const struct sampled_ring *const ring, const struct ring_stats *const stats,
+                         const struct ring_stats *const previous, const double seconds) {
+    //the consumer position first: the size can't be negative
+    const uint64_t consumer_position = load_position(ring, ring->consumer_position_index);
+    const uint64_t producer_position = load_position(ring, ring->producer_position_index);
+    const uint64_t size = producer_position - consumer_position;
+    const double average_batch = stats->batches == previous->batches ? 0 :
+                                 ((double) (stats->consumed_messages - previous->consumed_messages)) /
+                                 (stats->batches - previous->batches);
+    printf("size:%lu/%" PRIdINDEX " (%.1f%%) max_depth:%lu claims:%lu (%.0f/s) failed_claims:%lu (%.0f/s)"
+           " full_events:%lu (%.0f/s) padding:%lu records %lu bytes consumed:%lu msgs (%.0f/s) %lu bytes (%.0f/s)"
+           " avg_batch:%.1f lost:%lu records %lu bytes\n",
+           size, ring->capacity, (100.0 * size) / ring->capacity, stats->max_depth, stats->claims,
+           rate(stats->claims, previous->claims, seconds), stats->failed_claims,
+           rate(stats->failed_claims, previous->failed_claims, seconds), stats->full_events,
+           rate(stats->full_events, previous->full_events, seconds), stats->padding_records, stats->padding_bytes,
+           stats->consumed_messages, rate(stats->consumed_messages, previous->consumed_messages, seconds),
+           stats->consumed_bytes, rate(stats->consumed_bytes, previous->consumed_bytes, seconds), average_batch,
+           stats->lost_records, stats->lost_bytes);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+            {"file",        no_argument,       NULL, 'f'},
+            {"interval-ms", required_argument, NULL, 'i'},
+            {"samples",     required_argument, NULL, 's'},
+            {"help",        no_argument,       NULL, 'h'},
+            {NULL, 0,                          NULL, 0}
+    };
+    enum shared_memory_kind kind = SHARED_MEMORY_SHM;
+    uint64_t interval_millis = 1000;
+    uint64_t samples = 0;
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        char *end = NULL;
+        switch (option) {
+            case 'f':
+                kind = SHARED_MEMORY_FILE;
+                break;
+            case 'i':
+                interval_millis = strtoull(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || interval_millis == 0) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 's':
+                samples = strtoull(optarg, &end, 10);
+                if (end == optarg || *end != '\0') {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *const name = argv[optind];
+    struct sampled_ring ring;
+    if (!attach_sampled_ring(name, kind, &ring)) {
+        fprintf(stderr, "can't attach %s: not a shared ring or not initialized yet\n", name);
+        return 1;
+    }
+    struct ring_stats previous;
+    memset(&previous, 0, sizeof(previous));
+    struct timespec previous_time;
+    clock_gettime(CLOCK_MONOTONIC, &previous_time);
+    const struct timespec interval = {.tv_sec = interval_millis / 1000,
+            .tv_nsec = (interval_millis % 1000) * 1000000};
+    for (uint64_t sample = 0; samples == 0 || sample < samples; sample++) {
+        struct ring_stats stats;
+        load_ring_stats(ring.shared.buffer, ring.producer_stats_index, ring.consumer_stats_index, &stats);
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        //the first sample has no rates: there is nothing to compare it to
+        const double seconds = sample == 0 ? 0 : (time.tv_sec - previous_time.tv_sec) +
+                                                 ((time.tv_nsec - previous_time.tv_nsec) / 1e9);
+        print_sample(&ring, &stats, &previous, seconds);
+        previous = stats;
+        previous_time = time;
+        if (samples == 0 || sample + 1 < samples) {
+            nanosleep(&interval, NULL);
+        }
+    }
+    close_shared_ring_buffer(&ring.shared);
+    return 0;
+}
@@ -0,0 +1,159 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_RING_STATS_H
+#define FRANZ_FLOW_RING_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "index.h"
+#include "bytes_utils.h"
+
+/**
+ * Counters of a ring, in 2 blocks of its trailer: one written by the producers only and one by the consumer only,
+ * each on its own 2 cache lines as any other value of the trailers, hence an external process can sample them
+ * (see ring_stats.c) without slowing down the ring more than a reader of its positions would do.
+ * The blocks are always part of the trailers, but they are updated only if FRANZ_FLOW_RING_STATS is defined:
+ * a single producer and the consumer own their blocks and update them with plain relaxed stores, the multi producer
+ * claims share the producers block with relaxed fetch-adds instead.
+ * The lost records counters are the exception: they are always updated, by whoever unblocks the ring.
+ */
+
+//producers block
+//successful claims: a batch claim counts once
+static const index_t RING_STATS_CLAIMS_OFFSET = 0;
+//claims failed because the ring was full or the record wasn't fitting before the consumer
+static const index_t RING_STATS_FAILED_CLAIMS_OFFSET = 8;
+//claims that have found the ring full by its cached consumer position, ie that have reloaded the real one
+static const index_t RING_STATS_FULL_EVENTS_OFFSET = 16;
+static const index_t RING_STATS_PADDING_RECORDS_OFFSET = 24;
+static const index_t RING_STATS_PADDING_BYTES_OFFSET = 32;
+
+//consumer block
+//reads that have consumed at least one message
+static const index_t RING_STATS_BATCHES_OFFSET = 0;
+static const index_t RING_STATS_CONSUMED_MESSAGES_OFFSET = 8;
+static const index_t RING_STATS_CONSUMED_BYTES_OFFSET = 16;
+//the biggest distance between the producer and the consumer positions seen by the consumer, in bytes for the
+//ring_buffer and in messages for the fixed size rings
+static const index_t RING_STATS_MAX_DEPTH_OFFSET = 24;
+//claims never committed by their producers, turned into padding by ring_buffer_unblock
+static const index_t RING_STATS_LOST_RECORDS_OFFSET = 32;
+static const index_t RING_STATS_LOST_BYTES_OFFSET = 40;
+
+struct ring_stats {
+    uint64_t claims;
+    uint64_t failed_claims;
+    uint64_t full_events;
+    uint64_t padding_records;
+    uint64_t padding_bytes;
+    uint64_t batches;
+    uint64_t consumed_messages;
+    uint64_t consumed_bytes;
+    uint64_t max_depth;
+    uint64_t lost_records;
+    uint64_t lost_bytes;
+};
+
+/**
+ * Adds delta to a counter: with shared set, the counter has many writers.
+ */
+inline static void
+ring_stats_add(const uint8_t *const buffer, const index_t block_index, const index_t offset, const bool shared,
+               const uint64_t delta) {
+#ifdef FRANZ_FLOW_RING_STATS
+    _Atomic uint64_t *const counter_address = (_Atomic uint64_t *) (buffer + block_index + offset);
+    if (shared) {
+        atomic_fetch_add_explicit(counter_address, delta, memory_order_relaxed);
+    } else {
+        atomic_store_explicit(counter_address, atomic_load_explicit(counter_address, memory_order_relaxed) + delta,
+                              memory_order_relaxed);
+    }
+#endif
+}
+
+inline static void ring_stats_record_claim(const uint8_t *const buffer, const index_t producer_stats_index,
+                                           const bool shared, const uint64_t padding_records,
+                                           const uint64_t padding_bytes) {
+    ring_stats_add(buffer, producer_stats_index, RING_STATS_CLAIMS_OFFSET, shared, 1);
+    if (padding_records != 0) {
+        ring_stats_add(buffer, producer_stats_index, RING_STATS_PADDING_RECORDS_OFFSET, shared, padding_records);
+        ring_stats_add(buffer, producer_stats_index, RING_STATS_PADDING_BYTES_OFFSET, shared, padding_bytes);
+    }
+}
+
+inline static void
+ring_stats_record_failed_claim(const uint8_t *const buffer, const index_t producer_stats_index, const bool shared) {
+    ring_stats_add(buffer, producer_stats_index, RING_STATS_FAILED_CLAIMS_OFFSET, shared, 1);
+}
+
+inline static void
+ring_stats_record_full_event(const uint8_t *const buffer, const index_t producer_stats_index, const bool shared) {
+    ring_stats_add(buffer, producer_stats_index, RING_STATS_FULL_EVENTS_OFFSET, shared, 1);
+}
+
+/**
+ * Records a claim turned into padding because never committed: unlike the others, it is always counted.
+ */
+inline static void ring_stats_record_lost(const uint8_t *const buffer, const index_t consumer_stats_index,
+                                          const uint64_t bytes) {
+    _Atomic uint64_t *const lost_records_address = (_Atomic uint64_t *) (buffer + consumer_stats_index +
+                                                                         RING_STATS_LOST_RECORDS_OFFSET);
+    _Atomic uint64_t *const lost_bytes_address = (_Atomic uint64_t *) (buffer + consumer_stats_index +
+                                                                       RING_STATS_LOST_BYTES_OFFSET);
+    atomic_fetch_add_explicit(lost_records_address, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(lost_bytes_address, bytes, memory_order_relaxed);
+}
+
+/**
+ * Records a read of at least a message by the only consumer, that was at consumer_position: the depth is measured
+ * against the producer position, in the unit of the positions.
+ */
+inline static void ring_stats_record_read(const uint8_t *const buffer, const index_t consumer_stats_index,
+                                          const index_t producer_position_index, const uint64_t consumer_position,
+                                          const uint64_t messages, const uint64_t bytes) {
+#ifdef FRANZ_FLOW_RING_STATS
+    ring_stats_add(buffer, consumer_stats_index, RING_STATS_BATCHES_OFFSET, false, 1);
+    ring_stats_add(buffer, consumer_stats_index, RING_STATS_CONSUMED_MESSAGES_OFFSET, false, messages);
+    ring_stats_add(buffer, consumer_stats_index, RING_STATS_CONSUMED_BYTES_OFFSET, false, bytes);
+    const _Atomic uint64_t *const producer_position_address = (_Atomic uint64_t *) (buffer +
+                                                                                    producer_position_index);
+    const uint64_t depth = atomic_load_explicit(producer_position_address, memory_order_relaxed) - consumer_position;
+    _Atomic uint64_t *const max_depth_address = (_Atomic uint64_t *) (buffer + consumer_stats_index +
+                                                                      RING_STATS_MAX_DEPTH_OFFSET);
+    if (depth > atomic_load_explicit(max_depth_address, memory_order_relaxed)) {
+        atomic_store_explicit(max_depth_address, depth, memory_order_relaxed);
+    }
+#endif
+}
+
+inline static uint64_t
+load_ring_stats_counter(const uint8_t *const buffer, const index_t block_index, const index_t offset) {
+    const _Atomic uint64_t *const counter_address = (_Atomic uint64_t *) (buffer + block_index + offset);
+    return atomic_load_explicit(counter_address, memory_order_relaxed);
+}
+
+/**
+ * Samples the counters: each of them is atomic, but they aren't a consistent snapshot all together.
+ */
+inline static void
+load_ring_stats(const uint8_t *const buffer, const index_t producer_stats_index, const index_t consumer_stats_index,
+                struct ring_stats *const stats) {
+    stats->claims = load_ring_stats_counter(buffer, producer_stats_index, RING_STATS_CLAIMS_OFFSET);
+    stats->failed_claims = load_ring_stats_counter(buffer, producer_stats_index, RING_STATS_FAILED_CLAIMS_OFFSET);
+    stats->full_events = load_ring_stats_counter(buffer, producer_stats_index, RING_STATS_FULL_EVENTS_OFFSET);
+    stats->padding_records = load_ring_stats_counter(buffer, producer_stats_index,
+                                                     RING_STATS_PADDING_RECORDS_OFFSET);
+    stats->padding_bytes = load_ring_stats_counter(buffer, producer_stats_index, RING_STATS_PADDING_BYTES_OFFSET);
+    stats->batches = load_ring_stats_counter(buffer, consumer_stats_index, RING_STATS_BATCHES_OFFSET);
+    stats->consumed_messages = load_ring_stats_counter(buffer, consumer_stats_index,
+                                                       RING_STATS_CONSUMED_MESSAGES_OFFSET);
+    stats->consumed_bytes = load_ring_stats_counter(buffer, consumer_stats_index, RING_STATS_CONSUMED_BYTES_OFFSET);
+    stats->max_depth = load_ring_stats_counter(buffer, consumer_stats_index, RING_STATS_MAX_DEPTH_OFFSET);
+    stats->lost_records = load_ring_stats_counter(buffer, consumer_stats_index, RING_STATS_LOST_RECORDS_OFFSET);
+    stats->lost_bytes = load_ring_stats_counter(buffer, consumer_stats_index, RING_STATS_LOST_BYTES_OFFSET);
+}
+
+#endif //FRANZ_FLOW_RING_STATS_H
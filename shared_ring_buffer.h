@@ -0,0 +1,250 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_SHARED_RING_BUFFER_H
+#define FRANZ_FLOW_SHARED_RING_BUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "bytes_utils.h"
+#include "ring_buffer_layout.h"
+#include "fixed_size_ring_buffer.h"
+
+/**
+ * "FRNZFLOW" in ASCII: it is stored last by the creator, hence an attacher can't see a partially initialized ring.
+ */
+static const uint64_t SHARED_RING_BUFFER_MAGIC = 0x574F4C465A4E5246;
+/**
+ * Version of the metadata block and of the trailer layouts of the ring buffers.
+ */
+static const uint32_t SHARED_RING_BUFFER_VERSION = 4;
+/**
+ * Length of the metadata block that precedes the ring buffer: a page, to keep the ring buffer page aligned.
+ */
+static const index_t SHARED_RING_BUFFER_METADATA_LENGTH = 4096;
+
+enum shared_ring_buffer_layout_kind {
+    SHARED_RING_BUFFER_LAYOUT = 1,
+    SHARED_FIXED_SIZE_RING_BUFFER_LAYOUT = 2
+};
+
+enum shared_memory_kind {
+    //POSIX shared memory object ie /dev/shm/<name>
+    SHARED_MEMORY_SHM,
+    //regular file on any mmap-able file system
+    SHARED_MEMORY_FILE
+};
+
+struct shared_ring_buffer_metadata {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t layout_kind;
+    uint64_t buffer_length;
+    uint64_t requested_capacity;
+    uint32_t message_size;
+    //of the fixed size ring buffers only
+    uint16_t slot_layout;
+    uint16_t payload_alignment;
+};
+
+struct shared_ring_buffer {
+    uint8_t *address;
+    size_t length;
+    uint8_t *buffer;
+    index_t buffer_length;
+    enum shared_ring_buffer_layout_kind layout_kind;
+};
+
+inline static int open_shared_memory(const char *const name, const enum shared_memory_kind kind, const int flags) {
+    if (kind == SHARED_MEMORY_SHM) {
+        return shm_open(name, flags, S_IRUSR | S_IWUSR);
+    }
+    return open(name, flags, S_IRUSR | S_IWUSR);
+}
+
+inline static bool unlink_shared_ring_buffer(const char *const name, const enum shared_memory_kind kind) {
+    if (kind == SHARED_MEMORY_SHM) {
+        return shm_unlink(name) == 0;
+    }
+    return unlink(name) == 0;
+}
+
+inline static bool map_shared_memory(const int fd, const size_t length, struct shared_ring_buffer *const shared) {
+    void *const address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    shared->address = (uint8_t *) address;
+    shared->length = length;
+    shared->buffer = shared->address + SHARED_RING_BUFFER_METADATA_LENGTH;
+    shared->buffer_length = (index_t) (length - SHARED_RING_BUFFER_METADATA_LENGTH);
+    return true;
+}
+
+inline static bool
+create_shared_memory(const char *const name, const enum shared_memory_kind kind,
+                     const enum shared_ring_buffer_layout_kind layout_kind,
+                     const index_t buffer_length, const index_t requested_capacity, const uint32_t message_size,
+                     const enum fixed_size_slot_layout slot_layout, const uint32_t payload_alignment,
+                     struct shared_ring_buffer *const shared) {
+    //O_EXCL: 2 creators can't race on the same ring and a stale ring must be explicitly unlinked
+    const int fd = open_shared_memory(name, kind, O_CREAT | O_EXCL | O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    const size_t length = (size_t) SHARED_RING_BUFFER_METADATA_LENGTH + buffer_length;
+    //a truncated shm object or file is zero filled, hence the ring buffer doesn't need any memset
+    if (ftruncate(fd, length) != 0 || !map_shared_memory(fd, length, shared)) {
+        close(fd);
+        unlink_shared_ring_buffer(name, kind);
+        return false;
+    }
+    //the mapping stays valid after the close
+    close(fd);
+    struct shared_ring_buffer_metadata *const metadata = (struct shared_ring_buffer_metadata *) shared->address;
+    metadata->version = SHARED_RING_BUFFER_VERSION;
+    metadata->layout_kind = layout_kind;
+    metadata->buffer_length = buffer_length;
+    metadata->requested_capacity = requested_capacity;
+    metadata->message_size = message_size;
+    metadata->slot_layout = (uint16_t) slot_layout;
+    metadata->payload_alignment = (uint16_t) payload_alignment;
+    shared->layout_kind = layout_kind;
+    return true;
+}
+
+/**
+ * Makes a created ring visible to the attachers: to be called only after its header is validated.
+ */
+inline static void publish_shared_memory(const struct shared_ring_buffer *const shared) {
+    struct shared_ring_buffer_metadata *const metadata = (struct shared_ring_buffer_metadata *) shared->address;
+    const _Atomic uint64_t *const magic_address = (_Atomic uint64_t *) &metadata->magic;
+    atomic_store_explicit(magic_address, SHARED_RING_BUFFER_MAGIC, memory_order_release);
+}
+
+inline static bool
+attach_shared_memory(const char *const name, const enum shared_memory_kind kind,
+                     const enum shared_ring_buffer_layout_kind layout_kind,
+                     struct shared_ring_buffer *const shared) {
+    const int fd = open_shared_memory(name, kind, O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= SHARED_RING_BUFFER_METADATA_LENGTH ||
+        !map_shared_memory(fd, file_stat.st_size, shared)) {
+        close(fd);
+        return false;
+    }
+    close(fd);
+    const struct shared_ring_buffer_metadata *const metadata = (struct shared_ring_buffer_metadata *) shared->address;
+    const _Atomic uint64_t *const magic_address = (_Atomic uint64_t *) &metadata->magic;
+    //the creator could be still initializing it: the caller can retry later
+    const bool valid = atomic_load_explicit(magic_address, memory_order_acquire) == SHARED_RING_BUFFER_MAGIC &&
+                       metadata->version == SHARED_RING_BUFFER_VERSION &&
+                       metadata->layout_kind == layout_kind &&
+                       metadata->buffer_length == (uint64_t) shared->buffer_length;
+    if (!valid) {
+        munmap(shared->address, shared->length);
+        return false;
+    }
+    shared->layout_kind = layout_kind;
+    return true;
+}
+
+inline static void close_shared_ring_buffer(struct shared_ring_buffer *const shared) {
+    munmap(shared->address, shared->length);
+    shared->address = NULL;
+    shared->buffer = NULL;
+    shared->length = 0;
+    shared->buffer_length = 0;
+}
+
+inline static bool
+create_shared_ring_buffer(const char *const name, const enum shared_memory_kind kind,
+                          const index_t requested_capacity,
+                          struct shared_ring_buffer *const shared, struct ring_buffer_header *const header) {
+    const index_t buffer_length = ring_buffer_capacity(requested_capacity);
+    //0 if the requested capacity overflows an index_t: nothing has to be created
+    if (buffer_length == 0 || !init_ring_buffer_header(header, buffer_length) ||
+        !create_shared_memory(name, kind, SHARED_RING_BUFFER_LAYOUT, buffer_length, requested_capacity, 0,
+                              FIXED_SIZE_SLOT_LAYOUT_PACKED, 0, shared)) {
+        return false;
+    }
+    publish_shared_memory(shared);
+    return true;
+}
+
+inline static bool
+attach_shared_ring_buffer(const char *const name, const enum shared_memory_kind kind,
+                          struct shared_ring_buffer *const shared, struct ring_buffer_header *const header) {
+    if (!attach_shared_memory(name, kind, SHARED_RING_BUFFER_LAYOUT, shared)) {
+        return false;
+    }
+    if (!init_ring_buffer_header(header, shared->buffer_length)) {
+        close_shared_ring_buffer(shared);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The fixed size variants need the definitions in fixed_size_ring_buffer.c to be included by the caller.
+ * The attachers get the slot layout and the payload alignment of the creator.
+ */
+inline static bool
+create_shared_fixed_size_ring_buffer(const char *const name, const enum shared_memory_kind kind,
+                                     const index_t requested_capacity, const uint32_t message_size,
+                                     const enum fixed_size_slot_layout slot_layout, const uint32_t payload_alignment,
+                                     struct shared_ring_buffer *const shared,
+                                     struct fixed_size_ring_buffer_header *const header) {
+    const index_t buffer_length = fixed_size_ring_buffer_layout_capacity(requested_capacity, message_size,
+                                                                         slot_layout, payload_alignment);
+    if (buffer_length == 0 ||
+        !create_shared_memory(name, kind, SHARED_FIXED_SIZE_RING_BUFFER_LAYOUT, buffer_length, requested_capacity,
+                              message_size, slot_layout, payload_alignment, shared)) {
+        return false;
+    }
+    //an unpublished ring can't be attached: it is removed, to not leave a name that can't be created again
+    if (!init_fixed_size_ring_buffer_layout_header(shared->buffer, header, requested_capacity, message_size,
+                                                   slot_layout, payload_alignment)) {
+        close_shared_ring_buffer(shared);
+        unlink_shared_ring_buffer(name, kind);
+        return false;
+    }
+    publish_shared_memory(shared);
+    return true;
+}
+
+inline static bool
+attach_shared_fixed_size_ring_buffer(const char *const name, const enum shared_memory_kind kind,
+                                     struct shared_ring_buffer *const shared,
+                                     struct fixed_size_ring_buffer_header *const header) {
+    if (!attach_shared_memory(name, kind, SHARED_FIXED_SIZE_RING_BUFFER_LAYOUT, shared)) {
+        return false;
+    }
+    const struct shared_ring_buffer_metadata *const metadata = (struct shared_ring_buffer_metadata *) shared->address;
+    const index_t requested_capacity = (index_t) metadata->requested_capacity;
+    const uint32_t message_size = metadata->message_size;
+    const enum fixed_size_slot_layout slot_layout = (enum fixed_size_slot_layout) metadata->slot_layout;
+    const uint32_t payload_alignment = metadata->payload_alignment;
+    //the layout of the creator must be the same computed by this process
+    if (fixed_size_ring_buffer_layout_capacity(requested_capacity, message_size, slot_layout, payload_alignment) !=
+        shared->buffer_length ||
+        !init_fixed_size_ring_buffer_layout_header(shared->buffer, header, requested_capacity, message_size,
+                                                   slot_layout, payload_alignment)) {
+        close_shared_ring_buffer(shared);
+        return false;
+    }
+    return true;
+}
+
+#endif //FRANZ_FLOW_SHARED_RING_BUFFER_H
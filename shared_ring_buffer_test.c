@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "ring_buffer.h"
+#include "fixed_size_ring_buffer.c"
+#include "shared_ring_buffer.h"
+
+/**
+ * shared_ring_buffer between a creator and a forked process that attaches by name, and the attaches that must be
+ * rejected: exits with 1 if any check fails.
+ */
+
+#define MSG_TYPE_ID 1
+//a few laps of 16 bytes records
+#define RING_CAPACITY 4096
+#define MESSAGES 10000
+
+static uint32_t failures = 0;
+
+static void check(const bool condition, const char *const test, const char *const what) {
+    if (!condition) {
+        fprintf(stderr, "%s: %s\n", test, what);
+        failures++;
+    }
+}
+
+/**
+ * A name per process and per test: a ring left behind by a crashed run of this test can't be attached by another.
+ */
+static void test_ring_name(char *const name, const size_t length, const char *const test) {
+    snprintf(name, length, "/franz_flow_%s_%d", test, (int) getpid());
+    unlink_shared_ring_buffer(name, SHARED_MEMORY_SHM);
+}
+
+static bool on_message(const uint32_t msg_type_id, const uint8_t *buffer, const index_t msg_content_index,
+                       const index_t msg_content_length, void *context) {
+    uint64_t value;
+    memcpy(&value, buffer + msg_content_index, sizeof(value));
+    *((uint64_t *) context) += value;
+    return true;
+}
+
+static bool try_send(const struct ring_buffer_header *const header, uint8_t *const buffer, const uint64_t value) {
+    uint64_t claimed_position;
+    index_t claimed_index;
+    if (!try_ring_buffer_sp_claim(header, buffer, sizeof(value), &claimed_position, &claimed_index)) {
+        return false;
+    }
+    memcpy(buffer + encoded_msg_offset(claimed_index), &value, sizeof(value));
+    return ring_buffer_commit(buffer, claimed_index, MSG_TYPE_ID, sizeof(value));
+}
+
+/**
+ * The forked process: attaches both rings by name, sums the MESSAGES values received on the first and replies
+ * with the sum on the second.
+ */
+static int attached_child(const char *const name, const char *const reply_name) {
+    struct shared_ring_buffer shared;
+    struct ring_buffer_header header;
+    struct shared_ring_buffer reply_shared;
+    struct ring_buffer_header reply_header;
+    if (!attach_shared_ring_buffer(name, SHARED_MEMORY_SHM, &shared, &header)) {
+        return 2;
+    }
+    if (!attach_shared_ring_buffer(reply_name, SHARED_MEMORY_SHM, &reply_shared, &reply_header)) {
+        close_shared_ring_buffer(&shared);
+        return 2;
+    }
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, IDLE_STRATEGY_BACKOFF);
+    uint64_t checksum = 0;
+    uint32_t read = 0;
+    while (read < MESSAGES) {
+        const uint32_t msg_read = ring_buffer_batch_read(&header, shared.buffer, &on_message, 64, &checksum);
+        idle_strategy_idle_work(&idle_strategy, msg_read);
+        read += msg_read;
+    }
+    while (!try_send(&reply_header, reply_shared.buffer, checksum)) {
+        idle_strategy_idle(&idle_strategy);
+    }
+    close_shared_ring_buffer(&reply_shared);
+    close_shared_ring_buffer(&shared);
+    return 0;
+}
+
+/**
+ * If the child has exited, stores its exit status and returns false.
+ */
+static bool child_alive(const pid_t child, int *const status) {
+    return waitpid(child, status, WNOHANG) == 0;
+}
+
+static void test_fork_exchange(void) {
+    char name[64];
+    char reply_name[64];
+    test_ring_name(name, sizeof(name), "exchange");
+    test_ring_name(reply_name, sizeof(reply_name), "exchange_reply");
+    struct shared_ring_buffer shared;
+    struct ring_buffer_header header;
+    struct shared_ring_buffer reply_shared;
+    struct ring_buffer_header reply_header;
+    if (!create_shared_ring_buffer(name, SHARED_MEMORY_SHM, RING_CAPACITY, &shared, &header)) {
+        check(false, __func__, "can't create");
+        return;
+    }
+    if (!create_shared_ring_buffer(reply_name, SHARED_MEMORY_SHM, RING_CAPACITY, &reply_shared, &reply_header)) {
+        check(false, __func__, "can't create the reply ring");
+        close_shared_ring_buffer(&shared);
+        unlink_shared_ring_buffer(name, SHARED_MEMORY_SHM);
+        return;
+    }
+    fflush(stderr);
+    const pid_t child = fork();
+    if (child == 0) {
+        _exit(attached_child(name, reply_name));
+    }
+    check(child > 0, __func__, "can't fork");
+    struct idle_strategy idle_strategy;
+    init_idle_strategy(&idle_strategy, IDLE_STRATEGY_BACKOFF);
+    //a child that exits early (ie it can't attach) stops the exchange
+    int status = 0;
+    bool alive = child > 0;
+    for (uint64_t value = 1; alive && value <= MESSAGES; value++) {
+        while (!try_send(&header, shared.buffer, value) && (alive = child_alive(child, &status))) {
+            idle_strategy_idle(&idle_strategy);
+        }
+        idle_strategy_reset(&idle_strategy);
+    }
+    uint64_t reply = 0;
+    while (alive && ring_buffer_batch_read(&reply_header, reply_shared.buffer, &on_message, 1, &reply) == 0) {
+        alive = child_alive(child, &status);
+        idle_strategy_idle(&idle_strategy);
+    }
+    if (alive) {
+        waitpid(child, &status, 0);
+    }
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0, __func__, "the child failed or can't attach");
+    check(reply == (uint64_t) MESSAGES * (MESSAGES + 1) / 2, __func__, "wrong checksum");
+    close_shared_ring_buffer(&reply_shared);
+    close_shared_ring_buffer(&shared);
+    unlink_shared_ring_buffer(reply_name, SHARED_MEMORY_SHM);
+    unlink_shared_ring_buffer(name, SHARED_MEMORY_SHM);
+}
+
+static void test_attach_rejected(void) {
+    char name[64];
+    test_ring_name(name, sizeof(name), "rejected");
+    struct shared_ring_buffer shared;
+    struct ring_buffer_header header;
+    if (!create_shared_ring_buffer(name, SHARED_MEMORY_SHM, RING_CAPACITY, &shared, &header)) {
+        check(false, __func__, "can't create");
+        return;
+    }
+    struct shared_ring_buffer attached;
+    struct ring_buffer_header attached_header;
+    check(attach_shared_ring_buffer(name, SHARED_MEMORY_SHM, &attached, &attached_header), __func__,
+          "can't attach");
+    close_shared_ring_buffer(&attached);
+    //wrong layout
+    struct fixed_size_ring_buffer_header fixed_size_header;
+    check(!attach_shared_fixed_size_ring_buffer(name, SHARED_MEMORY_SHM, &attached, &fixed_size_header), __func__,
+          "attached with the wrong layout");
+    //wrong version
+    struct shared_ring_buffer_metadata *const metadata = (struct shared_ring_buffer_metadata *) shared.address;
+    metadata->version = SHARED_RING_BUFFER_VERSION + 1;
+    check(!attach_shared_ring_buffer(name, SHARED_MEMORY_SHM, &attached, &attached_header), __func__,
+          "attached with the wrong version");
+    metadata->version = SHARED_RING_BUFFER_VERSION;
+    //not published yet
+    metadata->magic = 0;
+    check(!attach_shared_ring_buffer(name, SHARED_MEMORY_SHM, &attached, &attached_header), __func__,
+          "attached before being published");
+    publish_shared_memory(&shared);
+    //wrong size: the object has grown after the creation
+    const int fd = open_shared_memory(name, SHARED_MEMORY_SHM, O_RDWR);
+    check(fd >= 0 && ftruncate(fd, shared.length + SHARED_RING_BUFFER_METADATA_LENGTH) == 0, __func__,
+          "can't resize");
+    if (fd >= 0) {
+        close(fd);
+    }
+    check(!attach_shared_ring_buffer(name, SHARED_MEMORY_SHM, &attached, &attached_header), __func__,
+          "attached with the wrong size");
+    close_shared_ring_buffer(&shared);
+    unlink_shared_ring_buffer(name, SHARED_MEMORY_SHM);
+}
+
+int main(int argc, char *argv[]) {
+    test_fork_exchange();
+    test_attach_rejected();
+    if (failures != 0) {
+        fprintf(stderr, "%u checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
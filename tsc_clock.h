@@ -0,0 +1,101 @@
+//
+// Created by forked_franz on 16/10/26.
+//
+
+#ifndef FRANZ_FLOW_TSC_CLOCK_H
+#define FRANZ_FLOW_TSC_CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <x86intrin.h>
+#include <cpuid.h>
+
+#endif
+
+/**
+ * Timestamps cheap enough to be taken on each message: the TSC ticks, calibrated against CLOCK_MONOTONIC.
+ * The ticks are comparable across cores only with an invariant TSC, otherwise (or if the cpu isn't x86) the clock
+ * falls back to the CLOCK_MONOTONIC nanos, ie a tick is a nano.
+ */
+
+static const uint64_t TSC_CLOCK_DEFAULT_CALIBRATION_NANOS = 100 * 1000 * 1000;
+
+struct tsc_clock {
+    bool tsc;
+    double nanos_per_tick;
+    double ticks_per_nano;
+};
+
+inline static uint64_t monotonic_nanos() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (((uint64_t) time.tv_sec) * 1000000000) + time.tv_nsec;
+}
+
+inline static bool is_tsc_invariant() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_max(0x80000000, NULL) < 0x80000007) {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1 << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+inline static uint64_t tsc_clock_ticks(const struct tsc_clock *const clock) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (clock->tsc) {
+        //not serializing: the stamp can move across the loads around it, but not across the ring's fences
+        return __rdtsc();
+    }
+#endif
+    return monotonic_nanos();
+}
+
+inline static double tsc_clock_nanos(const struct tsc_clock *const clock, const uint64_t ticks) {
+    return ticks * clock->nanos_per_tick;
+}
+
+inline static uint64_t tsc_clock_ticks_of(const struct tsc_clock *const clock, const double nanos) {
+    return (uint64_t) (nanos * clock->ticks_per_nano);
+}
+
+/**
+ * Spins for calibration_nanos to measure the TSC frequency: the longer, the more precise.
+ */
+inline static void init_tsc_clock(struct tsc_clock *const clock, const uint64_t calibration_nanos) {
+    clock->tsc = false;
+    clock->nanos_per_tick = 1;
+    clock->ticks_per_nano = 1;
+#if defined(__x86_64__) || defined(__i386__)
+    if (!is_tsc_invariant()) {
+        return;
+    }
+    //each CLOCK_MONOTONIC read is bracketed by two TSC reads and paired with their middle
+    const uint64_t start_before_ticks = __rdtsc();
+    const uint64_t start_nanos = monotonic_nanos();
+    const uint64_t start_ticks = start_before_ticks + ((__rdtsc() - start_before_ticks) / 2);
+    uint64_t end_before_ticks;
+    uint64_t end_nanos;
+    do {
+        end_before_ticks = __rdtsc();
+        end_nanos = monotonic_nanos();
+    } while (end_nanos - start_nanos < calibration_nanos);
+    const uint64_t end_ticks = end_before_ticks + ((__rdtsc() - end_before_ticks) / 2);
+    if (end_ticks <= start_ticks) {
+        return;
+    }
+    clock->tsc = true;
+    clock->nanos_per_tick = ((double) (end_nanos - start_nanos)) / (end_ticks - start_ticks);
+    clock->ticks_per_nano = 1 / clock->nanos_per_tick;
+#endif
+}
+
+#endif //FRANZ_FLOW_TSC_CLOCK_H